@@ -35,9 +35,9 @@ static void write_file(FileSystem &fs, const char *name) {
     auto finished = millis();
     auto elapsed = float(finished - started) / 1000.0f;
 
-    sdebug() << "Bytes: " << file.size() << endl;
+    sdebug() << "Bytes: " << (uint32_t)file.size() << endl;
     sdebug() << "Duration: " << elapsed << endl;
-    sdebug() << "Bytes/s: " << file.size() / float(elapsed) << endl;
+    sdebug() << "Bytes/s: " << (uint32_t)file.size() / float(elapsed) << endl;
 
     file.close();
 }
@@ -60,7 +60,7 @@ static void read_file(FileSystem &fs, const char *name) {
     auto finished = millis();
     auto elapsed = float(finished - started) / 1000.0f;
 
-    sdebug() << "Bytes: " << file.size() << endl;
+    sdebug() << "Bytes: " << (uint32_t)file.size() << endl;
     sdebug() << "Duration: " << elapsed << endl;
     sdebug() << "Bytes/s: " << read / float(elapsed) << endl;
 
@@ -71,14 +71,14 @@ static void seek_end_file(FileSystem &fs, const char *name) {
     auto started = millis();
     auto file = fs.open(name, true);
 
-    file.seek(UINT32_MAX);
+    file.seek(Seek::End);
 
     auto finished = millis();
     auto elapsed = float(finished - started) / 1000.0f;
 
-    sdebug() << "Bytes: " << file.size() << endl;
+    sdebug() << "Bytes: " << (uint32_t)file.size() << endl;
     sdebug() << "Duration: " << elapsed << endl;
-    sdebug() << "Bytes/s: " << file.size() / float(elapsed) << endl;
+    sdebug() << "Bytes/s: " << (uint32_t)file.size() / float(elapsed) << endl;
 
     file.close();
 }
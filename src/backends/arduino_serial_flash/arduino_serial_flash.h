@@ -39,7 +39,7 @@ public:
     ArduinoSerialFlashBackend(StorageBackendCallbacks &callbacks);
 
 public:
-    bool initialize(uint8_t cs, sector_index_t sector_size = 512, uint32_t maximum_blocks = SerialFlashAllocator::MaximumBlocks);
+    bool initialize(uint8_t cs, sector_index_t sector_size = 512, uint32_t maximum_blocks = 0);
     void geometry(Geometry &g) {
         geometry_ = g;
     }
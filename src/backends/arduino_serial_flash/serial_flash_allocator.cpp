@@ -5,29 +5,15 @@ using namespace alogging;
 namespace phylum {
 
 SerialFlashAllocator::SerialFlashAllocator(StorageBackend &storage) : storage_(&storage) {
-    for (auto i = 0; i < PreallocationSize; ++i) {
-        preallocated_[i] = BLOCK_INDEX_INVALID;
-    }
-}
-
-static inline bool is_block_free(uint8_t *map, block_index_t block) {
-    return !(map[block / 8] & (1 << (block % 8)));
-}
-
-static inline void set_block_free(uint8_t *map, block_index_t block) {
-    map[block / 8] &= ~(1 << (block % 8));
-}
-
-static inline void set_block_taken(uint8_t *map, block_index_t block) {
-    map[block / 8] |= (1 << (block % 8));
 }
 
 AllocatedBlock SerialFlashAllocator::allocate(BlockType type) {
-    for (auto i = 0; i < PreallocationSize; ++i) {
-        if (is_valid_block(preallocated_[i])) {
-            auto f = preallocated_[i];
-            preallocated_[i] = BLOCK_INDEX_INVALID;
-            return { f, 0, true };
+    // Preallocated blocks are cold, so they're only for files.
+    for (auto i = 0; stream_of(type) == BlockStream::Cold && i < PreallocationSize; ++i) {
+        if (preallocated_[i].valid()) {
+            auto alloc = preallocated_[i];
+            preallocated_[i] = { };
+            return alloc;
         }
     }
 
@@ -35,28 +21,52 @@ AllocatedBlock SerialFlashAllocator::allocate(BlockType type) {
 }
 
 AllocatedBlock SerialFlashAllocator::allocate_internal(BlockType type) {
-    ScanInfo info;
-
-    if (!scan(true, info)) {
+    auto selected = take(stream_of(type));
+    if (selected.block == BLOCK_INDEX_INVALID) {
         sdebug() << "Failed to allocate! (" << type << ")" << endl;
         return { };
     }
 
     #ifdef PHYLUM_ARDUINO_DEBUG
-    sdebug() << "Allocate: " << type << " = " << (uint32_t)info.block << " " << info.age << endl;
+    sdebug() << "Allocate: " << type << " = " << (uint32_t)selected.block << " " << selected.age << endl;
     #endif
 
-    assert(info.block != BLOCK_INDEX_INVALID);
+    return { selected.block, selected.age, false };
+}
+
+BlockHeap::Entry SerialFlashAllocator::take(BlockStream stream, bool borrowing) {
+    auto blank = stream == BlockStream::Hot ? blank_.last_free() : blank_.first_free();
+    if (blank != BLOCK_INDEX_INVALID) {
+        blank_.set_taken(blank);
+        map_.set_taken(blank);
+        return { blank, 0 };
+    }
 
-    set_block_taken(map_, info.block);
+    // Only once the stream's own blocks are gone do we take the other's.
+    auto &own = available_[(uint8_t)stream];
+    auto &other = available_[(uint8_t)(stream == BlockStream::Hot ? BlockStream::Cold : BlockStream::Hot)];
+    auto selected = !own.empty() || !borrowing ? own.pop() : other.pop();
+    if (selected.block != BLOCK_INDEX_INVALID) {
+        map_.set_taken(selected.block);
+    }
 
-    return { info.block, info.age, false };
+    return selected;
 }
 
 bool SerialFlashAllocator::initialize() {
-    ScanInfo info;
+    auto nblocks = storage_->geometry().number_of_blocks;
 
-    if (!scan(false, info)) {
+    if (map_.size() != nblocks) {
+        auto cold = nblocks / 2;
+        if (!map_.initialize(nblocks) || !blank_.initialize(nblocks) ||
+            !available_[(uint8_t)BlockStream::Cold].initialize(cold) ||
+            !available_[(uint8_t)BlockStream::Hot].initialize(nblocks - cold)) {
+            sdebug() << "Failed to allocate block map!" << endl;
+            return false;
+        }
+    }
+
+    if (!scan()) {
         return false;
     }
 
@@ -89,84 +99,42 @@ bool SerialFlashAllocator::is_taken(block_index_t block) {
     return is_taken(block, header);
 }
 
-bool SerialFlashAllocator::scan(bool free_only, ScanInfo *blocks, size_t size) {
-    size_t n = 0;
+bool SerialFlashAllocator::scan() {
+    for (auto &heap : available_) {
+        heap.clear();
+    }
 
-    for (size_t block = 0; block < size; block++) {
-        blocks[block] = { BLOCK_INDEX_INVALID, 0 };
+    // These are always taken, anchor blocks and we skip block 0, for now.
+    for (auto block = (uint32_t)0; block < 3; ++block) {
+        map_.set_taken(block);
+        blank_.set_taken(block);
     }
 
     for (auto block = (uint32_t)3; block < storage_->geometry().number_of_blocks; ++block) {
-        if (free_only) {
-            if (!is_block_free(map_, block)) {
-                continue;
-            }
-        }
-
         BlockHead candidate;
         if (is_taken(block, candidate)) {
-            set_block_taken(map_, block);
+            map_.set_taken(block);
+            blank_.set_taken(block);
             #ifdef PHYLUM_ARDUINO_DEBUG
             sdebug() << "Block " << (uint32_t)block << " is taken. (age=" << candidate.age << ", " << candidate.type << ")" << endl;
             #endif
         }
         else {
-            set_block_free(map_, block);
+            map_.set_free(block);
             #ifdef PHYLUM_ARDUINO_DEBUG
             sdebug() << "Block " << (uint32_t)block << " is free. (age=" << candidate.age << ")" << (candidate.valid() ? "" : " Invalid") << endl;
             #endif
 
-            if (size == 1) {
-                if (candidate.valid()) {
-                    if (blocks->block == BLOCK_INDEX_INVALID || candidate.age < blocks->age) {
-                        blocks->block = block;
-                        blocks->age = candidate.age;
-                    }
-                }
-                else {
-                    // Using 0 here means no other "valid" block can win, so we're
-                    // picking this invalid block regardless.
-                    blocks->block = block;
-                    blocks->age = 0;
-                }
+            if (candidate.valid()) {
+                blank_.set_taken(block);
+                available(block).push(block, candidate.age);
             }
             else {
-                if (candidate.valid()) {
-                    blocks[n].block = block;
-                    blocks[n].age = candidate.age;
-                    n++;
-                }
-                else {
-                    // Using 0 here means no other "valid" block can win, so we're
-                    // picking this invalid block regardless.
-                    blocks[n].block = block;
-                    blocks[n].age = 0;
-                    n++;
-                }
-
-                if (n == size) {
-                    break;
-                }
+                blank_.set_free(block);
             }
         }
     }
 
-    // These are always taken, anchor blocks and we skip block 0, for now.
-    set_block_taken(map_, 0);
-    set_block_taken(map_, 1);
-    set_block_taken(map_, 2);
-
-    return true;
-}
-
-bool SerialFlashAllocator::scan(bool free_only, ScanInfo &selected) {
-    selected.block = BLOCK_INDEX_INVALID;
-    selected.age = BLOCK_AGE_INVALID;
-
-    if (!scan(free_only, &selected, 1)) {
-        return false;
-    }
-
     return true;
 }
 
@@ -193,88 +161,64 @@ bool SerialFlashAllocator::free(block_index_t block, block_age_t age) {
         return false;
     }
 
-    set_block_free(map_, block);
+    // Anchor blocks are never handed out, and blocks that were already free
+    // are in the heap from before, with their old age, unless they were
+    // blank until now.
+    if (block >= 3) {
+        if (blank_.is_free(block)) {
+            blank_.set_taken(block);
+            available(block).push(block, age);
+        }
+        else if (map_.is_free(block)) {
+            available(block).update(block, age);
+        }
+        else {
+            map_.set_free(block);
+            available(block).push(block, age);
+        }
+    }
 
     return true;
 }
 
 uint32_t SerialFlashAllocator::number_of_free_blocks() {
-    uint32_t c = 0;
-    for (auto block = (uint32_t)0; block < storage_->geometry().number_of_blocks; ++block) {
-        if (is_block_free(map_, block)) {
-            c++;
-        }
-    }
-    return c;
-}
-
-static SerialFlashAllocator::ScanInfo *take_block(SerialFlashAllocator::ScanInfo *available, size_t size) {
-    SerialFlashAllocator::ScanInfo *selected = nullptr;
-
-    for (size_t i = 0; i < size; ++i) {
-        auto &candidate = available[i];
-
-        if (candidate.block != BLOCK_INDEX_INVALID) {
-            if (selected == nullptr || candidate.age < selected->age || candidate.age == 0) {
-                selected = &candidate;
-            }
-        }
-    }
-
-    return selected;
+    return map_.number_of_free();
 }
 
 bool SerialFlashAllocator::preallocate(uint32_t expected_size) {
-    // This is risk, though given this backend we're sure this will never be
-    // more than 64. So this will nearly always be less than 1k.
-    auto nblocks = storage_->geometry().number_of_blocks;
-    auto available = (ScanInfo *)alloca(sizeof(ScanInfo) * nblocks);
-
-    if (!scan(true, available, nblocks)) {
-        return false;
-    }
-
     for (auto i = 0; i < PreallocationSize; ++i) {
-        auto alloc = take_block(available, nblocks);
-
-        assert(alloc != nullptr);
-
-        set_block_taken(map_, alloc->block);
+        if (preallocated_[i].valid()) {
+            continue;
+        }
 
-        if (!storage_->erase(alloc->block)) {
+        // Preallocating is for files, and never takes hot blocks to do it.
+        auto selected = take(BlockStream::Cold, false);
+        if (selected.block == BLOCK_INDEX_INVALID) {
             return false;
         }
 
-        preallocated_[i] = alloc->block;
+        if (!storage_->erase(selected.block)) {
+            return false;
+        }
 
-        alloc->block = BLOCK_INDEX_INVALID;
-        alloc->age = BLOCK_AGE_INVALID;
+        preallocated_[i] = { selected.block, selected.age, true };
     }
     return true;
 }
 
-TakenBlockTracker::TakenBlockTracker() {
-    for (auto block = (uint32_t)0; block < sizeof(map_) * 8; ++block) {
-        set_block_free(map_, block);
-    }
-
-    set_block_taken(map_, 0);
-    set_block_taken(map_, 1);
-    set_block_taken(map_, 2);
+TakenBlockTracker::TakenBlockTracker(uint32_t number_of_blocks) {
+    map_.initialize(number_of_blocks);
+    map_.set_taken(0);
+    map_.set_taken(1);
+    map_.set_taken(2);
 }
 
 void TakenBlockTracker::block(VisitInfo info) {
-    auto block = info.block;
-    if (block < sizeof(map_) * 8) {
-        set_block_taken(map_, block);
-    }
+    map_.set_taken(info.block);
 }
 
 bool TakenBlockTracker::is_free(block_index_t block) {
-    if (block < sizeof(map_) * 8) {
-        return is_block_free(map_, block);
-    }
-    return false;
+    return map_.is_free(block);
 }
 
 }
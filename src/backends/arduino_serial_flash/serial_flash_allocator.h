@@ -2,21 +2,27 @@
 #define __PHYLUM_SERIAL_FLASH_ALLOCATOR_H_INCLUDED
 
 #include "phylum/private.h"
+#include "phylum/block_bitmap.h"
+#include "phylum/block_heap.h"
 #include "phylum/block_alloc.h"
 #include "phylum/visitor.h"
 
 namespace phylum {
 
 class SerialFlashAllocator : public ReusableBlockAllocator {
-public:
-    static constexpr size_t MaximumBlocks = 64;
-    static constexpr size_t MapSize = MaximumBlocks / 8;
-
 private:
     static constexpr int32_t PreallocationSize = 8;
-    uint32_t preallocated_[PreallocationSize];
+    AllocatedBlock preallocated_[PreallocationSize];
     StorageBackend *storage_;
-    uint8_t map_[MapSize]{ 0 };
+    BlockBitmap map_;
+    // Free blocks that have never been formatted, which are taken before
+    // any others. Hot blocks are taken from the end and cold ones from the
+    // start, so the two streams stay apart.
+    BlockBitmap blank_;
+    // Formatted free blocks, youngest first. Blocks in the first half of
+    // the device are kept for the cold stream and the rest for the hot
+    // one, indexed by BlockStream, so reused blocks stay apart too.
+    BlockHeap available_[2];
 
 public:
     SerialFlashAllocator(StorageBackend &storage);
@@ -25,20 +31,29 @@ public:
     bool initialize();
     AllocatedBlock allocate(BlockType type) override;
     bool free(block_index_t block, block_age_t age) override;
+    bool keeps_free_blocks() override {
+        return true;
+    }
 
 private:
     AllocatedBlock allocate_internal(BlockType type);
+    BlockHeap::Entry take(BlockStream stream, bool borrowing = true);
 
-public:
-    struct ScanInfo {
-        block_index_t block;
-        block_age_t age;
-    };
+    BlockStream stream_of_block(block_index_t block) {
+        return block < map_.size() / 2 ? BlockStream::Cold : BlockStream::Hot;
+    }
 
-    bool scan(bool free_only, ScanInfo &selected);
+    BlockHeap &available(block_index_t block) {
+        return available_[(uint8_t)stream_of_block(block)];
+    }
 
-    bool scan(bool free_only, ScanInfo *blocks, size_t size);
+    /**
+     * Reads the head of every block once, building the map of taken blocks
+     * and the heap of free ones that allocations are taken from after.
+     */
+    bool scan();
 
+public:
     bool is_taken(block_index_t block, BlockHead &header);
 
     bool is_taken(block_index_t block);
@@ -53,10 +68,10 @@ public:
 
 class TakenBlockTracker : public BlockVisitor {
 private:
-    uint8_t map_[SerialFlashAllocator::MapSize]{ 0 };
+    BlockBitmap map_;
 
 public:
-    TakenBlockTracker();
+    TakenBlockTracker(uint32_t number_of_blocks);
 
 public:
     void block(VisitInfo info) override;
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "phylum/block_alloc.h"
 
 namespace phylum {
@@ -10,23 +12,67 @@ SequentialBlockAllocator::SequentialBlockAllocator() {
 bool SequentialBlockAllocator::initialize(Geometry &geometry) {
     geometry_ = &geometry;
 
+    if (!is_valid_block(hot_)) {
+        hot_ = geometry.number_of_blocks - 1;
+    }
+
     return true;
 }
 
 AllocatorState SequentialBlockAllocator::state() {
-    return { block_ };
+    return { block_, streams_ ? hot_ : BLOCK_INDEX_INVALID };
 }
 
 void SequentialBlockAllocator::state(AllocatorState state) {
     block_ = state.head;
+    if (is_valid_block(state.hot)) {
+        hot_ = state.hot;
+    }
+    else if (geometry_ != nullptr) {
+        hot_ = geometry_->number_of_blocks - 1;
+    }
+}
+
+uint32_t SequentialBlockAllocator::available() {
+    if (streams_) {
+        return hot_ >= block_ ? hot_ + 1 - block_ : 0;
+    }
+    return block_ < geometry_->number_of_blocks ? geometry_->number_of_blocks - block_ : 0;
 }
 
 AllocatedBlock SequentialBlockAllocator::allocate(BlockType type) {
     assert(geometry_ != nullptr);
-    assert(block_ < geometry_->number_of_blocks);
+    assert(available() > 0);
+    if (hot(type)) {
+        return { hot_--, 0, false };
+    }
     return { block_++, 0, false };
 }
 
+BlockExtent SequentialBlockAllocator::reserve(BlockType type, uint32_t blocks) {
+    assert(geometry_ != nullptr);
+    assert(available() > 0);
+    auto size = std::min(blocks, available());
+    if (hot(type)) {
+        hot_ -= size;
+        return { hot_ + 1, size };
+    }
+    auto extent = BlockExtent{ block_, size };
+    block_ += extent.size;
+    return extent;
+}
+
+bool SequentialBlockAllocator::release(BlockExtent extent) {
+    // We can only take blocks back when nothing was allocated after them.
+    if (extent.valid() && extent.block + extent.size == block_) {
+        block_ = extent.block;
+    }
+    else if (streams_ && extent.valid() && extent.block == hot_ + 1) {
+        hot_ += extent.size;
+    }
+    return true;
+}
+
 bool SequentialBlockAllocator::free(block_index_t block, block_age_t age) {
     return true;
 }
@@ -43,6 +89,29 @@ AllocatedBlock DebuggingBlockAllocator::allocate(BlockType type) {
     return alloc;
 }
 
+BlockExtent DebuggingBlockAllocator::reserve(BlockType type, uint32_t blocks) {
+    auto extent = SequentialBlockAllocator::reserve(type, blocks);
+    for (auto i = (uint32_t)0; i < extent.size; ++i) {
+        assert(allocations_.find(extent.block + i) == allocations_.end());
+        allocations_[extent.block + i] = type;
+    }
+    return extent;
+}
+
+bool DebuggingBlockAllocator::release(BlockExtent extent) {
+    auto before = state();
+    if (!SequentialBlockAllocator::release(extent)) {
+        return false;
+    }
+    auto after = state();
+    if (after.head != before.head || after.hot != before.hot) {
+        for (auto i = (uint32_t)0; i < extent.size; ++i) {
+            allocations_.erase(extent.block + i);
+        }
+    }
+    return true;
+}
+
 QueueBlockAllocator::QueueBlockAllocator() {
 }
 
@@ -59,7 +128,7 @@ AllocatorState QueueBlockAllocator::state() {
 void QueueBlockAllocator::state(AllocatorState state) {
 }
 
-AllocatedBlock QueueBlockAllocator::allocate(BlockType type) {
+void QueueBlockAllocator::fill() {
     assert(geometry_ != nullptr);
 
     if (!initialized_) {
@@ -68,6 +137,10 @@ AllocatedBlock QueueBlockAllocator::allocate(BlockType type) {
         }
         initialized_ = true;
     }
+}
+
+AllocatedBlock QueueBlockAllocator::allocate(BlockType type) {
+    fill();
 
     assert(!free_.empty());
 
@@ -78,6 +151,22 @@ AllocatedBlock QueueBlockAllocator::allocate(BlockType type) {
     return { block, 0, false };
 }
 
+BlockExtent QueueBlockAllocator::reserve(BlockType type, uint32_t blocks) {
+    fill();
+
+    assert(!free_.empty());
+
+    // Blocks are freed in order often enough that the front of the queue is
+    // usually a run, so we take as much of it as we can.
+    auto extent = BlockExtent{ free_.front(), 0 };
+    while (!free_.empty() && extent.size < blocks && free_.front() == extent.block + extent.size) {
+        free_.pop();
+        extent.size++;
+    }
+
+    return extent;
+}
+
 bool QueueBlockAllocator::free(block_index_t block, block_age_t age) {
     free_.push(block);
 
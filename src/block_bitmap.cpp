@@ -0,0 +1,139 @@
+#include <cstring>
+
+#include "phylum/block_bitmap.h"
+
+namespace phylum {
+
+BlockBitmap::BlockBitmap() {
+}
+
+BlockBitmap::~BlockBitmap() {
+    release();
+}
+
+void BlockBitmap::release() {
+    ::free(words_);
+    ::free(summary_);
+    words_ = nullptr;
+    summary_ = nullptr;
+    size_ = 0;
+    free_ = 0;
+}
+
+bool BlockBitmap::initialize(uint32_t number_of_blocks, bool free) {
+    release();
+
+    auto words = words_for(number_of_blocks);
+    auto summaries = words_for(words);
+
+    words_ = (uint32_t *)malloc(sizeof(uint32_t) * words);
+    summary_ = (uint32_t *)malloc(sizeof(uint32_t) * summaries);
+    if (words_ == nullptr || summary_ == nullptr) {
+        release();
+        return false;
+    }
+
+    memset(words_, free ? 0 : 0xff, sizeof(uint32_t) * words);
+    memset(summary_, 0, sizeof(uint32_t) * summaries);
+
+    // Bits past the end are taken so they're never found.
+    if (free && number_of_blocks % BitsPerWord != 0) {
+        words_[words - 1] = ~(((uint32_t)1 << (number_of_blocks % BitsPerWord)) - 1);
+    }
+
+    size_ = number_of_blocks;
+    free_ = free ? number_of_blocks : 0;
+
+    for (auto i = (uint32_t)0; i < words; ++i) {
+        summarize(i);
+    }
+
+    return true;
+}
+
+void BlockBitmap::set_free(block_index_t block) {
+    if (block >= size_) {
+        return;
+    }
+
+    auto &word = words_[block / BitsPerWord];
+    if ((word & bit(block)) != 0) {
+        word &= ~bit(block);
+        free_++;
+        summarize(block / BitsPerWord);
+    }
+}
+
+void BlockBitmap::set_taken(block_index_t block) {
+    if (block >= size_) {
+        return;
+    }
+
+    auto &word = words_[block / BitsPerWord];
+    if ((word & bit(block)) == 0) {
+        word |= bit(block);
+        free_--;
+        summarize(block / BitsPerWord);
+    }
+}
+
+void BlockBitmap::summarize(uint32_t word) {
+    auto &summary = summary_[word / BitsPerWord];
+    auto mask = (uint32_t)1 << (word % BitsPerWord);
+    if (words_[word] != UINT32_MAX) {
+        summary |= mask;
+    }
+    else {
+        summary &= ~mask;
+    }
+}
+
+block_index_t BlockBitmap::first_free(block_index_t from) const {
+    if (from >= size_) {
+        return BLOCK_INDEX_INVALID;
+    }
+
+    // The word we start in may have free blocks before the one we were
+    // given, so those are masked off first.
+    auto word = from / BitsPerWord;
+    auto available = ~words_[word] & ~(bit(from) - 1);
+    if (available != 0) {
+        return word * BitsPerWord + __builtin_ctz(available);
+    }
+
+    auto words = words_for(size_);
+    auto next = word + 1;
+    while (next < words) {
+        auto index = next / BitsPerWord;
+        auto summary = summary_[index] & ~(((uint32_t)1 << (next % BitsPerWord)) - 1);
+        if (summary != 0) {
+            auto found = index * BitsPerWord + __builtin_ctz(summary);
+            if (found >= words) {
+                break;
+            }
+            return found * BitsPerWord + __builtin_ctz(~words_[found]);
+        }
+        next = (index + 1) * BitsPerWord;
+    }
+
+    return BLOCK_INDEX_INVALID;
+}
+
+block_index_t BlockBitmap::last_free() const {
+    if (free_ == 0) {
+        return BLOCK_INDEX_INVALID;
+    }
+
+    // Bits past the end are always taken, so nothing needs masking here.
+    for (auto index = words_for(words_for(size_)); index > 0; --index) {
+        auto summary = summary_[index - 1];
+        if (summary != 0) {
+            auto found = (index - 1) * BitsPerWord + (BitsPerWord - 1 - __builtin_clz(summary));
+            return found * BitsPerWord + (BitsPerWord - 1 - __builtin_clz(~words_[found]));
+        }
+    }
+
+    return BLOCK_INDEX_INVALID;
+}
+
+}
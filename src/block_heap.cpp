@@ -0,0 +1,120 @@
+#include <utility>
+
+#include "phylum/block_heap.h"
+
+namespace phylum {
+
+BlockHeap::BlockHeap() {
+}
+
+BlockHeap::~BlockHeap() {
+    ::free(entries_);
+}
+
+bool BlockHeap::initialize(uint32_t capacity) {
+    ::free(entries_);
+
+    entries_ = (Entry *)malloc(sizeof(Entry) * capacity);
+    if (entries_ == nullptr) {
+        capacity_ = 0;
+        size_ = 0;
+        return false;
+    }
+
+    capacity_ = capacity;
+    size_ = 0;
+
+    return true;
+}
+
+void BlockHeap::clear() {
+    size_ = 0;
+}
+
+bool BlockHeap::push(block_index_t block, block_age_t age) {
+    if (size_ == capacity_) {
+        return false;
+    }
+
+    entries_[size_] = Entry{ block, age };
+    sift_up(size_);
+    size_++;
+
+    return true;
+}
+
+BlockHeap::Entry BlockHeap::pop() {
+    if (size_ == 0) {
+        return Entry{ BLOCK_INDEX_INVALID, BLOCK_AGE_INVALID };
+    }
+
+    auto entry = entries_[0];
+    size_--;
+    if (size_ > 0) {
+        entries_[0] = entries_[size_];
+        sift_down(0);
+    }
+
+    return entry;
+}
+
+bool BlockHeap::update(block_index_t block, block_age_t age) {
+    for (auto i = (uint32_t)0; i < size_; ++i) {
+        if (entries_[i].block == block) {
+            entries_[i].age = age;
+            sift_up(i);
+            sift_down(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool BlockHeap::remove(block_index_t block) {
+    for (auto i = (uint32_t)0; i < size_; ++i) {
+        if (entries_[i].block == block) {
+            size_--;
+            if (i < size_) {
+                entries_[i] = entries_[size_];
+                sift_up(i);
+                sift_down(i);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void BlockHeap::sift_up(uint32_t i) {
+    while (i > 0) {
+        auto parent = (i - 1) / 2;
+        if (!before(entries_[i], entries_[parent])) {
+            break;
+        }
+        std::swap(entries_[i], entries_[parent]);
+        i = parent;
+    }
+}
+
+void BlockHeap::sift_down(uint32_t i) {
+    while (true) {
+        auto smallest = i;
+        auto left = 2 * i + 1;
+        auto right = 2 * i + 2;
+        if (left < size_ && before(entries_[left], entries_[smallest])) {
+            smallest = left;
+        }
+        if (right < size_ && before(entries_[right], entries_[smallest])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        std::swap(entries_[i], entries_[smallest]);
+        i = smallest;
+    }
+}
+
+}
@@ -0,0 +1,317 @@
+#include <cstdlib>
+
+#include "phylum/erase_scheduler.h"
+
+namespace phylum {
+
+static constexpr BlockStream Streams[] = { BlockStream::Hot, BlockStream::Cold };
+
+// Pools are filled ahead of knowing what the blocks are for, so they're
+// allocated as a type from the right stream.
+static BlockType type_of(BlockStream stream) {
+    return stream == BlockStream::Cold ? BlockType::File : BlockType::Unallocated;
+}
+
+constexpr uint32_t EraseScheduler::DefaultPoolSize;
+constexpr uint32_t EraseScheduler::DefaultQueueSize;
+
+EraseScheduler::EraseScheduler(StorageBackend &storage, BlockManager &manager, uint32_t pool_size, uint32_t queue_size)
+    : storage_(&storage), allocator_(&manager), manager_(&manager) {
+    create(pool_size, queue_size);
+}
+
+EraseScheduler::EraseScheduler(StorageBackend &storage, ReusableBlockAllocator &allocator, uint32_t pool_size, uint32_t queue_size)
+    : storage_(&storage), allocator_(&allocator) {
+    create(pool_size, queue_size);
+}
+
+EraseScheduler::~EraseScheduler() {
+    #if !defined(ARDUINO)
+    stop();
+    #endif
+    ::free(pool_);
+    ::free(queue_);
+}
+
+void EraseScheduler::create(uint32_t pool_size, uint32_t queue_size) {
+    // Without room we just pass everything through to the allocator.
+    if (pool_size > 0) {
+        pool_ = (AllocatedBlock *)malloc(sizeof(AllocatedBlock) * pool_size * 2);
+        if (pool_ != nullptr) {
+            for (auto stream : Streams) {
+                pool(stream).blocks = pool_ + (uint8_t)stream * pool_size;
+                pool(stream).capacity = pool_size;
+            }
+        }
+    }
+    if (queue_size > 0) {
+        queue_ = (PendingFree *)malloc(sizeof(PendingFree) * queue_size);
+        queue_capacity_ = queue_ != nullptr ? queue_size : 0;
+    }
+}
+
+uint32_t EraseScheduler::pooled() {
+    Lock lock{ state_ };
+    return pool(BlockStream::Hot).pooled + pool(BlockStream::Cold).pooled;
+}
+
+uint32_t EraseScheduler::pooled(BlockStream stream) {
+    Lock lock{ state_ };
+    return pool(stream).pooled;
+}
+
+uint32_t EraseScheduler::pending() {
+    Lock lock{ state_ };
+    return pending_;
+}
+
+uint32_t EraseScheduler::misses() {
+    Lock lock{ state_ };
+    return misses_;
+}
+
+bool EraseScheduler::initialize(Geometry &geometry) {
+    if (manager_ == nullptr) {
+        return true;
+    }
+    Lock lock{ allocating_ };
+    return manager_->initialize(geometry);
+}
+
+AllocatorState EraseScheduler::state() {
+    if (manager_ == nullptr) {
+        return { BLOCK_INDEX_INVALID };
+    }
+    Lock lock{ allocating_ };
+    return manager_->state();
+}
+
+void EraseScheduler::state(AllocatorState state) {
+    if (manager_ != nullptr) {
+        Lock lock{ allocating_ };
+        manager_->state(state);
+    }
+}
+
+AllocatedBlock EraseScheduler::allocate(BlockType type) {
+    {
+        Lock lock{ state_ };
+        auto &p = pool(stream_of(type));
+        if (p.pooled > 0) {
+            auto alloc = p.blocks[p.head];
+            p.head = (p.head + 1) % p.capacity;
+            p.pooled--;
+            lock.unlock();
+            wake();
+            return alloc;
+        }
+        misses_++;
+    }
+
+    AllocatedBlock alloc;
+    {
+        Lock lock{ allocating_ };
+        alloc = allocator_->allocate(type);
+    }
+
+    wake();
+
+    return alloc;
+}
+
+bool EraseScheduler::free(block_index_t block, block_age_t age) {
+    {
+        Lock lock{ state_ };
+        exhausted_ = false;
+        if (pending_ < queue_capacity_) {
+            queue_[(queue_head_ + pending_) % queue_capacity_] = PendingFree{ block, age };
+            pending_++;
+            lock.unlock();
+            wake();
+            return true;
+        }
+    }
+
+    // Queue's full, so this one can't wait.
+    Lock lock{ allocating_ };
+    return allocator_->free(block, age);
+}
+
+bool EraseScheduler::release(BlockExtent extent) {
+    // Erased blocks that were never used go back in the pool, rather than
+    // being erased all over again. Only files reserve extents.
+    while (extent.valid() && extent.erased) {
+        Lock lock{ state_ };
+        auto &p = pool(BlockStream::Cold);
+        if (p.pooled >= p.capacity) {
+            break;
+        }
+        p.head = (p.head + p.capacity - 1) % p.capacity;
+        p.blocks[p.head] = extent.take();
+        p.pooled++;
+    }
+
+    return BlockManager::release(extent);
+}
+
+bool EraseScheduler::preallocate(uint32_t expected_size) {
+    return service();
+}
+
+bool EraseScheduler::keeps_free_blocks() {
+    return allocator_->keeps_free_blocks();
+}
+
+bool EraseScheduler::service(uint32_t erases) {
+    return work(erases, true) >= 0;
+}
+
+bool EraseScheduler::flush() {
+    return work(UINT32_MAX, false) >= 0;
+}
+
+bool EraseScheduler::dequeue(PendingFree &pending) {
+    Lock lock{ state_ };
+    if (pending_ == 0) {
+        return false;
+    }
+    pending = queue_[queue_head_];
+    queue_head_ = (queue_head_ + 1) % queue_capacity_;
+    pending_--;
+    return true;
+}
+
+int32_t EraseScheduler::work(uint32_t erases, bool refill) {
+    auto done = (uint32_t)0;
+
+    // Frees go first, they may be the only blocks left for the pool.
+    PendingFree pending;
+    while (done < erases && dequeue(pending)) {
+        Lock lock{ allocating_ };
+        if (!allocator_->free(pending.block, pending.age)) {
+            return -1;
+        }
+        done++;
+    }
+
+    while (refill && done < erases) {
+        // The emptier pool is topped up first.
+        auto stream = BlockStream::Hot;
+        {
+            Lock lock{ state_ };
+            if (filled() || exhausted_) {
+                break;
+            }
+            auto &hot = pool(BlockStream::Hot);
+            auto &cold = pool(BlockStream::Cold);
+            if (hot.pooled >= hot.capacity || cold.pooled < hot.pooled) {
+                stream = BlockStream::Cold;
+            }
+        }
+
+        AllocatedBlock alloc;
+        {
+            Lock lock{ allocating_ };
+            alloc = allocator_->allocate(type_of(stream));
+        }
+
+        if (!alloc.valid()) {
+            Lock lock{ state_ };
+            exhausted_ = true;
+            break;
+        }
+
+        // Nobody else knows about this block yet, so the erase happens
+        // without holding anything.
+        if (!alloc.erased) {
+            if (!storage_->erase(alloc.block)) {
+                Lock lock{ allocating_ };
+                allocator_->free(alloc.block, alloc.age);
+                return -1;
+            }
+        }
+
+        Lock lock{ state_ };
+        auto &p = pool(stream);
+        if (p.pooled >= p.capacity) {
+            lock.unlock();
+            Lock returning{ allocating_ };
+            if (!allocator_->free(alloc.block, alloc.age)) {
+                return -1;
+            }
+            break;
+        }
+
+        p.blocks[(p.head + p.pooled) % p.capacity] = AllocatedBlock{ alloc.block, alloc.age, true };
+        p.pooled++;
+        done++;
+    }
+
+    return (int32_t)done;
+}
+
+bool EraseScheduler::filled() {
+    for (auto stream : Streams) {
+        if (pool(stream).pooled < pool(stream).capacity) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#if !defined(ARDUINO)
+
+void EraseScheduler::wake() {
+    wake_.notify_one();
+}
+
+bool EraseScheduler::start() {
+    Lock lock{ state_ };
+    if (running_) {
+        return true;
+    }
+    running_ = true;
+    worker_ = std::thread([this]() { run(); });
+    return true;
+}
+
+void EraseScheduler::stop() {
+    {
+        Lock lock{ state_ };
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void EraseScheduler::run() {
+    Lock lock{ state_ };
+    while (running_) {
+        auto waiting = pending_ > 0 || (!filled() && !exhausted_);
+        if (!waiting) {
+            wake_.wait(lock);
+            continue;
+        }
+
+        lock.unlock();
+        auto done = work(1, true);
+        lock.lock();
+
+        // Failures are left for the foreground to run into, rather than
+        // retrying them over and over.
+        if (done <= 0 && running_) {
+            wake_.wait(lock);
+        }
+    }
+}
+
+#else
+
+void EraseScheduler::wake() {
+}
+
+#endif
+
+}
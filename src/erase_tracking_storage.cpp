@@ -0,0 +1,46 @@
+#include "phylum/erase_tracking_storage.h"
+
+namespace phylum {
+
+EraseTrackingStorage::EraseTrackingStorage(StorageBackend &target) : target(target) {
+}
+
+bool EraseTrackingStorage::open() {
+    if (!target.open()) {
+        return false;
+    }
+
+    return erased_.initialize(geometry().number_of_blocks, false);
+}
+
+bool EraseTrackingStorage::erase(block_index_t block) {
+    if (erased_.is_free(block)) {
+        statistics_.avoided++;
+        return true;
+    }
+
+    if (!target.erase(block)) {
+        return false;
+    }
+
+    statistics_.erases++;
+    erased_.set_free(block);
+
+    return true;
+}
+
+bool EraseTrackingStorage::eraseAll() {
+    if (!target.eraseAll()) {
+        return false;
+    }
+
+    return erased_.initialize(geometry().number_of_blocks, true);
+}
+
+bool EraseTrackingStorage::write(BlockAddress addr, void *d, size_t n) {
+    erased_.set_taken(addr.block);
+
+    return target.write(addr, d, n);
+}
+
+}
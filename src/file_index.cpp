@@ -37,6 +37,11 @@ get_index_layout(StorageBackend &storage, BlockAddress address) {
         return get_index_layout(storage, empty_allocator, address);
 }
 
+static inline LayoutIterator<IndexBlockHead, IndexBlockTail, IndexRecord>
+get_index_iterator(StorageBackend &storage, BlockAddress address) {
+    return { storage, address };
+}
+
 class IndexBlockLayout {
 private:
     StorageBackend *storage_;
@@ -188,11 +193,11 @@ bool FileIndex::initialize() {
     #endif
 
     IndexRecord record;
-    auto layout = get_index_layout(caching, { end_block, 0 });
-    while (layout.walk<IndexRecord>(record)) {
+    auto iterator = get_index_iterator(caching, { end_block, 0 });
+    while (iterator.next(record)) {
 
     }
-    head_ = layout.address();
+    head_ = iterator.address();
 
     #if PHYLUM_DEBUG > 0
     sdebug() << "Initialized: " << *this << endl;
@@ -217,8 +222,8 @@ bool FileIndex::seek(uint64_t position, IndexRecord &selected) {
     }
 
     IndexRecord record;
-    auto reading = get_index_layout(caching, { end_block, 0 });
-    while (reading.walk<IndexRecord>(record)) {
+    auto reading = get_index_iterator(caching, { end_block, 0 });
+    while (reading.next(record)) {
         #if PHYLUM_DEBUG > 1
         sdebug() << "  " << record << " " << reading.address() << endl;
         #endif
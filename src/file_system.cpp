@@ -3,14 +3,19 @@
 
 namespace phylum {
 
-// NOTE: This is typically ~1700 bytes with 8 entries. With the union between
-// children and values in NodeType this weighs in around 1300 bytes.
+// NOTE: Nodes are sector sized, holding 23 keys, which is 480 bytes each. The
+// cache of 8 of them is nearly all of a TreeContext, which comes to about 4KB
+// on the stack of whoever makes one. Trees are rarely more than 3 deep, which
+// leaves room for siblings when rebalancing.
 template<typename NodeType>
 struct TreeContext {
+public:
+    using IteratorType = typename PersistedTree<NodeType>::Iterator;
+
 public:
     FileSystem &fs;
     NodeSerializer<NodeType> serializer;
-    MemoryConstrainedNodeCache<NodeType, 12> cache;
+    MemoryConstrainedNodeCache<NodeType, 8> cache;
     PersistedTree<NodeType> tree;
     BlockAddress new_head;
 
@@ -29,12 +34,46 @@ public:
         new_head = tree.add(key, value);
     }
 
+    // Buffered pairs are newer than those in the tree, so they're preferred.
     uint64_t find(uint64_t key) {
+        uint64_t value;
+        if (fs.pending_.find(key, &value)) {
+            return value;
+        }
         return tree.find(key);
     }
 
     bool find_less_then(uint64_t key, uint64_t *value, uint64_t *found) {
-        return tree.find_less_then(key, value, found);
+        uint64_t pending_value = 0;
+        uint64_t pending_key = 0;
+        auto in_pending = fs.pending_.find_less_then(key, &pending_value, &pending_key);
+        auto in_tree = tree.find_less_then(key, value, found);
+        if (in_pending && (!in_tree || !(pending_key < *found))) {
+            *value = pending_value;
+            *found = pending_key;
+            return true;
+        }
+        return in_tree;
+    }
+
+    void add(const uint64_t *keys, const uint64_t *values, size_t number) {
+        new_head = tree.add(keys, values, number);
+    }
+
+    bool remove(uint64_t key) {
+        if (!tree.remove(key)) {
+            return false;
+        }
+        new_head = tree.address();
+        return true;
+    }
+
+    size_t remove(uint64_t first, uint64_t last) {
+        auto removed = tree.remove(first, last);
+        if (removed > 0) {
+            new_head = tree.address();
+        }
+        return removed;
     }
 
     void touch() {
@@ -42,33 +81,34 @@ public:
     }
 
     bool recreate() {
-        auto before = fs.nodes_.state();
-
         new_head = tree.recreate();
         if (!new_head.valid()) {
             return false;
         }
 
-        auto after = fs.nodes_.state();
+        return true;
+    }
 
-        if (before.index.valid()) {
-            assert(before.index != after.index);
-            fs.fpm().free(before.index.block);
+    template<typename FN>
+    bool relocate(uint64_t &key, FN moving, uint32_t &budget) {
+        auto before = tree.address();
+        auto more = tree.relocate(key, moving, budget);
+        if (tree.address() != before) {
+            new_head = tree.address();
         }
-
-        assert(before.leaf != after.leaf);
-        fs.fpm().free(before.leaf.block);
-
-        return true;
+        return more;
     }
 
-    bool flush() {
-        if (new_head.valid()) {
+    bool flush(bool force = false) {
+        if (new_head.valid() || force) {
             // Fill SuperBlock with useful details, save and then kill our
             // new_head so we don't try and save again until a new modification occurs.
-            fs.tree_addr_ = new_head;
-            fs.prepare(fs.sbm_.block());
-            fs.sbm_.save();
+            if (new_head.valid()) {
+                fs.tree_addr_ = new_head;
+            }
+            if (!fs.checkpoint()) {
+                return false;
+            }
             new_head.invalid();
             return true;
         }
@@ -77,9 +117,8 @@ public:
 };
 
 FileSystem::FileSystem(StorageBackend &storage, BlockManager &allocator) :
-    storage_(&storage), allocator_(&allocator), sbm_{ storage, allocator },
-    nodes_{ storage, allocator },
-    fpm_(storage, allocator) {
+    storage_(&storage), fpm_(storage, allocator), allocator_(&fpm_), sbm_{ storage, fpm_ },
+    nodes_{ storage, fpm_ }, journal_(storage, fpm_) {
 }
 
 void FileSystem::prepare(TreeFileSystemSuperBlock &sb) {
@@ -91,10 +130,13 @@ void FileSystem::prepare(TreeFileSystemSuperBlock &sb) {
     sb.index = tree_state.index;
     sb.leaf = tree_state.leaf;
     sb.tree = tree_addr_.block;
+    sb.free_tail = fpm_.location().block;
 }
 
 bool FileSystem::format() {
-    if (!sbm_.create()) {
+    AllocatedBlock journal;
+    AllocatedBlock free;
+    if (!sbm_.create(journal, free)) {
         return false;
     }
 
@@ -104,7 +146,11 @@ bool FileSystem::format() {
 
     auto &sb = sbm_.block();
 
-    if (!fpm_.format(sb.free)) {
+    if (!fpm_.format(sb.free, free.age)) {
+        return false;
+    }
+
+    if (!journal_.format(sb.journal, journal.age)) {
         return false;
     }
 
@@ -114,6 +160,8 @@ bool FileSystem::format() {
 bool FileSystem::mount(bool wipe) {
     allocator_->initialize(storage_->geometry());
 
+    pending_.clear();
+
     if (wipe || !sbm_.locate()) {
         if (!format()) {
             return false;
@@ -122,7 +170,9 @@ bool FileSystem::mount(bool wipe) {
 
     auto &sb = sbm_.block();
 
-    if (!fpm_.locate(sb.free)) {
+    // Older super blocks don't know where the free pile ends, so then we
+    // walk it from its first block.
+    if (!fpm_.locate(sb.free, sb.free_tail)) {
         return false;
     }
 
@@ -133,10 +183,140 @@ bool FileSystem::mount(bool wipe) {
 
     nodes_.state({ sb.index, sb.leaf });
 
+    // Older file systems allocated the journal's block and never wrote to it.
+    if (!journal_.locate(sb.journal)) {
+        if (!journal_.format(sb.journal)) {
+            return false;
+        }
+    }
+
+    if (!replay()) {
+        return false;
+    }
+
+    return index_files();
+}
+
+bool FileSystem::index_files() {
+    class FileIndexer : public FileVisitor {
+    private:
+        BloomFilter<PHYLUM_FILE_FILTER_BYTES> *files_;
+
+    public:
+        FileIndexer(BloomFilter<PHYLUM_FILE_FILTER_BYTES> &files) : files_(&files) {
+        }
+
+    public:
+        void file(FileInfo info) override {
+            files_->add(info.id);
+        }
+    };
+
+    files_.clear();
+
+    FileIndexer indexer{ files_ };
+    return list(indexer);
+}
+
+bool FileSystem::replay() {
+    auto &sb = sbm_.block();
+    auto state = AllocatorState{ };
+
+    auto success = journal_.replay(sb.journal, sbm_.timestamp(), [&](JournalEntry &entry) {
+        // Positions are only hints for seeking, so if there's no room for
+        // them we can do without.
+        if (entry.kind == JournalEntryKind::Position) {
+            pending_.add(entry.key, entry.value);
+        }
+        state = AllocatorState{ entry.head, entry.hot };
+    });
+    if (!success) {
+        return false;
+    }
+
+    // Blocks were allocated after the super block was saved, so pick up
+    // where the allocator was, rather than handing them out again.
+    if (is_valid_block(state.head)) {
+        allocator_->state(state);
+    }
+
+    return true;
+}
+
+bool FileSystem::checkpoint() {
+    auto &sb = sbm_.block();
+    auto previous = sb.journal;
+    auto previous_free = sb.free;
+
+    // Once the journal spills into another block, start over in a new one
+    // and free the old chain after the super block is saved.
+    auto restarting = journal_.location().block != sb.journal;
+    if (restarting) {
+        auto alloc = allocator_->allocate(BlockType::Journal);
+        if (!journal_.format(alloc.block, alloc.age)) {
+            return false;
+        }
+        sb.journal = alloc.block;
+    }
+
+    // Blocks at the start of the free pile whose entries have all been
+    // taken are dropped, and freed once the super block no longer has them.
+    auto trimming = fpm_.cursor().valid() && fpm_.cursor().block != sb.free;
+    if (trimming) {
+        sb.free = fpm_.cursor().block;
+    }
+
+    prepare(sb);
+
+    // The checkpoint gets the timestamp the super block will be saved with,
+    // so if that save never happens replay carries on past this.
+    auto state = allocator_->state();
+    if (!journal_.append(JournalEntry{ JournalEntryKind::Checkpoint, state, sbm_.timestamp() + 1 })) {
+        return false;
+    }
+
+    // Positions still waiting to be added to the tree are logged again so
+    // they survive the checkpoint.
+    for (auto i = (size_t)0; i < pending_.size(); ++i) {
+        if (!journal_.append(JournalEntry{ JournalEntryKind::Position, state, pending_.keys()[i], pending_.values()[i] })) {
+            return false;
+        }
+    }
+
+    if (!sbm_.save()) {
+        return false;
+    }
+
+    if (restarting) {
+        auto block = previous;
+        while (is_valid_block(block) && block != sb.journal) {
+            auto following = journal_.following_block(block);
+            if (!fpm_.free(block)) {
+                return false;
+            }
+            block = following;
+        }
+    }
+
+    if (trimming) {
+        auto block = previous_free;
+        while (is_valid_block(block) && block != sb.free) {
+            auto following = fpm_.following_block(block);
+            if (!fpm_.free(block)) {
+                return false;
+            }
+            block = following;
+        }
+    }
+
     return true;
 }
 
 bool FileSystem::exists(const char *name) {
+    if (!files_.might_contain(INodeKey::file_id(name))) {
+        return false;
+    }
+
     TreeContext<NodeType> tc{ *this };
 
     auto key = INodeKey::file_beginning(name);
@@ -153,6 +333,123 @@ OpenFile FileSystem::open(const char *name, bool readonly) {
     return file;
 }
 
+bool FileSystem::remove(const char *name) {
+    auto id = INodeKey::file_id(name);
+
+    TreeContext<NodeType> tc{ *this };
+
+    auto beginning = tc.find(INodeKey::file_beginning(id));
+    if (beginning == 0) {
+        return false;
+    }
+
+    // Remove the beginning and all of the saved positions, and save the tree
+    // before any of the file's blocks are freed. Freed blocks can be handed
+    // out again right away, so the saved tree must never refer to them.
+    pending_.remove(INodeKey::file_beginning(id), INodeKey::file_maximum(id));
+
+    tc.remove(INodeKey::file_beginning(id), INodeKey::file_maximum(id));
+
+    if (!tc.flush(true)) {
+        return false;
+    }
+
+    // Follow the links in each block's tail to free the file's blocks. The
+    // last block's tail is unwritten and so its link is invalid.
+    auto &g = storage_->geometry();
+    auto block = BlockAddress::from(beginning).block;
+    for (auto i = (block_index_t)0; is_valid_block(block) && i < g.number_of_blocks; ++i) {
+        auto addr = BlockAddress::tail_sector_of(block, g);
+        addr.add(SectorSize - sizeof(FileBlockTail));
+
+        FileBlockTail tail;
+        if (!storage_->read(addr, &tail, sizeof(FileBlockTail))) {
+            return false;
+        }
+
+        if (!fpm_.free(block)) {
+            return false;
+        }
+
+        block = tail.block.linked_block;
+    }
+
+    // Freed blocks are erased now rather than by whoever is handed them
+    // next, which is usually a writer.
+    return fpm_.erase(UINT32_MAX);
+}
+
+bool FileSystem::list(FileVisitor &visitor) {
+    TreeContext<NodeType> tc{ *this };
+    TreeContext<NodeType>::IteratorType iter{ tc.tree, 0, UINT64_MAX };
+
+    // Files begin with a key whose lower half is zero, so we visit those and
+    // then skip over the file's positions by seeking to the following id.
+    while (iter.valid()) {
+        auto key = INodeKey(iter.key());
+        if (key.lower() == 0) {
+            visitor.file(FileInfo{ key.upper(), BlockAddress::from(iter.value()) });
+        }
+
+        if (key.upper() == UINT32_MAX) {
+            break;
+        }
+
+        iter.seek(INodeKey::file_beginning((file_id_t)(key.upper() + 1)));
+    }
+
+    return true;
+}
+
+bool FileSystem::positions(file_id_t id, PositionVisitor &visitor) {
+    TreeContext<NodeType> tc{ *this };
+    TreeContext<NodeType>::IteratorType iter{ tc.tree, INodeKey::file_beginning(id), INodeKey::file_maximum(id) };
+
+    // Merge the buffered positions with those in the tree as we go.
+    auto keys = pending_.keys();
+    auto values = pending_.values();
+    auto p = (size_t)0;
+    while (p < pending_.size() && keys[p] < INodeKey::file_beginning(id)) {
+        p++;
+    }
+
+    while (true) {
+        auto buffered = p < pending_.size() && keys[p] <= INodeKey::file_maximum(id);
+        if (!buffered && !iter.valid()) {
+            break;
+        }
+
+        if (buffered && (!iter.valid() || keys[p] <= iter.key())) {
+            if (iter.valid() && keys[p] == iter.key()) {
+                iter.next();
+            }
+            auto address = BlockAddress::from(values[p]);
+            visitor.position(PositionInfo{ position_of(keys[p], address), address });
+            p++;
+        }
+        else {
+            auto address = BlockAddress::from(iter.value());
+            visitor.position(PositionInfo{ position_of(iter.key(), address), address });
+            iter.next();
+        }
+    }
+
+    return true;
+}
+
+uint64_t FileSystem::position_of(INodeKey key, BlockAddress address) {
+    if (key.lower() == 0) {
+        return 0;
+    }
+
+    FileBlockHead head;
+    if (!storage_->read({ address.block, 0 }, &head, sizeof(FileBlockHead))) {
+        return UINT64_MAX;
+    }
+
+    return head.position;
+}
+
 bool FileSystem::touch() {
     TreeContext<NodeType> tc{ *this };
     tc.touch();
@@ -161,21 +458,379 @@ bool FileSystem::touch() {
 }
 
 bool FileSystem::gc() {
+    auto before = nodes_.state();
+    auto &sb = sbm_.block();
+    auto leaf = oldest_block(sb.gc.leaf, before.leaf, BlockType::Leaf);
+    auto index = oldest_block(sb.gc.index, before.index, BlockType::Index);
+
     TreeContext<NodeType> tc{ *this };
     if (!tc.recreate()) {
         return false;
     }
 
-    auto &sb = sbm_.block();
+    sb.gc = TreeGcState{ };
     sb.last_gc = sbm_.timestamp();
 
+    if (!tc.flush(true)) {
+        return false;
+    }
+
+    // The tree now lives in new chains, so every block of the old ones can be
+    // freed. We do this after saving so we never free blocks in use.
+    if (!free_chain(leaf, before.leaf)) {
+        return false;
+    }
+
+    if (!free_chain(index, before.index)) {
+        return false;
+    }
+
+    return fpm_.erase(UINT32_MAX);
+}
+
+bool FileSystem::gc(uint32_t budget) {
+    auto frontier = nodes_.state();
+    auto &sb = sbm_.block();
+    auto &state = sb.gc;
+
+    // Start a new pass, moving nodes out of the oldest block of each chain.
+    // We can't do that to the block being appended to.
+    if (state.relocating == 0) {
+        state.leaf = oldest_block(state.leaf, frontier.leaf, BlockType::Leaf);
+        state.index = oldest_block(state.index, frontier.index, BlockType::Index);
+
+        if (is_valid_block(state.leaf) && state.leaf != frontier.leaf.block) {
+            state.relocating |= TreeGcState::RelocatingLeaf;
+        }
+        if (is_valid_block(state.index) && state.index != frontier.index.block) {
+            state.relocating |= TreeGcState::RelocatingIndex;
+        }
+        if (state.relocating == 0) {
+            return true;
+        }
+
+        state.key = 0;
+    }
+
+    auto leaf = (state.relocating & TreeGcState::RelocatingLeaf) ? state.leaf : BLOCK_INDEX_INVALID;
+    auto index = (state.relocating & TreeGcState::RelocatingIndex) ? state.index : BLOCK_INDEX_INVALID;
+    auto moving = [&](BlockAddress address) {
+        return address.block == leaf || address.block == index;
+    };
+
+    TreeContext<NodeType> tc{ *this };
+
+    auto key = state.key;
+    auto more = tc.relocate(key, moving, budget);
+
+    state.key = key;
+
+    if (!more) {
+        // Nothing in the tree refers to these blocks anymore, move on to the
+        // following blocks in their chains.
+        if (is_valid_block(leaf)) {
+            state.leaf = following_block(leaf);
+        }
+        if (is_valid_block(index)) {
+            state.index = following_block(index);
+        }
+        state.relocating = 0;
+        state.key = 0;
+        sb.last_gc = sbm_.timestamp();
+    }
+
+    // Save progress and the new tree before the blocks are freed.
+    if (!tc.flush(true)) {
+        return false;
+    }
+
+    if (!more) {
+        if (is_valid_block(leaf) && !fpm_.free(leaf)) {
+            return false;
+        }
+        if (is_valid_block(index) && !fpm_.free(index)) {
+            return false;
+        }
+        if (!fpm_.erase(UINT32_MAX)) {
+            return false;
+        }
+    }
+
     return true;
 }
 
+block_index_t FileSystem::oldest_block(block_index_t known, BlockAddress frontier, BlockType type) {
+    if (is_valid_block(known)) {
+        return known;
+    }
+
+    if (!frontier.valid()) {
+        return BLOCK_INDEX_INVALID;
+    }
+
+    // Blocks in a chain are linked to the block before them, so we can follow
+    // those until we run out of blocks of the right type.
+    auto &g = storage_->geometry();
+    auto oldest = BLOCK_INDEX_INVALID;
+    auto block = frontier.block;
+    for (auto i = (block_index_t)0; i < g.number_of_blocks; ++i) {
+        TreeBlockHead head{ BlockType::Error };
+        if (!storage_->read({ block, 0 }, &head, sizeof(TreeBlockHead))) {
+            return BLOCK_INDEX_INVALID;
+        }
+
+        if (!head.valid() || head.block.type != type) {
+            break;
+        }
+
+        oldest = block;
+
+        if (!is_valid_block(head.block.linked_block) || head.block.linked_block == frontier.block) {
+            break;
+        }
+
+        block = head.block.linked_block;
+    }
+
+    return oldest;
+}
+
+block_index_t FileSystem::following_block(block_index_t block) {
+    auto &g = storage_->geometry();
+    auto address = BlockAddress::tail_data_of(block, g, sizeof(TreeBlockTail));
+
+    TreeBlockTail tail;
+    if (!storage_->read(address, &tail, sizeof(TreeBlockTail))) {
+        return BLOCK_INDEX_INVALID;
+    }
+
+    return tail.block.linked_block;
+}
+
+bool FileSystem::free_chain(block_index_t oldest, BlockAddress frontier) {
+    if (!is_valid_block(oldest) || !frontier.valid()) {
+        return true;
+    }
+
+    auto &g = storage_->geometry();
+    auto block = oldest;
+    for (auto i = (block_index_t)0; is_valid_block(block) && i < g.number_of_blocks; ++i) {
+        auto following = block == frontier.block ? BLOCK_INDEX_INVALID : following_block(block);
+
+        if (!fpm_.free(block)) {
+            return false;
+        }
+
+        block = following;
+    }
+
+    return true;
+}
+
+bool FileSystem::save_position(uint64_t key, uint64_t value) {
+    if (!journal_.append(JournalEntry{ JournalEntryKind::Position, allocator_->state(), key, value })) {
+        return false;
+    }
+
+    if (pending_.add(key, value)) {
+        return true;
+    }
+
+    if (!flush()) {
+        return false;
+    }
+
+    return pending_.add(key, value);
+}
+
+bool FileSystem::save_allocation() {
+    return journal_.append(JournalEntry{ JournalEntryKind::Block, allocator_->state() });
+}
+
+bool FileSystem::flush() {
+    if (pending_.empty()) {
+        return true;
+    }
+
+    TreeContext<NodeType> tc{ *this };
+    tc.add(pending_.keys(), pending_.values(), pending_.size());
+
+    // Cleared before the checkpoint so these aren't logged again.
+    pending_.clear();
+
+    return tc.flush();
+}
+
 bool FileSystem::unmount() {
+    if (!flush()) {
+        return false;
+    }
+
     return storage_->close();
 }
 
+bool FileSystem::movable(block_index_t block) {
+    FileBlockHead head;
+    if (!storage_->read({ block, 0 }, &head, sizeof(FileBlockHead))) {
+        return false;
+    }
+
+    // Blocks reserved by writers have no head until they're used.
+    if (!head.valid() || head.block.type != BlockType::File) {
+        return false;
+    }
+
+    TreeContext<NodeType> tc{ *this };
+
+    return tc.find(INodeKey::file_beginning(head.file_id)) != 0;
+}
+
+bool FileSystem::migrate(block_index_t from, AllocatedBlock to) {
+    FileBlockHead head;
+    if (!storage_->read({ from, 0 }, &head, sizeof(FileBlockHead))) {
+        return false;
+    }
+
+    auto id = head.file_id;
+
+    // Only positions in the tree are moved along with their blocks.
+    if (!flush()) {
+        return false;
+    }
+
+    TreeContext<NodeType> tc{ *this };
+
+    auto value = tc.find(INodeKey::file_beginning(id));
+    if (value == 0) {
+        return false;
+    }
+
+    // Make sure the block is in the file before copying anything.
+    auto &g = storage_->geometry();
+    auto beginning = BlockAddress::from(value).block;
+    auto block = beginning;
+    for (auto i = (block_index_t)0; block != from; ++i) {
+        if (!is_valid_block(block) || i == g.number_of_blocks) {
+            return false;
+        }
+        block = following_file_block(block);
+    }
+
+    // Copies are allocated a block ahead, so their tails can link to the
+    // following copy as they're written.
+    auto previous = BLOCK_INDEX_INVALID;
+    auto copy = beginning == from ? to : allocator_->allocate(BlockType::File);
+    block = beginning;
+    while (true) {
+        if (!copy.valid() || !storage_->read({ block, 0 }, &head, sizeof(FileBlockHead))) {
+            return false;
+        }
+
+        auto following = block == from ? BLOCK_INDEX_INVALID : following_file_block(block);
+        auto following_copy = AllocatedBlock{ };
+        if (block != from) {
+            following_copy = following == from ? to : allocator_->allocate(BlockType::File);
+        }
+
+        if (!copy_file_block(block, head, copy, previous, following_copy.block)) {
+            return false;
+        }
+
+        // Positions are saved with the position of the block they're in, so
+        // there's at most one per block to look for.
+        auto key = block == beginning ? INodeKey::file_beginning(id) : INodeKey::file_position(id, head.position);
+        auto address = BlockAddress::from(tc.find(key));
+        if (address.block == block) {
+            tc.add(key, BlockAddress{ copy.block, address.position }.value());
+        }
+
+        if (block == from) {
+            break;
+        }
+
+        previous = copy.block;
+        copy = following_copy;
+        block = following;
+    }
+
+    // Save the tree before freeing the old blocks, which can be handed out
+    // again right away. The allocator frees `from` itself.
+    if (!tc.flush()) {
+        return false;
+    }
+
+    block = beginning;
+    while (block != from) {
+        auto following = following_file_block(block);
+        if (!fpm_.free(block)) {
+            return false;
+        }
+        block = following;
+    }
+
+    return fpm_.erase(UINT32_MAX);
+}
+
+block_index_t FileSystem::following_file_block(block_index_t block) {
+    auto &g = storage_->geometry();
+    auto address = BlockAddress::tail_data_of(block, g, sizeof(FileBlockTail));
+
+    FileBlockTail tail;
+    if (!storage_->read(address, &tail, sizeof(FileBlockTail))) {
+        return BLOCK_INDEX_INVALID;
+    }
+
+    return tail.block.linked_block;
+}
+
+bool FileSystem::copy_file_block(block_index_t block, FileBlockHead head, AllocatedBlock copy, block_index_t previous,
+                                 block_index_t following) {
+    if (!copy.erased && !storage_->erase(copy.block)) {
+        return false;
+    }
+
+    // Nothing follows these links backwards, so the block after the last
+    // one copied is left linking to the old block.
+    head.block.age = copy.age;
+    if (is_valid_block(previous)) {
+        head.block.linked_block = previous;
+    }
+
+    if (!storage_->write({ copy.block, 0 }, &head, sizeof(FileBlockHead))) {
+        return false;
+    }
+
+    // Sectors are written in order, so the first unwritten one is the end.
+    auto &g = storage_->geometry();
+    uint8_t buffer[SectorSize];
+    for (auto address = BlockAddress{ block, SectorSize }; address.position < g.block_size(); address.add(SectorSize)) {
+        if (!storage_->read(address, buffer, sizeof(buffer))) {
+            return false;
+        }
+
+        auto tail_sector = address.tail_sector(g);
+        auto tail_size = tail_sector ? sizeof(FileBlockTail) : sizeof(FileSectorTail);
+        FileSectorTail sector;
+        memcpy(&sector, buffer + sizeof(buffer) - tail_size, sizeof(FileSectorTail));
+        if (sector.bytes == 0 || sector.bytes == SECTOR_INDEX_INVALID) {
+            break;
+        }
+
+        if (tail_sector && is_valid_block(following)) {
+            FileBlockTail tail;
+            memcpy(&tail, buffer + sizeof(buffer) - tail_size, sizeof(FileBlockTail));
+            tail.block.linked_block = following;
+            memcpy(buffer + sizeof(buffer) - tail_size, &tail, sizeof(FileBlockTail));
+        }
+
+        if (!storage_->write({ copy.block, address.position }, buffer, sizeof(buffer))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 template<typename T, size_t N>
 static T *tail_info(uint8_t(&buffer)[N]) {
     auto tail_offset = sizeof(buffer) - sizeof(T);
@@ -183,7 +838,8 @@ static T *tail_info(uint8_t(&buffer)[N]) {
 }
 
 OpenFile::OpenFile(FileSystem &fs, file_id_t id, bool readonly) :
-    fs_(&fs), id_(id), readonly_(readonly), length_(readonly ? InvalidLengthOrPosition : 0) {
+    fs_(&fs), id_(id), readonly_(readonly), length_(readonly ? InvalidLengthOrPosition : 0),
+    save_frequency_(fs.position_policy_.initial) {
     assert(sizeof(buffer_) == SectorSize);
 }
 
@@ -192,7 +848,15 @@ bool OpenFile::open_or_create() {
         return true;
     }
 
+    // Files we've never seen created can't be opened for reading and needn't
+    // be looked for before creating them.
+    auto missing = !fs_->files_.might_contain(id_);
+
     if (readonly_) {
+        if (missing) {
+            return false;
+        }
+
         TreeContext<FileSystem::NodeType> tc{ *fs_ };
 
         auto beginning = tc.find(INodeKey::file_beginning(id_));
@@ -203,16 +867,17 @@ bool OpenFile::open_or_create() {
         head_ = BlockAddress::from(beginning);
     }
     else {
-        auto seeked = seek(Seek::End, 0);
-        if (seeked == SeekFailed) {
+        if (missing || locate(Seek::End, 0) == SeekFailed) {
             TreeContext<FileSystem::NodeType> tc{ *fs_ };
 
-            auto new_block = initialize_block(fs_->allocator_->allocate(BlockType::File), BLOCK_INDEX_INVALID);
+            auto reserved = false;
+            auto new_block = initialize_block(allocate(reserved), BLOCK_INDEX_INVALID, 0);
             if (!new_block.valid()) {
                 return false;
             }
 
             tc.add(INodeKey::file_beginning(id_), new_block.value());
+            fs_->files_.add(id_);
 
             head_ = new_block;
         }
@@ -229,22 +894,24 @@ bool OpenFile::tail_sector() {
     return head_.tail_sector(fs_->storage().geometry());
 }
 
-uint32_t OpenFile::size() {
+uint64_t OpenFile::size() {
     if (length_ == InvalidLengthOrPosition) {
         auto saved = position_;
-        seek(Seek::End);
-        seek(saved);
+        locate(Seek::End, 0);
+        locate(Seek::Beginning, saved);
     }
     return length_;
 }
 
-uint32_t OpenFile::tell() {
+uint64_t OpenFile::tell() {
     return position_;
 }
 
-OpenFile::SeekStatistics OpenFile::seek(BlockAddress starting, uint32_t max) {
-    auto bytes = 0;
+OpenFile::SeekStatistics OpenFile::seek(BlockAddress starting, uint64_t max) {
+    auto bytes = (uint64_t)0;
     auto blocks = 0;
+    auto block_bytes = (uint64_t)0;
+    auto walking = false;
 
     // Start walking the file from the given starting block until we reach the
     // end of the file or we've passed `max` bytes.
@@ -257,7 +924,7 @@ OpenFile::SeekStatistics OpenFile::seek(BlockAddress starting, uint32_t max) {
 
         // Check to see if our desired location is in this block, otherwise we
         // can just skip this one entirely.
-        if (addr.tail_sector(g)) {
+        if (addr.tail_sector(g) && !walking) {
             FileBlockTail tail;
             memcpy(&tail, tail_info<FileBlockTail>(buffer_), sizeof(FileBlockTail));
             if (is_valid_block(tail.block.linked_block) && max > tail.bytes_in_block) {
@@ -265,35 +932,55 @@ OpenFile::SeekStatistics OpenFile::seek(BlockAddress starting, uint32_t max) {
                 bytes += tail.bytes_in_block;
                 max -= tail.bytes_in_block;
                 blocks++;
+                block_bytes = bytes;
             }
             else {
                 addr = BlockAddress{ addr.block, SectorSize };
+                walking = true;
             }
         }
         else {
+            // When we walk as far as the tail sector it's the last one in the
+            // file, as we'd have followed its link otherwise.
+            auto tail_sector = addr.tail_sector(g);
             FileSectorTail tail;
-            memcpy(&tail, tail_info<FileSectorTail>(buffer_), sizeof(FileSectorTail));
+            if (tail_sector) {
+                tail = tail_info<FileBlockTail>(buffer_)->sector;
+            }
+            else {
+                memcpy(&tail, tail_info<FileSectorTail>(buffer_), sizeof(FileSectorTail));
+            }
 
             if (tail.bytes == 0 || tail.bytes == SECTOR_INDEX_INVALID) {
                 break;
             }
-            if (max > tail.bytes) {
+            if (max > tail.bytes && !tail_sector) {
                 bytes += tail.bytes;
                 max -= tail.bytes;
                 addr.add(SectorSize);
             }
             else {
-                bytes += max;
-                addr.add(max);
+                auto advancing = max > tail.bytes ? tail.bytes : max;
+                bytes += advancing;
+                addr.add(advancing);
                 break;
             }
         }
     }
 
-    return { addr, blocks, bytes };
+    return { addr, blocks, bytes, block_bytes };
 }
 
-int32_t OpenFile::seek(Seek where, uint32_t position) {
+int64_t OpenFile::seek(Seek where, uint64_t position) {
+    // Seeking around makes saved positions more valuable.
+    auto &policy = fs_->position_policy_;
+    save_frequency_ = save_frequency_ / 2 < policy.minimum ? policy.minimum : save_frequency_ / 2;
+    seeked_ = true;
+
+    return locate(where, position);
+}
+
+int64_t OpenFile::locate(Seek where, uint64_t position) {
     TreeContext<FileSystem::NodeType> tc{ *fs_ };
 
     // Easy seek, we can do this directly.
@@ -304,15 +991,15 @@ int32_t OpenFile::seek(Seek where, uint32_t position) {
     }
 
     // This is a little trickier. What we do is look for the first saved INode
-    // less than the desired position in the file. If we're seeking to the end
-    // then we use UINT32_MAX for the desired position.
+    // at or before the desired position in the file. If we're seeking to the
+    // end then we use UINT64_MAX for the desired position.
     // Technically we could do this faster if we also looked for the following
     // entry and determined if seeking in reverse is a better way. Doesn't seem
     // worth the effort though.
-    uint64_t value;
-    uint64_t saved;
-    auto relative = where == Seek::End ? UINT32_MAX : position;
-    if (!tc.find_less_then(INodeKey::file_position(id_, relative), &value, &saved)) {
+    uint64_t value = 0;
+    uint64_t saved = 0;
+    auto relative = where == Seek::End ? UINT64_MAX : position;
+    if (!tc.find_less_then(INodeKey::file_following(id_, relative), &value, &saved)) {
         return SeekFailed;
     }
 
@@ -323,14 +1010,43 @@ int32_t OpenFile::seek(Seek where, uint32_t position) {
         return SeekFailed;
     }
 
-    // This gets us pretty close (within PositionSaveFrequency blocks) so we
+    // This gets us pretty close (within a few blocks, see PositionPolicy) so we
     // walk the blocks and sectors to find the actual location.
-    auto starting = key.lower();
-    auto ss = seek(BlockAddress::from(value), relative - starting);
+    // Keys only get us to within a granule, the block has the exact position.
+    // That's only past where we're going for files over a terabyte.
+    auto address = BlockAddress::from(value);
+    // Seeking to the end is relative to UINT64_MAX, so a failed read has
+    // to be caught by itself.
+    auto starting = fs_->position_of(key, address);
+    if (starting == UINT64_MAX || starting > relative) {
+        return SeekFailed;
+    }
+
+    // Blocks we've been to before may be closer than anything saved.
+    KnownPosition known;
+    if (recall(relative, known) && known.position > starting) {
+        starting = known.position;
+        address = known.address;
+    }
+
+    auto ss = seek(address, relative - starting);
     blocks_since_save_ = ss.blocks;
     head_ = ss.address;
     position_ = starting + ss.bytes;
 
+    remember(starting + ss.block_bytes, BlockAddress{ ss.address.block, SectorSize });
+
+    // Walking this far means positions were never saved or were lost before
+    // being flushed, so we save the one for the block we ended up in. Readers
+    // leave that to writers, rather than writing just because they seeked.
+    if (!readonly_ && ss.blocks >= save_frequency_) {
+        auto block = BlockAddress{ ss.address.block, SectorSize };
+        if (!fs_->save_position(INodeKey::file_position(id_, starting + ss.block_bytes), block.value())) {
+            return SeekFailed;
+        }
+        blocks_since_save_ = 0;
+    }
+
     // If we found the end then remember the length.
     if (where == Seek::End) {
         length_ = position_;
@@ -339,7 +1055,7 @@ int32_t OpenFile::seek(Seek where, uint32_t position) {
     return position_;
 }
 
-int32_t OpenFile::seek(uint32_t position) {
+int64_t OpenFile::seek(uint64_t position) {
     return seek(Seek::Beginning, position);
 }
 
@@ -388,8 +1104,9 @@ int32_t OpenFile::flush() {
     auto writing_tail_sector = tail_sector();
     auto addr = head_;
     auto alloc = AllocatedBlock{ };
+    auto reserved = false;
     if (writing_tail_sector) {
-        alloc = fs_->allocator_->allocate(BlockType::File);
+        alloc = allocate(reserved);
         linked = alloc.block;
         FileBlockTail tail;
         tail.sector.bytes = buffpos_;
@@ -412,7 +1129,7 @@ int32_t OpenFile::flush() {
 
     // We could do this in the if scope above, I like doing things "in order" though.
     if (writing_tail_sector) {
-        head_ = initialize_block(alloc, head_.block);
+        head_ = initialize_block(alloc, head_.block, length_);
         if (!head_.valid()) {
             assert(false); // TODO: Yikes.
         }
@@ -420,13 +1137,26 @@ int32_t OpenFile::flush() {
         // Every N blocks we save our offset in the tree. This affects how much
         // seeking needs to happen when trying to append or seek around.
         blocks_since_save_++;
-        if (blocks_since_save_ == PositionSaveFrequency) {
-            TreeContext<FileSystem::NodeType> tc{ *fs_ };
+        if (blocks_since_save_ >= save_frequency_) {
             auto key = INodeKey::file_position(id_, length_);
-            tc.add(key, head_.value());
+            if (!fs_->save_position(key, head_.value())) {
+                return 0;
+            }
             blocks_since_save_ = 0;
+
+            // Nobody's seeking, so this is probably just being appended to.
+            if (!seeked_) {
+                auto &policy = fs_->position_policy_;
+                save_frequency_ = save_frequency_ * 2 > policy.maximum ? policy.maximum : save_frequency_ * 2;
+            }
+            seeked_ = false;
+        }
+        else if (reserved && !fs_->save_allocation()) {
+            return 0;
         }
 
+        remember(length_, head_);
+
         bytes_in_block_ = 0;
     }
 
@@ -452,6 +1182,7 @@ int32_t OpenFile::read(void *ptr, size_t size) {
             available_ = tail.sector.bytes;
             if (tail.block.linked_block != BLOCK_INDEX_INVALID) {
                 head_ = BlockAddress{ tail.block.linked_block, SectorSize };
+                remember(position_ + available_, head_);
             }
             else {
                 assert(false);
@@ -487,13 +1218,65 @@ int32_t OpenFile::read(void *ptr, size_t size) {
 
 void OpenFile::close() {
     flush();
+
+    // Give back what we didn't use, so other files can have them.
+    if (extent_.valid()) {
+        if (fs_->allocator_->release(extent_)) {
+            fs_->save_allocation();
+        }
+        extent_ = BlockExtent{ };
+    }
+}
+
+AllocatedBlock OpenFile::allocate(bool &reserved) {
+    // Taking blocks from our own extent keeps them contiguous, even with
+    // other files being written at the same time.
+    reserved = !extent_.valid();
+    if (reserved) {
+        extent_ = fs_->allocator_->reserve(BlockType::File, ExtentBlocks);
+        if (!extent_.valid()) {
+            return { };
+        }
+    }
+
+    return extent_.take();
+}
+
+void OpenFile::remember(uint64_t position, BlockAddress address) {
+    for (auto i = 0; i < number_known_; ++i) {
+        if (known_[i].position == position) {
+            return;
+        }
+    }
+
+    // Oldest goes first.
+    known_[next_known_] = KnownPosition{ position, address };
+    next_known_ = (next_known_ + 1) % SeekCacheSize;
+    if (number_known_ < SeekCacheSize) {
+        number_known_++;
+    }
+}
+
+bool OpenFile::recall(uint64_t position, KnownPosition &known) {
+    auto found = false;
+
+    for (auto i = 0; i < number_known_; ++i) {
+        if (known_[i].position <= position && (!found || known_[i].position > known.position)) {
+            known = known_[i];
+            found = true;
+        }
+    }
+
+    return found;
 }
 
-BlockAddress OpenFile::initialize_block(AllocatedBlock alloc, block_index_t previous) {
+BlockAddress OpenFile::initialize_block(AllocatedBlock alloc, block_index_t previous, uint64_t position) {
     FileBlockHead head;
 
     head.fill();
     head.file_id = id_;
+    head.position = position;
+    head.block.age = alloc.age;
     head.block.linked_block = previous;
 
     if (!alloc.erased) {
@@ -3,7 +3,7 @@
 namespace phylum {
 
 FileTable::FileTable(StorageBackend &storage) :
-    layout{ storage, empty_allocator, { 0, 0 }, BlockType::Index } {
+    layout{ storage, empty_allocator, { 0, 0 }, BlockType::Index }, iterator{ storage, { 0, 0 } } {
 }
 
 bool FileTable::erase() {
@@ -23,7 +23,7 @@ bool FileTable::write(FileTableEntry &entry) {
 }
 
 bool FileTable::read(FileTableEntry &entry) {
-    if (!layout.walk(entry)) {
+    if (!iterator.next(entry)) {
         return false;
     }
 
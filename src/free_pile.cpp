@@ -2,37 +2,65 @@
 
 namespace phylum {
 
-inline BlockLayout<FreePileBlockHead, FreePileBlockTail> get_layout(StorageBackend &storage,
+static BlockLayout<FreePileBlockHead, FreePileBlockTail> get_layout(StorageBackend &storage,
                                                                     BlockAllocator &allocator,
                                                                     BlockAddress address) {
     return { storage, allocator, address, BlockType::Free };
 }
 
-FreePileManager::FreePileManager(StorageBackend &storage, BlockAllocator &allocator)
+FreePileManager::FreePileManager(StorageBackend &storage, BlockManager &allocator)
     : storage_(&storage), allocator_(&allocator) {
 }
 
-bool FreePileManager::format(block_index_t block) {
+bool FreePileManager::format(block_index_t block, block_age_t age) {
     auto layout = get_layout(*storage_, *allocator_, BlockAddress{ block, 0 });
 
-    if (!layout.write_head(block)) {
+    if (!layout.write_head(block, BLOCK_INDEX_INVALID, age)) {
         return false;
     }
 
     location_ = { block, SectorSize };
+    for (auto &cursor : cursors_) {
+        cursor = { location_, 0 };
+    }
+    erasing_ = { location_, 0 };
 
     return true;
 }
 
 bool FreePileManager::locate(block_index_t block) {
-    auto layout = get_layout(*storage_, *allocator_, BlockAddress{ block, 0 });
+    return locate(block, block);
+}
 
-    if (!layout.find_append_location<FreePileEntry>(block)) {
-        return false;
+bool FreePileManager::locate(block_index_t first, block_index_t tail) {
+    auto layout = get_layout(*storage_, *allocator_, BlockAddress{ first, 0 });
+
+    if (!layout.find_append_location<FreePileEntry>(tail)) {
+        if (tail == first || !layout.find_append_location<FreePileEntry>(first)) {
+            return false;
+        }
     }
 
     location_ = layout.address();
 
+    // Blocks at the start of the pile are dropped once all their entries
+    // have been taken, so this is never far. Both streams start from the
+    // first entry that hasn't, and pass over each other's as they take.
+    LayoutIterator<FreePileBlockHead, FreePileBlockTail, FreePileEntry> iterator{ *storage_, BlockAddress{ first, 0 } };
+    FreePileEntry entry;
+    auto index = (uint32_t)0;
+    while (iterator.next(entry)) {
+        if (entry.reusable()) {
+            break;
+        }
+        index++;
+    }
+
+    for (auto &cursor : cursors_) {
+        cursor = { iterator.address(), index };
+    }
+    erasing_ = { iterator.address(), index };
+
     return true;
 }
 
@@ -48,8 +76,217 @@ bool FreePileManager::append(FreePileEntry entry) {
     return true;
 }
 
+bool FreePileManager::erase(uint32_t blocks) {
+    // Everything before the first cursor has been taken already.
+    auto &hot = cursor(BlockStream::Hot);
+    auto &cold = cursor(BlockStream::Cold);
+    auto &first = hot.entry <= cold.entry ? hot : cold;
+    if (!erasing_.address.valid() || erasing_.entry < first.entry) {
+        erasing_ = first;
+    }
+
+    if (!erasing_.address.valid()) {
+        return true;
+    }
+
+    LayoutIterator<FreePileBlockHead, FreePileBlockTail, FreePileEntry> iterator{ *storage_, erasing_.address };
+    FreePileEntry entry;
+    auto erased = (uint32_t)0;
+    while (erased < blocks && iterator.next(entry)) {
+        auto following = iterator.address();
+        following.add(sizeof(FreePileEntry));
+
+        if (entry.reusable() && !entry.is_erased()) {
+            if (!storage_->erase(entry.available)) {
+                return false;
+            }
+
+            auto address = iterator.address();
+            address.add(offsetof(FreePileEntry, erased));
+            if (!storage_->write(address, &entry.available, sizeof(block_index_t))) {
+                return false;
+            }
+
+            erased++;
+        }
+
+        erasing_ = { following, erasing_.entry + 1 };
+    }
+
+    return true;
+}
+
 bool FreePileManager::free(block_index_t block) {
-    return append({ block });
+    return free(block, BLOCK_AGE_INVALID);
+}
+
+bool FreePileManager::add(FreePileEntry entry) {
+    auto layout = get_layout(*storage_, *allocator_, location_);
+
+    auto address = layout.find_available(sizeof(FreePileEntry));
+    if (!address.valid()) {
+        return false;
+    }
+
+    // What's still to happen is left erased, for writing in place.
+    auto size = entry.is_erased() ? offsetof(FreePileEntry, taken) : offsetof(FreePileEntry, erased);
+    if (!storage_->write(address, &entry, size)) {
+        return false;
+    }
+
+    location_ = layout.address();
+
+    return true;
+}
+
+block_index_t FreePileManager::following_block(block_index_t block) {
+    auto address = BlockAddress::tail_data_of(block, storage_->geometry(), sizeof(FreePileBlockTail));
+
+    FreePileBlockTail tail;
+    if (!storage_->read(address, &tail, sizeof(FreePileBlockTail))) {
+        return BLOCK_INDEX_INVALID;
+    }
+
+    return tail.block.linked_block;
+}
+
+bool FreePileManager::initialize(Geometry &geometry) {
+    return allocator_->initialize(geometry);
+}
+
+AllocatorState FreePileManager::state() {
+    return allocator_->state();
+}
+
+void FreePileManager::state(AllocatorState state) {
+    allocator_->state(state);
+}
+
+AllocatedBlock FreePileManager::allocate(BlockType type) {
+    auto extent = take(stream_of(type), 1);
+    if (!extent.valid()) {
+        return allocator_->allocate(type);
+    }
+
+    return extent.take();
+}
+
+BlockExtent FreePileManager::reserve(BlockType type, uint32_t blocks) {
+    auto extent = take(stream_of(type), blocks);
+    if (!extent.valid()) {
+        return allocator_->reserve(type, blocks);
+    }
+
+    return extent;
+}
+
+bool FreePileManager::free(block_index_t block, block_age_t age) {
+    BlockHead head;
+    if (!storage_->read({ block, 0 }, &head, sizeof(BlockHead))) {
+        return false;
+    }
+
+    if (age == BLOCK_AGE_INVALID) {
+        age = head.valid() ? head.age : 0;
+    }
+
+    // Allocators that keep their own free blocks, ages and all, get them
+    // back instead, or they'd never learn they were freed.
+    if (allocator_->keeps_free_blocks()) {
+        return allocator_->free(block, age);
+    }
+
+    // Blocks age as they're erased, which happens before they're reused.
+    auto stream = head.valid() ? stream_of(head.type) : BlockStream::Hot;
+    return add(FreePileEntry{ block, age + 1, stream });
+}
+
+bool FreePileManager::release(BlockExtent extent) {
+    // These were never used, so they're as old as when they were taken,
+    // and still erased if they were then. Only files reserve extents.
+    if (allocator_->keeps_free_blocks()) {
+        return allocator_->release(extent);
+    }
+
+    for (auto i = (uint32_t)0; i < extent.size; ++i) {
+        if (!add(FreePileEntry{ extent.block + i, extent.age, BlockStream::Cold, extent.erased })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FreePileManager::preallocate(uint32_t expected_size) {
+    if (!erase(expected_size / storage_->geometry().block_size() + 1)) {
+        return false;
+    }
+
+    return allocator_->preallocate(expected_size);
+}
+
+BlockExtent FreePileManager::take(BlockStream stream, uint32_t blocks) {
+    auto extent = BlockExtent{ };
+    auto &cursor = this->cursor(stream);
+    auto &other = this->cursor(stream == BlockStream::Hot ? BlockStream::Cold : BlockStream::Hot);
+
+    if (empty(stream)) {
+        return extent;
+    }
+
+    // Chains are usually freed in the order they were allocated, so runs of
+    // entries are often runs of blocks too and we take as much as we can.
+    LayoutIterator<FreePileBlockHead, FreePileBlockTail, FreePileEntry> iterator{ *storage_, cursor.address };
+    FreePileEntry entry;
+    auto index = cursor.entry;
+    while (extent.size < blocks && iterator.next(entry)) {
+        auto following = iterator.address();
+        following.add(sizeof(FreePileEntry));
+
+        // The other stream's cursor comes along while it's on entries that
+        // aren't for that stream to take.
+        auto theirs = entry.reusable() && entry.stream != stream;
+        if (other.entry == index && !theirs) {
+            other = { following, index + 1 };
+        }
+
+        if (!entry.reusable() || entry.stream != stream) {
+            index++;
+            continue;
+        }
+
+        // Extents have one age and are erased or not as a whole, so runs
+        // end where either of those change.
+        if (extent.valid()) {
+            if (entry.available != extent.block + extent.size || entry.age != extent.age || entry.is_erased() != extent.erased) {
+                break;
+            }
+        }
+
+        auto address = iterator.address();
+        address.add(offsetof(FreePileEntry, taken));
+        if (!storage_->write(address, &entry.available, sizeof(block_index_t))) {
+            break;
+        }
+
+        if (!extent.valid()) {
+            extent = { entry.available, 0 };
+            extent.age = entry.age;
+            extent.erased = entry.is_erased();
+        }
+        extent.size++;
+
+        index++;
+        cursor = { following, index };
+    }
+
+    // Leave the cursor on the following entry, or where one will go.
+    if (!extent.valid() || extent.size < blocks) {
+        if (iterator.address().valid()) {
+            cursor = { iterator.address(), index };
+        }
+    }
+
+    return extent;
 }
 
 }
@@ -0,0 +1,62 @@
+#include "phylum/journal.h"
+
+namespace phylum {
+
+static BlockLayout<JournalBlockHead, JournalBlockTail> get_layout(StorageBackend &storage,
+                                                                  BlockAllocator &allocator,
+                                                                  BlockAddress address) {
+    return { storage, allocator, address, BlockType::Journal };
+}
+
+JournalManager::JournalManager(StorageBackend &storage, BlockAllocator &allocator)
+    : storage_(&storage), allocator_(&allocator) {
+}
+
+bool JournalManager::format(block_index_t block, block_age_t age) {
+    auto layout = get_layout(*storage_, *allocator_, BlockAddress{ block, 0 });
+
+    if (!layout.write_head(block, BLOCK_INDEX_INVALID, age)) {
+        return false;
+    }
+
+    location_ = { block, SectorSize };
+
+    return true;
+}
+
+bool JournalManager::locate(block_index_t block) {
+    auto layout = get_layout(*storage_, *allocator_, BlockAddress{ block, 0 });
+
+    if (!layout.find_append_location<JournalEntry>(block)) {
+        return false;
+    }
+
+    location_ = layout.address();
+
+    return true;
+}
+
+bool JournalManager::append(JournalEntry entry) {
+    auto layout = get_layout(*storage_, *allocator_, location_);
+
+    if (!layout.append(entry)) {
+        return false;
+    }
+
+    location_ = layout.address();
+
+    return true;
+}
+
+block_index_t JournalManager::following_block(block_index_t block) {
+    auto address = BlockAddress::tail_data_of(block, storage_->geometry(), sizeof(JournalBlockTail));
+
+    JournalBlockTail tail;
+    if (!storage_->read(address, &tail, sizeof(JournalBlockTail))) {
+        return BLOCK_INDEX_INVALID;
+    }
+
+    return tail.block.linked_block;
+}
+
+}
@@ -78,14 +78,17 @@ public:
     bool deserialize(BlockAddress addr, NodeType *node, TreeHead *head) {
         SerializerType serializer;
 
-        auto required = serializer.size(head != nullptr);
+        // Records never span sectors, so we can read whatever is left of
+        // this one and let the serializer find the end.
+        auto &g = storage_->geometry();
+        auto available = std::min<size_t>(addr.remaining_in_sector(g), serializer.size(true));
 
         uint8_t buffer[SerializerType::HeadNodeSize];
-        if (!storage_->read(addr, buffer, required)) {
+        if (!storage_->read(addr, buffer, available)) {
             return false;
         }
 
-        if (!serializer.deserialize(buffer, node, head)) {
+        if (!serializer.deserialize(buffer, available, node, head)) {
             return false;
         }
 
@@ -97,7 +100,7 @@ public:
 
         auto &location = node->depth == 0 ? leaf_ : index_;
         auto type = node->depth == 0 ? BlockType::Leaf : BlockType::Index;
-        auto required = serializer.size(head != nullptr);
+        auto required = serializer.size(node, head);
         auto layout = get_layout(*storage_, *allocator_, location, type);
 
         auto address = layout.find_available(required);
@@ -123,29 +126,62 @@ public:
     BlockAddress find_head(block_index_t block) {
         SerializerType serializer;
 
-        assert(block != BLOCK_INDEX_INVALID);
+        assert(is_valid_block(block));
 
-        auto layout = get_layout(*storage_, *allocator_, BlockAddress{ block, 0 }, BlockType::Error);
-        auto required = serializer.size(true);
+        auto &g = storage_->geometry();
+        auto found = BlockAddress{ };
 
-        auto fn = [&](StorageBackend &storage, BlockAddress& address) -> bool {
-            TreeHead head;
-            NodeType node;
+        // Records are appended one after another, skipping to the following
+        // sector when one won't fit, so the first sector that doesn't begin
+        // with a valid record is the end of the chain.
+        while (is_valid_block(block)) {
+            TreeBlockHead block_head(BlockType::Error);
+            if (!storage_->read(BlockAddress{ block, 0 }, &block_head, sizeof(TreeBlockHead))) {
+                return { };
+            }
 
-            if (deserialize(address, &node, &head)) {
-                return true;
+            if (!block_head.valid()) {
+                break;
             }
 
-            return false;
-        };
+            for (auto sector = (sector_index_t)1; sector < g.sectors_per_block(); ++sector) {
+                auto available = (size_t)g.sector_size;
+                if (sector == g.sectors_per_block() - 1) {
+                    available -= sizeof(TreeBlockTail);
+                }
+
+                uint8_t buffer[SectorSize];
+                auto address = BlockAddress{ block, (uint32_t)(sector * g.sector_size) };
+                if (!storage_->read(address, buffer, available)) {
+                    return { };
+                }
+
+                auto position = (size_t)0;
+                while (true) {
+                    auto size = serializer.record_size(buffer + position, available - position);
+                    if (size == 0) {
+                        break;
+                    }
+                    if (serializer.is_head(buffer + position)) {
+                        found = BlockAddress{ block, (uint32_t)(address.position + position) };
+                    }
+                    position += size;
+                }
+
+                if (position == 0) {
+                    return found;
+                }
+            }
 
-        if (!layout.find_tail_entry(block, required, fn)) {
-            return { };
-        }
+            TreeBlockTail tail;
+            if (!storage_->read(BlockAddress::tail_data_of(block, g, sizeof(TreeBlockTail)), &tail, sizeof(TreeBlockTail))) {
+                return { };
+            }
 
-        auto address = layout.address();
+            block = tail.block.linked_block;
+        }
 
-        return address;
+        return found;
     }
 
 };
@@ -16,7 +16,7 @@ public:
         return state_;
     }
 
-    SectorAddress location() {
+    BlockAddress location() {
         return manager_.location();
     }
 
@@ -1,6 +1,8 @@
 #ifndef __PHYLUM_BLOCK_ALLOC_H_INCLUDED
 #define __PHYLUM_BLOCK_ALLOC_H_INCLUDED
 
+#include <cassert>
+
 #include <phylum/private.h>
 #include <phylum/backend.h>
 
@@ -16,11 +18,34 @@ namespace phylum {
 // seem worth the effort though.
 struct AllocatorState {
     block_index_t head;
+    // Frontier of the hot stream, for allocators that keep one.
+    block_index_t hot;
 
-    AllocatorState(block_index_t head = BLOCK_INDEX_INVALID) : head(head) {
+    AllocatorState(block_index_t head = BLOCK_INDEX_INVALID, block_index_t hot = BLOCK_INDEX_INVALID) :
+        head(head), hot(hot) {
     }
 };
 
+/**
+ * Blocks that are rewritten all the time, like the tree, the free pile and
+ * the super block's links, are hot. File data is mostly written once and
+ * is cold. Allocators that keep the two apart keep blocks that are freed
+ * around the same time next to each other.
+ */
+enum class BlockStream : uint8_t {
+    Hot,
+    Cold,
+};
+
+inline BlockStream stream_of(BlockType type) {
+    switch (type) {
+    case BlockType::File:
+        return BlockStream::Cold;
+    default:
+        return BlockStream::Hot;
+    }
+}
+
 struct AllocatedBlock {
     block_index_t block{ BLOCK_INDEX_INVALID };
     block_age_t age{ 0 };
@@ -37,6 +62,38 @@ struct AllocatedBlock {
     }
 };
 
+/**
+ * A run of contiguous blocks, handed out by BlockManager::reserve so that
+ * a file's blocks sit next to each other even with other writers around.
+ * The age and whether they're erased are the same for every block in it.
+ */
+struct BlockExtent {
+    block_index_t block{ BLOCK_INDEX_INVALID };
+    uint32_t size{ 0 };
+    block_age_t age{ 0 };
+    bool erased{ false };
+
+    BlockExtent() {
+    }
+
+    BlockExtent(block_index_t block, uint32_t size) : block(block), size(size) {
+    }
+
+    BlockExtent(AllocatedBlock alloc) :
+        block(alloc.block), size(alloc.valid() ? 1 : 0), age(alloc.age), erased(alloc.erased) {
+    }
+
+    bool valid() {
+        return is_valid_block(block) && size > 0;
+    }
+
+    AllocatedBlock take() {
+        assert(valid());
+        size--;
+        return { block++, age, erased };
+    }
+};
+
 class BlockAllocator {
 public:
     virtual AllocatedBlock allocate(BlockType type) = 0;
@@ -48,6 +105,14 @@ public:
     virtual bool preallocate(uint32_t expected_size) {
         return true;
     }
+
+    /**
+     * Whether freed blocks are kept track of here and handed out again,
+     * rather than forgotten. Those wrapping us should free into us then.
+     */
+    virtual bool keeps_free_blocks() {
+        return false;
+    }
 };
 
 class EmptyAllocator : public BlockAllocator {
@@ -63,22 +128,63 @@ public:
     virtual AllocatorState state() = 0;
     virtual void state(AllocatorState state) = 0;
 
+    /**
+     * Reserves up to `blocks` contiguous blocks, though possibly fewer. By
+     * default this is a single block, as it was allocated.
+     */
+    virtual BlockExtent reserve(BlockType type, uint32_t blocks) {
+        return BlockExtent{ allocate(type) };
+    }
+
+    /**
+     * Returns the blocks of an extent that were never used.
+     */
+    virtual bool release(BlockExtent extent) {
+        for (auto i = (uint32_t)0; i < extent.size; ++i) {
+            if (!free(extent.block + i, extent.age)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
 };
 
+/**
+ * Hands out blocks in order. When streams are separated, cold blocks are
+ * taken going up from the start of the device and hot ones going down
+ * from the end, until the two meet.
+ */
 class SequentialBlockAllocator : public BlockManager {
 private:
     Geometry *geometry_{ nullptr };
     uint32_t block_{ 3 };
+    uint32_t hot_{ BLOCK_INDEX_INVALID };
+    bool streams_{ false };
 
 public:
     SequentialBlockAllocator();
 
+public:
+    void separate_streams(bool enabled) {
+        streams_ = enabled;
+    }
+
 public:
     bool initialize(Geometry &geometry) override;
     bool free(block_index_t block, block_age_t age) override;
     AllocatorState state() override;
     void state(AllocatorState state) override;
     AllocatedBlock allocate(BlockType type) override;
+    BlockExtent reserve(BlockType type, uint32_t blocks) override;
+    bool release(BlockExtent extent) override;
+
+private:
+    bool hot(BlockType type) {
+        return streams_ && stream_of(type) == BlockStream::Hot;
+    }
+
+    uint32_t available();
 
 };
 
@@ -108,6 +214,8 @@ public:
 
 public:
     AllocatedBlock allocate(BlockType type) override;
+    BlockExtent reserve(BlockType type, uint32_t blocks) override;
+    bool release(BlockExtent extent) override;
 
 };
 
@@ -125,8 +233,12 @@ public:
     AllocatorState state() override;
     void state(AllocatorState state) override;
     AllocatedBlock allocate(BlockType type) override;
+    BlockExtent reserve(BlockType type, uint32_t blocks) override;
     bool free(block_index_t block, block_age_t age) override;
 
+private:
+    void fill();
+
 };
 #endif
 
@@ -0,0 +1,80 @@
+#ifndef __PHYLUM_BLOCK_BITMAP_H_INCLUDED
+#define __PHYLUM_BLOCK_BITMAP_H_INCLUDED
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "phylum/private.h"
+
+namespace phylum {
+
+/**
+ * One bit per block, set when the block is taken, sized for the device when
+ * initialized. A second level keeps a bit per word of the map that's set
+ * when that word has any free blocks, so finding a free block skips 1024
+ * taken blocks at a time, and a count of free blocks is kept as they change.
+ */
+class BlockBitmap {
+public:
+    static constexpr uint32_t BitsPerWord = 32;
+
+private:
+    uint32_t *words_{ nullptr };
+    uint32_t *summary_{ nullptr };
+    uint32_t size_{ 0 };
+    uint32_t free_{ 0 };
+
+public:
+    BlockBitmap();
+    BlockBitmap(const BlockBitmap&) = delete;
+    BlockBitmap &operator=(const BlockBitmap&) = delete;
+    virtual ~BlockBitmap();
+
+public:
+    uint32_t size() const {
+        return size_;
+    }
+
+    uint32_t number_of_free() const {
+        return free_;
+    }
+
+    bool is_free(block_index_t block) const {
+        return block < size_ && (words_[block / BitsPerWord] & bit(block)) == 0;
+    }
+
+public:
+    /**
+     * Sizes the map for the given number of blocks, all of them free or
+     * all of them taken.
+     */
+    bool initialize(uint32_t number_of_blocks, bool free = true);
+    void set_free(block_index_t block);
+    void set_taken(block_index_t block);
+    /**
+     * The first free block at or after the given one, or BLOCK_INDEX_INVALID
+     * if there aren't any.
+     */
+    block_index_t first_free(block_index_t from = 0) const;
+    /**
+     * The last free block, or BLOCK_INDEX_INVALID if there aren't any.
+     */
+    block_index_t last_free() const;
+
+private:
+    static uint32_t bit(block_index_t block) {
+        return (uint32_t)1 << (block % BitsPerWord);
+    }
+
+    static uint32_t words_for(uint32_t bits) {
+        return (bits + BitsPerWord - 1) / BitsPerWord;
+    }
+
+    void release();
+    void summarize(uint32_t word);
+
+};
+
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __PHYLUM_BLOCK_HEAP_H_INCLUDED
+#define __PHYLUM_BLOCK_HEAP_H_INCLUDED
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "phylum/private.h"
+
+namespace phylum {
+
+/**
+ * Blocks ordered by age, youngest first, so the least worn block can be
+ * taken without looking at any others. Ties go to the lower block. Space
+ * for every block is allocated up front when initialized, so pushing never
+ * fails after that.
+ */
+class BlockHeap {
+public:
+    struct Entry {
+        block_index_t block;
+        block_age_t age;
+    };
+
+private:
+    Entry *entries_{ nullptr };
+    uint32_t capacity_{ 0 };
+    uint32_t size_{ 0 };
+
+public:
+    BlockHeap();
+    BlockHeap(const BlockHeap&) = delete;
+    BlockHeap &operator=(const BlockHeap&) = delete;
+    virtual ~BlockHeap();
+
+public:
+    uint32_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    /**
+     * The youngest block, which is only valid when the heap isn't empty.
+     */
+    const Entry &top() const {
+        return entries_[0];
+    }
+
+public:
+    bool initialize(uint32_t capacity);
+    void clear();
+    bool push(block_index_t block, block_age_t age);
+    Entry pop();
+    /**
+     * Changes the age of a block that's already in the heap. This has to
+     * search for the block so it's only for the rare times a free block is
+     * freed again.
+     */
+    bool update(block_index_t block, block_age_t age);
+    /**
+     * Takes a block out of the heap, searching for it like update does.
+     */
+    bool remove(block_index_t block);
+
+private:
+    static bool before(const Entry &a, const Entry &b) {
+        return a.age < b.age || (a.age == b.age && a.block < b.block);
+    }
+
+    void sift_up(uint32_t i);
+    void sift_down(uint32_t i);
+
+};
+
+}
+
+#endif
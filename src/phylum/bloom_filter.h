@@ -0,0 +1,74 @@
+#ifndef __PHYLUM_BLOOM_FILTER_H_INCLUDED
+#define __PHYLUM_BLOOM_FILTER_H_INCLUDED
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace phylum {
+
+/**
+ * Remembers which 32bit ids have been added in a fixed number of bytes. It
+ * may answer that an id was added when it wasn't, but never the other way
+ * around, so a negative answer can be trusted without looking any further.
+ * Ids can't be removed, they linger until the filter is cleared.
+ */
+template<size_t Bytes, size_t Hashes = 3>
+class BloomFilter {
+    static_assert(Bytes > 0, "Filter needs at least one byte.");
+    static_assert(Hashes > 0, "Filter needs at least one hash.");
+
+public:
+    static constexpr uint32_t Bits = Bytes * 8;
+
+private:
+    uint8_t bits_[Bytes];
+
+public:
+    BloomFilter() {
+        clear();
+    }
+
+public:
+    void clear() {
+        memset(bits_, 0, sizeof(bits_));
+    }
+
+    void add(uint32_t id) {
+        auto h1 = id;
+        auto h2 = mix(id);
+        for (auto i = (uint32_t)0; i < Hashes; ++i) {
+            auto bit = (h1 + i * h2) % Bits;
+            bits_[bit / 8] |= (uint8_t)(1 << (bit % 8));
+        }
+    }
+
+    bool might_contain(uint32_t id) const {
+        auto h1 = id;
+        auto h2 = mix(id);
+        for (auto i = (uint32_t)0; i < Hashes; ++i) {
+            auto bit = (h1 + i * h2) % Bits;
+            if ((bits_[bit / 8] & (uint8_t)(1 << (bit % 8))) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    // Ids are usually already hashes, so this only needs to give us a second,
+    // independent looking one. Forced odd so the step is never zero.
+    static uint32_t mix(uint32_t h) {
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h | 1;
+    }
+
+};
+
+}
+
+#endif
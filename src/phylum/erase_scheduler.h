@@ -0,0 +1,165 @@
+#ifndef __PHYLUM_ERASE_SCHEDULER_H_INCLUDED
+#define __PHYLUM_ERASE_SCHEDULER_H_INCLUDED
+
+#if !defined(ARDUINO)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#include "phylum/backend.h"
+#include "phylum/block_alloc.h"
+
+namespace phylum {
+
+/**
+ * Sits in front of an allocator so that writers rarely wait on an erase.
+ * Freed blocks are queued and only handed back to the allocator, which is
+ * what erases them, when there's time. Meanwhile a pool of blocks is
+ * erased ahead of being allocated, one for each BlockStream so that the
+ * allocator can keep the streams apart. The work is done by calling
+ * service when idle, or on Linux by a worker thread. When using the
+ * worker, the storage has to be safe to erase from it while others write.
+ *
+ * The queue of frees is only kept in RAM. Blocks still in it when power
+ * is lost were never given back, so the allocator will find them taken
+ * after a restart and they're lost until something like
+ * UnusedBlockReclaimer finds them. Call flush before powering down, and
+ * after freeing blocks whose loss can't wait for reclaiming.
+ */
+class EraseScheduler : public BlockManager {
+public:
+    // Erased blocks kept ahead for each stream.
+    static constexpr uint32_t DefaultPoolSize = 8;
+    static constexpr uint32_t DefaultQueueSize = 16;
+
+    struct PendingFree {
+        block_index_t block;
+        block_age_t age;
+    };
+
+    struct Pool {
+        AllocatedBlock *blocks{ nullptr };
+        uint32_t capacity{ 0 };
+        uint32_t head{ 0 };
+        uint32_t pooled{ 0 };
+    };
+
+private:
+    #if !defined(ARDUINO)
+    using Mutex = std::mutex;
+    using Lock = std::unique_lock<std::mutex>;
+    #else
+    struct Mutex {
+    };
+    struct Lock {
+        Lock(Mutex&) {
+        }
+        void unlock() {
+        }
+        void lock() {
+        }
+    };
+    #endif
+
+    StorageBackend *storage_;
+    ReusableBlockAllocator *allocator_;
+    BlockManager *manager_{ nullptr };
+    AllocatedBlock *pool_{ nullptr };
+    // Indexed by BlockStream, both in pool_.
+    Pool pools_[2];
+    PendingFree *queue_{ nullptr };
+    uint32_t queue_capacity_{ 0 };
+    uint32_t queue_head_{ 0 };
+    uint32_t pending_{ 0 };
+    uint32_t misses_{ 0 };
+    // Set when the allocator ran out while refilling, until a block's freed.
+    bool exhausted_{ false };
+    // The pool and queue are guarded separately from the allocator, so that
+    // taking a block from the pool never waits on a deferred free.
+    Mutex state_;
+    Mutex allocating_;
+    #if !defined(ARDUINO)
+    std::condition_variable wake_;
+    std::thread worker_;
+    bool running_{ false };
+    #endif
+
+public:
+    EraseScheduler(StorageBackend &storage, BlockManager &manager,
+                   uint32_t pool_size = DefaultPoolSize, uint32_t queue_size = DefaultQueueSize);
+    EraseScheduler(StorageBackend &storage, ReusableBlockAllocator &allocator,
+                   uint32_t pool_size = DefaultPoolSize, uint32_t queue_size = DefaultQueueSize);
+    EraseScheduler(const EraseScheduler&) = delete;
+    EraseScheduler &operator=(const EraseScheduler&) = delete;
+    virtual ~EraseScheduler();
+
+public:
+    /**
+     * Number of erased blocks waiting to be allocated.
+     */
+    uint32_t pooled();
+
+    /**
+     * Number of erased blocks waiting to be allocated to the given stream.
+     */
+    uint32_t pooled(BlockStream stream);
+
+    /**
+     * Number of freed blocks that haven't been given back yet.
+     */
+    uint32_t pending();
+
+    /**
+     * Number of allocations the pool couldn't serve, which were handed to
+     * the caller without being erased.
+     */
+    uint32_t misses();
+
+    /**
+     * Gives back queued frees and tops up the pool, erasing at most the
+     * given number of blocks.
+     */
+    bool service(uint32_t erases = UINT32_MAX);
+
+    /**
+     * Gives back every queued free, without touching the pool.
+     */
+    bool flush();
+
+    #if !defined(ARDUINO)
+    bool start();
+    void stop();
+    #endif
+
+public:
+    bool initialize(Geometry &geometry) override;
+    AllocatorState state() override;
+    void state(AllocatorState state) override;
+    AllocatedBlock allocate(BlockType type) override;
+    bool free(block_index_t block, block_age_t age) override;
+    bool release(BlockExtent extent) override;
+    bool preallocate(uint32_t expected_size) override;
+    bool keeps_free_blocks() override;
+
+private:
+    void create(uint32_t pool_size, uint32_t queue_size);
+    Pool &pool(BlockStream stream) {
+        return pools_[(uint8_t)stream];
+    }
+    bool filled();
+    bool dequeue(PendingFree &pending);
+    /**
+     * Returns the number of blocks erased, or -1 if something failed.
+     */
+    int32_t work(uint32_t erases, bool refill);
+    void wake();
+    #if !defined(ARDUINO)
+    void run();
+    #endif
+
+};
+
+}
+
+#endif
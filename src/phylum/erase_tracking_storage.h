@@ -0,0 +1,67 @@
+#ifndef __PHYLUM_ERASE_TRACKING_STORAGE_H_INCLUDED
+#define __PHYLUM_ERASE_TRACKING_STORAGE_H_INCLUDED
+
+#include "phylum/backend.h"
+#include "phylum/block_bitmap.h"
+
+namespace phylum {
+
+struct EraseStatistics {
+    uint32_t erases{ 0 };
+    uint32_t avoided{ 0 };
+};
+
+/**
+ * Remembers which blocks are known to be erased, so erasing one of them
+ * again is skipped. Nothing is known when opened, so every block starts
+ * out needing an erase, and any write to a block forgets that it was.
+ */
+class EraseTrackingStorage : public StorageBackend {
+private:
+    StorageBackend &target;
+    // Free bits are the blocks known to be erased.
+    BlockBitmap erased_;
+    EraseStatistics statistics_;
+
+public:
+    EraseTrackingStorage(StorageBackend &target);
+
+public:
+    bool is_erased(block_index_t block) const {
+        return erased_.is_free(block);
+    }
+
+    EraseStatistics statistics() const {
+        return statistics_;
+    }
+
+public:
+    virtual bool open() override;
+
+    virtual bool close() override {
+        return target.close();
+    }
+
+    virtual Geometry &geometry() override {
+        return target.geometry();
+    }
+
+    virtual void geometry(Geometry g) override {
+        target.geometry(g);
+    }
+
+    virtual bool read(BlockAddress addr, void *d, size_t n) override {
+        return target.read(addr, d, n);
+    }
+
+    virtual bool erase(block_index_t block) override;
+
+    virtual bool eraseAll() override;
+
+    virtual bool write(BlockAddress addr, void *d, size_t n) override;
+
+};
+
+}
+
+#endif
@@ -8,6 +8,17 @@
 #include "phylum/inodes.h"
 #include "phylum/backend_nodes.h"
 #include "phylum/free_pile.h"
+#include "phylum/wear_leveling_allocator.h"
+#include "phylum/journal.h"
+#include "phylum/memtable.h"
+#include "phylum/bloom_filter.h"
+
+// Bytes of RAM given to remembering which files exist, so that looking for
+// missing ones can usually skip the tree. Boards with RAM to spare can raise
+// this, around a byte per file keeps false positives under 10%.
+#ifndef PHYLUM_FILE_FILTER_BYTES
+#define PHYLUM_FILE_FILTER_BYTES 64
+#endif
 
 namespace phylum {
 
@@ -17,7 +28,7 @@ struct FileBlockHead {
     BlockHead block;
     file_id_t file_id{ FILE_ID_INVALID };
     uint32_t version{ 0 };
-    uint64_t position{ 0 }; // NOTE: Unused for now.
+    uint64_t position{ 0 }; // Position in the file of this block's first byte.
     uint32_t reserved[4];   // NOTE: Unused for now.
 
     FileBlockHead() : block(BlockType::File) {
@@ -63,10 +74,35 @@ enum class Seek {
     End,
 };
 
+/**
+ * How many blocks open files write between saving their position in the
+ * tree. Files start out saving every `initial` blocks. Every seek halves
+ * that, down to `minimum`, and every save made without a seek since the last
+ * doubles it, up to `maximum`. So files that get seeked around have dense
+ * positions and append only logs have sparse ones.
+ */
+struct PositionPolicy {
+    uint8_t initial;
+    uint8_t minimum;
+    uint8_t maximum;
+
+    PositionPolicy(uint8_t initial = 8, uint8_t minimum = 2, uint8_t maximum = 32) :
+        initial(initial), minimum(minimum), maximum(maximum) {
+    }
+};
+
 class OpenFile {
-    static constexpr uint32_t InvalidLengthOrPosition = UINT32_MAX;
-    static constexpr uint8_t PositionSaveFrequency = 8;
-    static constexpr int32_t SeekFailed = INT32_MAX;
+    static constexpr uint64_t InvalidLengthOrPosition = UINT64_MAX;
+    static constexpr int64_t SeekFailed = INT64_MAX;
+    // Number of block positions each handle remembers.
+    static constexpr uint8_t SeekCacheSize = 4;
+    // Number of contiguous blocks writers reserve at a time.
+    static constexpr uint8_t ExtentBlocks = 8;
+
+    struct KnownPosition {
+        uint64_t position;
+        BlockAddress address;
+    };
 
 private:
     FileSystem *fs_;
@@ -75,9 +111,16 @@ private:
     bool readonly_{ false };
 
     uint32_t bytes_in_block_{ 0 };
-    uint32_t length_{ 0 };
-    uint32_t position_{ 0 };
+    uint64_t length_{ 0 };
+    uint64_t position_{ 0 };
     uint8_t blocks_since_save_{ 0 };
+    uint8_t save_frequency_;
+    bool seeked_{ false };
+    BlockExtent extent_;
+
+    KnownPosition known_[SeekCacheSize];
+    uint8_t number_known_{ 0 };
+    uint8_t next_known_{ 0 };
 
     uint8_t buffer_[SectorSize];
     uint16_t available_{ 0 };
@@ -89,10 +132,10 @@ public:
 public:
     bool open();
     bool open_or_create();
-    uint32_t size();
-    uint32_t tell();
-    int32_t seek(Seek seek, uint32_t position = 0);
-    int32_t seek(uint32_t position);
+    uint64_t size();
+    uint64_t tell();
+    int64_t seek(Seek seek, uint64_t position = 0);
+    int64_t seek(uint64_t position);
     int32_t write(const void *ptr, size_t size);
     int32_t read(void *ptr, size_t size);
     void close();
@@ -104,28 +147,65 @@ public:
 private:
     int32_t flush();
     bool tail_sector();
+    int64_t locate(Seek where, uint64_t position);
+    AllocatedBlock allocate(bool &reserved);
+    void remember(uint64_t position, BlockAddress address);
+    bool recall(uint64_t position, KnownPosition &known);
 
     struct SeekStatistics {
         BlockAddress address;
         int32_t blocks;
-        int32_t bytes;
+        uint64_t bytes;
+        uint64_t block_bytes; // Bytes walked before the final block.
     };
 
-    SeekStatistics seek(BlockAddress starting, uint32_t max);
-    BlockAddress initialize_block(AllocatedBlock block, block_index_t previous);
+    SeekStatistics seek(BlockAddress starting, uint64_t max);
+    BlockAddress initialize_block(AllocatedBlock block, block_index_t previous, uint64_t position);
+
+};
+
+struct FileInfo {
+    file_id_t id;
+    BlockAddress head;
+};
+
+class FileVisitor {
+public:
+    virtual void file(FileInfo info) = 0;
+
+};
+
+struct PositionInfo {
+    uint64_t position;
+    BlockAddress address;
+};
+
+class PositionVisitor {
+public:
+    virtual void position(PositionInfo info) = 0;
 
 };
 
 class FileSystem {
 private:
-    using NodeType = Node<uint64_t, uint64_t, BlockAddress, 6, 6>;
+    using NodeType = SectorSizedNode<uint64_t, uint64_t, BlockAddress>::NodeType;
+
+    // Saved file positions are buffered and added to the tree this many at a
+    // time, rather than rewriting the path to a leaf for every one.
+    static constexpr size_t PendingPositions = 16;
 
     StorageBackend *storage_;
+    // Everything allocates through the free pile, so freed blocks are used
+    // again before any new ones are taken from the BlockManager.
+    FreePileManager fpm_;
     BlockManager *allocator_;
     TreeFileSystemSuperBlockManager sbm_;
     StorageBackendNodeStorage<NodeType> nodes_;
     BlockAddress tree_addr_;
-    FreePileManager fpm_;
+    JournalManager journal_;
+    MemTable<uint64_t, uint64_t, PendingPositions> pending_;
+    BloomFilter<PHYLUM_FILE_FILTER_BYTES> files_;
+    PositionPolicy position_policy_;
 
 public:
     FileSystem(StorageBackend &storage, BlockManager &allocator);
@@ -147,17 +227,107 @@ public:
         return fpm_;
     }
 
+    JournalManager &journal() {
+        return journal_;
+    }
+
+    /**
+     * Changes how often files opened after this save their positions.
+     */
+    void position_policy(PositionPolicy policy) {
+        position_policy_ = policy;
+    }
+
 public:
     bool mount(bool wipe = false);
     bool exists(const char *name);
     OpenFile open(const char *name, bool readonly = false);
+    /**
+     * Removes the file from the tree and frees its blocks, erasing them so
+     * they're ready for whoever writes next.
+     */
+    bool remove(const char *name);
+    /**
+     * Visits every file in the tree in order of their id. Visitors are
+     * called while the tree is being walked and mustn't use the FileSystem.
+     */
+    bool list(FileVisitor &visitor);
+    /**
+     * Visits the beginning and every saved position of the given file, in
+     * order. The same restrictions as list apply to the visitor.
+     */
+    bool positions(file_id_t id, PositionVisitor &visitor);
     bool gc();
+    /**
+     * Moves live tree nodes out of the oldest leaf and index blocks, spending
+     * at most around `budget` node reads and writes, and frees those blocks
+     * once they're empty. Progress is kept in the super block, so this can be
+     * called whenever there's time to spare. Freed blocks are erased here
+     * too, rather than by whoever is given them.
+     */
+    bool gc(uint32_t budget);
+    /**
+     * Adds any buffered file positions to the tree. This happens on its own
+     * when the buffer fills and on unmount. Until then they're kept in the
+     * journal, which is replayed when mounting.
+     */
+    bool flush();
     bool unmount();
+    /**
+     * Whether the block is one of a file's, which are the only ones migrate
+     * can move.
+     */
+    bool movable(block_index_t block);
+    /**
+     * Moves a file's block into `to`, see BlockMigrator. Blocks are only
+     * linked to from the tail of the block before them, which can't be
+     * rewritten, so every block of the file up to this one is copied into
+     * newly allocated blocks too, and the old ones besides `from` freed.
+     * Files mustn't be open while this happens.
+     */
+    bool migrate(block_index_t from, AllocatedBlock to);
 
 private:
+    bool save_position(uint64_t key, uint64_t value);
+    bool save_allocation();
+    bool checkpoint();
+    bool replay();
+    bool index_files();
+    /**
+     * Returns UINT64_MAX if the block's head can't be read.
+     */
+    uint64_t position_of(INodeKey key, BlockAddress address);
     bool touch();
     bool format();
     void prepare(TreeFileSystemSuperBlock &sb);
+    block_index_t oldest_block(block_index_t known, BlockAddress frontier, BlockType type);
+    block_index_t following_block(block_index_t block);
+    bool free_chain(block_index_t oldest, BlockAddress frontier);
+    block_index_t following_file_block(block_index_t block);
+    bool copy_file_block(block_index_t block, FileBlockHead head, AllocatedBlock copy, block_index_t previous,
+                         block_index_t following);
+
+};
+
+/**
+ * Lets a WearLevelingBlockAllocator move cold file blocks.
+ */
+class FileSystemMigrator : public BlockMigrator {
+private:
+    FileSystem *fs_;
+
+public:
+    FileSystemMigrator(FileSystem &fs) : fs_(&fs) {
+    }
+
+public:
+    bool movable(block_index_t block) override {
+        return fs_->movable(block);
+    }
+
+    bool migrate(block_index_t from, AllocatedBlock to) override {
+        return fs_->migrate(from, to);
+    }
 
 };
 
@@ -47,6 +47,7 @@ struct FileTableTail {
 class FileTable {
 private:
     BlockLayout<FileTableHead, FileTableTail> layout;
+    LayoutIterator<FileTableHead, FileTableTail, FileTableEntry> iterator;
 
 public:
     FileTable(StorageBackend &storage);
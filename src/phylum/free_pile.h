@@ -24,38 +24,140 @@ struct FreePileBlockHead {
     }
 };
 
+/**
+ * Freed blocks are appended with taken left erased, which is written in
+ * place when the block is reused. Blocks are reused in the order they
+ * were freed, so the taken entries are always at the start of the pile.
+ * The age is the one the block has once it's been erased to be reused,
+ * and erased is the block again when that's already happened. Blocks are
+ * only reused for the stream they were freed from.
+ */
 struct FreePileEntry {
     block_index_t available;
+    block_age_t age;
+    BlockStream stream;
+    uint8_t reserved[3];
+    block_index_t erased;
     block_index_t taken;
 
+    FreePileEntry(block_index_t available = BLOCK_INDEX_INVALID, block_age_t age = 0,
+                  BlockStream stream = BlockStream::Hot, bool erased = false) :
+        available(available), age(age), stream(stream), reserved{ },
+        erased(erased ? available : BLOCK_INDEX_INVALID), taken(BLOCK_INDEX_INVALID) {
+    }
+
     bool valid() {
         return is_valid_block(available) || is_valid_block(taken);
     }
+
+    bool reusable() {
+        return is_valid_block(available) && !is_valid_block(taken);
+    }
+
+    bool is_erased() {
+        return is_valid_block(erased);
+    }
 };
 
 struct FreePileBlockTail {
     BlockTail block;
 };
 
-class FreePileManager {
+/**
+ * Keeps the blocks freed by the file system and hands them out again before
+ * asking the underlying BlockManager, which the pile's own blocks come from.
+ * When that BlockManager keeps its own free blocks they go back to it
+ * instead, and the pile stays empty.
+ */
+class FreePileManager : public BlockManager {
 private:
+    struct Cursor {
+        BlockAddress address;
+        // Entries before this one since the pile was located, which tells
+        // us which cursor is first.
+        uint32_t entry;
+
+        Cursor(BlockAddress address = { }, uint32_t entry = 0) : address(address), entry(entry) {
+        }
+    };
+
     StorageBackend *storage_;
-    BlockAllocator *allocator_;
+    BlockManager *allocator_;
     BlockAddress location_;
+    // Indexed by BlockStream. There's nothing left to take for a stream
+    // before its cursor, though the entry it's on may be for the other.
+    Cursor cursors_[2];
+    // Blocks before this that haven't been taken have been erased.
+    Cursor erasing_;
 
 public:
-    FreePileManager(StorageBackend &storage, BlockAllocator &allocator);
+    FreePileManager(StorageBackend &storage, BlockManager &allocator);
 
 public:
     BlockAddress location() {
         return location_;
     }
 
+    /**
+     * The first entry that may not have been taken, or the location when
+     * they all have been.
+     */
+    BlockAddress cursor() {
+        auto &hot = cursor(BlockStream::Hot);
+        auto &cold = cursor(BlockStream::Cold);
+        return hot.entry <= cold.entry ? hot.address : cold.address;
+    }
+
+    bool empty() {
+        return empty(BlockStream::Hot) && empty(BlockStream::Cold);
+    }
+
 public:
-    bool format(block_index_t block);
+    bool format(block_index_t block, block_age_t age = 0);
     bool locate(block_index_t block);
+    /**
+     * Finds the end of the pile starting from tail, or from first if that
+     * fails, and the first entry that hasn't been taken starting from first.
+     */
+    bool locate(block_index_t first, block_index_t tail);
     bool append(FreePileEntry entry);
+    /**
+     * Erases up to `blocks` of the blocks that haven't been taken yet, in
+     * the order they'll be taken, so that they're handed out erased and
+     * whoever gets them can write right away.
+     */
+    bool erase(uint32_t blocks);
+    /**
+     * Frees the block with the age in its head. Either way, the block's
+     * head decides which stream it's reused for.
+     */
     bool free(block_index_t block);
+    block_index_t following_block(block_index_t block);
+
+public:
+    bool initialize(Geometry &geometry) override;
+    AllocatorState state() override;
+    void state(AllocatorState state) override;
+    AllocatedBlock allocate(BlockType type) override;
+    BlockExtent reserve(BlockType type, uint32_t blocks) override;
+    bool free(block_index_t block, block_age_t age) override;
+    bool release(BlockExtent extent) override;
+    bool preallocate(uint32_t expected_size) override;
+    bool keeps_free_blocks() override {
+        return true;
+    }
+
+private:
+    Cursor &cursor(BlockStream stream) {
+        return cursors_[(uint8_t)stream];
+    }
+
+    bool empty(BlockStream stream) {
+        return !cursor(stream).address.valid() || cursor(stream).address == location_;
+    }
+
+    bool add(FreePileEntry entry);
+    BlockExtent take(BlockStream stream, uint32_t blocks);
 
 };
 
@@ -36,14 +36,14 @@ public:
 
     virtual bool deserialize(ADDRESS addr, NodeType *node, TreeHead *head) override {
         SerializerType serializer;
-        return serializer.deserialize(lookup(addr), node, head);
+        return serializer.deserialize(lookup(addr), serializer.size(true), node, head);
     }
 
     virtual ADDRESS serialize(ADDRESS addr, const NodeType *node, const TreeHead *head) override {
         SerializerType serializer;
 
         if (!addr.valid()) {
-            addr = allocate(serializer.size(head));
+            addr = allocate(serializer.size(head != nullptr));
         }
 
         if (!serializer.serialize(lookup(addr), node, head)) {
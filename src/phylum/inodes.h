@@ -11,7 +11,16 @@
 
 namespace phylum {
 
+/**
+ * File ids are kept in the upper half and positions in the lower, counted in
+ * granules of 1 << PositionShift bytes so that files can grow to a terabyte.
+ * The exact position is kept in the head of the block saved with it.
+ */
 class INodeKey {
+public:
+    static constexpr uint32_t PositionShift = 8;
+    static constexpr uint32_t MaximumGranule = UINT32_MAX - 1;
+
 private:
     uint64_t value_;
 
@@ -48,8 +57,18 @@ public:
         return make(id, 0);
     }
 
-    static INodeKey file_position(uint32_t id, uint32_t length) {
-        return make(id, length);
+    // Saved positions are rounded up to the following granule, and looked
+    // for using file_following, which rounds down. So a position found
+    // that way is never past the one we were after.
+    static INodeKey file_position(uint32_t id, uint64_t position) {
+        auto granule = (position >> PositionShift) + ((position & ((1 << PositionShift) - 1)) != 0 ? 1 : 0);
+        return make(id, granule > MaximumGranule ? MaximumGranule : (uint32_t)granule);
+    }
+
+    // The key after every position saved at or before the given one.
+    static INodeKey file_following(uint32_t id, uint64_t position) {
+        auto granule = (position >> PositionShift) + 1;
+        return make(id, granule > UINT32_MAX ? UINT32_MAX : (uint32_t)granule);
     }
 
     static INodeKey file_beginning(const char *name) {
@@ -0,0 +1,147 @@
+#ifndef __PHYLUM_JOURNAL_H_INCLUDED
+#define __PHYLUM_JOURNAL_H_INCLUDED
+
+#include "phylum/backend.h"
+#include "phylum/block_alloc.h"
+#include "phylum/crc.h"
+#include "phylum/layout.h"
+
+namespace phylum {
+
+struct JournalBlockHead {
+    BlockHead block;
+
+    JournalBlockHead(BlockType type = BlockType::Journal) : block(type) {
+    }
+
+    void fill() {
+        block.magic.fill();
+        block.age = 0;
+        block.timestamp = 0;
+    }
+
+    bool valid() const {
+        return block.valid();
+    }
+};
+
+enum class JournalEntryKind : uint8_t {
+    // The tree and super block were saved with the given timestamp, so the
+    // entries before this one are in them.
+    Checkpoint = 0x43,
+    // A file position was saved, see FileSystem::save_position.
+    Position = 0x50,
+    // A file took another block from the allocator.
+    Block = 0x42,
+};
+
+/**
+ * Entries are small and fixed size so that logging a change is a single
+ * short write. Every entry has the allocator's state as of that change.
+ */
+struct JournalEntry {
+    JournalEntryKind kind;
+    uint8_t reserved[3];
+    block_index_t head;
+    uint64_t key;
+    uint64_t value;
+    block_index_t hot;
+    uint32_t crc;
+
+    JournalEntry() {
+        memset(this, 0, sizeof(JournalEntry));
+    }
+
+    JournalEntry(JournalEntryKind kind, AllocatorState state, uint64_t key = 0, uint64_t value = 0) {
+        memset(this, 0, sizeof(JournalEntry));
+        this->kind = kind;
+        this->head = state.head;
+        this->hot = state.hot;
+        this->key = key;
+        this->value = value;
+        this->crc = checksum();
+    }
+
+    bool valid() {
+        switch (kind) {
+        case JournalEntryKind::Checkpoint:
+        case JournalEntryKind::Position:
+        case JournalEntryKind::Block:
+            return crc == checksum();
+        default:
+            return false;
+        }
+    }
+
+private:
+    uint32_t checksum() {
+        return crc32_checksum(reinterpret_cast<uint8_t*>(this), offsetof(JournalEntry, crc));
+    }
+};
+
+struct JournalBlockTail {
+    BlockTail block;
+};
+
+/**
+ * An append only log of metadata changes made since the super block was
+ * last saved, which are replayed when mounting.
+ */
+class JournalManager {
+private:
+    StorageBackend *storage_;
+    BlockAllocator *allocator_;
+    BlockAddress location_;
+
+public:
+    JournalManager(StorageBackend &storage, BlockAllocator &allocator);
+
+public:
+    BlockAddress location() {
+        return location_;
+    }
+
+public:
+    bool format(block_index_t block, block_age_t age = 0);
+    bool locate(block_index_t block);
+    bool append(JournalEntry entry);
+    block_index_t following_block(block_index_t block);
+
+    /**
+     * Calls fn with every entry after the last checkpoint made by a super
+     * block with the given timestamp or before it. Later checkpoints are
+     * from saves that never finished, so we go on past them.
+     */
+    template<typename FN>
+    bool replay(block_index_t block, timestamp_t timestamp, FN fn) {
+        using IteratorType = LayoutIterator<JournalBlockHead, JournalBlockTail, JournalEntry>;
+
+        // We only know which checkpoint is the last finished one once we've
+        // seen them all, so this takes two passes.
+        auto skipping = (uint32_t)0;
+        auto number = (uint32_t)0;
+        JournalEntry entry;
+
+        IteratorType finding{ *storage_, BlockAddress{ block, 0 } };
+        while (finding.next(entry)) {
+            number++;
+            if (entry.kind == JournalEntryKind::Checkpoint && entry.key <= timestamp) {
+                skipping = number;
+            }
+        }
+
+        IteratorType replaying{ *storage_, BlockAddress{ block, 0 } };
+        for (auto i = (uint32_t)0; i < number && replaying.next(entry); ++i) {
+            if (i >= skipping && entry.kind != JournalEntryKind::Checkpoint) {
+                fn(entry);
+            }
+        }
+
+        return true;
+    }
+
+};
+
+}
+
+#endif
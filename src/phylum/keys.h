@@ -1,28 +1,83 @@
 #ifndef __PHYLUM_KEYS_H_INCLUDED
 #define __PHYLUM_KEYS_H_INCLUDED
 
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PHYLUM_KEYS_AVX2
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define PHYLUM_KEYS_SSE42
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PHYLUM_KEYS_NEON
+#endif
+
+#if defined(PHYLUM_KEYS_AVX2) || defined(PHYLUM_KEYS_SSE42) || defined(PHYLUM_KEYS_NEON)
+#define PHYLUM_KEYS_VECTORIZED
+#endif
+
 namespace phylum {
 
 class Keys {
+public:
+    // Nodes with at least this many keys are searched with a binary search,
+    // smaller ones are faster to just scan.
+    static constexpr size_t BinarySearchThreshold = 16;
+
+    // Nodes of 64bit keys with at least this many keys are searched by
+    // comparing several keys at once, when the target supports it.
+    static constexpr size_t VectorSearchThreshold = 8;
+
+private:
+    enum class Strategy {
+        Linear,
+        Binary,
+        Vectorized,
+    };
+
+    template<typename KEY, size_t N>
+    using StrategyFor = std::integral_constant<Strategy,
+        #ifdef PHYLUM_KEYS_VECTORIZED
+        (std::is_same<KEY, uint64_t>::value && N >= VectorSearchThreshold) ? Strategy::Vectorized :
+        #endif
+        (N >= BinarySearchThreshold ? Strategy::Binary : Strategy::Linear)>;
+
 public:
     // Returns the position where 'key' should be inserted in a leaf node
     // that has the given keys.
-    // NOTE: These and the following methods do a simple linear search, which is
-    // just fine for N or M < 100. Any large and a Binary Search is better.
+    template<typename KEY, size_t N>
+    static unsigned leaf_position_for(const KEY &key, const KEY (&keys)[N], unsigned number_keys) {
+        assert(number_keys <= N);
+        auto k = lower_bound(key, keys, number_keys, StrategyFor<KEY, N>{});
+        assert(k <= number_keys);
+        return k;
+    }
+
+    // Returns the position where 'key' should be inserted in an inner node
+    // that has the given keys.
+    template<typename KEY, size_t N>
+    static inline uint8_t inner_position_for(const KEY &key, const KEY (&keys)[N], unsigned number_keys) {
+        assert(number_keys <= N);
+        return upper_bound(key, keys, number_keys, StrategyFor<KEY, N>{});
+    }
+
+private:
+    // First position whose key is not less than 'key'.
     template<typename KEY>
-    static unsigned leaf_position_for(const KEY &key, const KEY *keys, unsigned number_keys) {
+    static unsigned lower_bound(const KEY &key, const KEY *keys, unsigned number_keys, std::integral_constant<Strategy, Strategy::Linear>) {
         uint8_t k = 0;
         while ((k < number_keys) && (keys[k] < key)) {
             ++k;
         }
-        assert(k <= number_keys);
         return k;
     }
 
-    // Returns the position where 'key' should be inserted in an inner node
-    // that has the given keys.
+    // First position whose key is greater than 'key'.
     template<typename KEY>
-    static inline uint8_t inner_position_for(const KEY &key, const KEY *keys, unsigned number_keys) {
+    static unsigned upper_bound(const KEY &key, const KEY *keys, unsigned number_keys, std::integral_constant<Strategy, Strategy::Linear>) {
         uint8_t k = 0;
         while ((k < number_keys) && ((keys[k] < key) || (keys[k] == key))) {
             ++k;
@@ -30,6 +85,104 @@ public:
         return k;
     }
 
+    // These halve the range every iteration and only ever select the base
+    // pointer, which compilers turn into a conditional move. So there's one
+    // well predicted branch per level rather than one per key.
+    template<typename KEY>
+    static unsigned lower_bound(const KEY &key, const KEY *keys, unsigned number_keys, std::integral_constant<Strategy, Strategy::Binary>) {
+        if (number_keys == 0) {
+            return 0;
+        }
+        auto base = keys;
+        auto n = number_keys;
+        while (n > 1) {
+            auto half = n / 2;
+            base = (base[half] < key) ? base + half : base;
+            n -= half;
+        }
+        return (unsigned)(base - keys) + (*base < key);
+    }
+
+    template<typename KEY>
+    static unsigned upper_bound(const KEY &key, const KEY *keys, unsigned number_keys, std::integral_constant<Strategy, Strategy::Binary>) {
+        if (number_keys == 0) {
+            return 0;
+        }
+        auto base = keys;
+        auto n = number_keys;
+        while (n > 1) {
+            auto half = n / 2;
+            base = (key < base[half]) ? base : base + half;
+            n -= half;
+        }
+        return (unsigned)(base - keys) + !(key < *base);
+    }
+
+    #ifdef PHYLUM_KEYS_VECTORIZED
+    // Keys are sorted, so the position is the number of keys below 'key',
+    // which we count a vector at a time with no branches on the keys.
+    static unsigned lower_bound(const uint64_t &key, const uint64_t *keys, unsigned number_keys, std::integral_constant<Strategy, Strategy::Vectorized>) {
+        return count_below<false>(key, keys, number_keys);
+    }
+
+    static unsigned upper_bound(const uint64_t &key, const uint64_t *keys, unsigned number_keys, std::integral_constant<Strategy, Strategy::Vectorized>) {
+        return count_below<true>(key, keys, number_keys);
+    }
+
+    template<bool Inclusive>
+    static unsigned count_below(uint64_t key, const uint64_t *keys, unsigned number_keys) {
+        auto i = 0u;
+        auto count = 0u;
+
+        #if defined(PHYLUM_KEYS_AVX2)
+        // There are only signed 64bit compares, flipping the sign bit of
+        // both sides gives us the unsigned ordering.
+        auto bias = _mm256_set1_epi64x(INT64_MIN);
+        auto needle = _mm256_xor_si256(_mm256_set1_epi64x((int64_t)key), bias);
+        for (; i + 4 <= number_keys; i += 4) {
+            auto v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+            if (Inclusive) {
+                auto above = _mm256_cmpgt_epi64(v, needle);
+                count += 4 - __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(above)));
+            }
+            else {
+                auto below = _mm256_cmpgt_epi64(needle, v);
+                count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(below)));
+            }
+        }
+        #elif defined(PHYLUM_KEYS_SSE42)
+        auto bias = _mm_set1_epi64x(INT64_MIN);
+        auto needle = _mm_xor_si128(_mm_set1_epi64x((int64_t)key), bias);
+        for (; i + 2 <= number_keys; i += 2) {
+            auto v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bias);
+            if (Inclusive) {
+                auto above = _mm_cmpgt_epi64(v, needle);
+                count += 2 - __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(above)));
+            }
+            else {
+                auto below = _mm_cmpgt_epi64(needle, v);
+                count += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(below)));
+            }
+        }
+        #elif defined(PHYLUM_KEYS_NEON)
+        // Matching lanes are all ones, so subtracting them counts.
+        auto needle = vdupq_n_u64(key);
+        auto counts = vdupq_n_u64(0);
+        for (; i + 2 <= number_keys; i += 2) {
+            auto v = vld1q_u64(keys + i);
+            counts = vsubq_u64(counts, Inclusive ? vcleq_u64(v, needle) : vcltq_u64(v, needle));
+        }
+        count += (unsigned)vaddvq_u64(counts);
+        #endif
+
+        for (; i < number_keys; ++i) {
+            count += Inclusive ? (keys[i] <= key) : (keys[i] < key);
+        }
+
+        return count;
+    }
+    #endif
+
 };
 
 }
@@ -1,6 +1,9 @@
 #ifndef __PHYLUM_LAYOUT_H_INCLUDED
 #define __PHYLUM_LAYOUT_H_INCLUDED
 
+#include <algorithm>
+#include <cstring>
+
 #include "phylum/block_alloc.h"
 #include "phylum/private.h"
 
@@ -13,7 +16,6 @@ private:
     BlockAllocator &allocator_;
     Geometry &g_;
     BlockAddress address_;
-    BlockAddress iterator_;
     BlockType type_;
 
 public:
@@ -71,71 +73,6 @@ public:
         return true;
     }
 
-    template<typename TEntry>
-    bool walk(TEntry &entry) {
-        if (iterator_.valid()) {
-            address_ = iterator_;
-        }
-        else {
-            assert(address_.find_room(g_, sizeof(TEntry)));
-        }
-
-        // Walk leaves the address as the one we just read, so we need room for
-        // two entries, the one we read previously and the following one,
-        // otherwise we can skip to the following block.
-        if (should_move_to_following_block(sizeof(TEntry) * 2)) {
-            auto tl = BlockAddress::tail_data_of(address_.block, g_, sizeof(TTail));
-            TTail tail;
-
-            #ifdef PHYLUM_LAYOUT_DEBUG
-            sdebug() << "layout: ReadTail: " << tl << " " << sizeof(TTail) << endl;
-            #endif
-
-            if (!storage_.read(tl, &tail, sizeof(TTail))) {
-                return false;
-            }
-
-            if (is_valid_block(tail.block.linked_block)) {
-                address_ = { tail.block.linked_block, 0 };
-            }
-            else {
-                return false;
-            }
-        }
-
-        if (address_.is_beginning_of_block()) {
-            if (!verify_head(address_)) {
-                #ifdef PHYLUM_LAYOUT_DEBUG
-                sdebug() << "layout: Invalid Head" << endl;
-                #endif
-                return false;
-            }
-            address_.add(SectorSize);
-        }
-        else {
-        }
-
-        #ifdef PHYLUM_LAYOUT_DEBUG
-        sdebug() << "layout: Read (" << address_ << ")" << endl;
-        #endif
-        if (!storage_.read(address_, &entry, sizeof(TEntry))) {
-            return false;
-        }
-
-        iterator_ = address_;
-
-        assert(iterator_.add_or_move_to_following_sector(g_, sizeof(TEntry)));
-
-        if (!entry.valid()) {
-            #ifdef PHYLUM_LAYOUT_DEBUG
-            sdebug() << "layout: Invalid (" << address_ << ")" << endl;
-            #endif
-            return false;
-        }
-
-        return true;
-    }
-
     BlockAddress find_available(size_t required) {
         THead head(type_);
         head.fill();
@@ -148,7 +85,8 @@ public:
             auto new_block_alloc = allocator_.allocate(type_);
             auto new_block = new_block_alloc.block;
             head.block.linked_block = address_.block;
-            if (!write_head(new_block, head)) {
+            head.block.age = new_block_alloc.age;
+            if (!write_head(new_block, head, new_block_alloc.erased)) {
                 return { };
             }
 
@@ -181,30 +119,7 @@ public:
     }
 
     template<typename TEntry>
-    bool find_append_location(block_index_t block) {
-        auto fn = [](StorageBackend &storage, BlockAddress &address) -> bool {
-            TEntry entry;
-
-            if (!storage.read(address, &entry, sizeof(TEntry))) {
-                return false;
-            }
-
-            if (!entry.valid()) {
-                return false;
-            }
-
-            return true;
-        };
-
-        auto end = walk_to_end(block, sizeof(TEntry), fn);
-        if (!end.available.valid()) {
-            return false;
-        }
-
-        address_ = end.available;
-
-        return true;
-    }
+    bool find_append_location(block_index_t block);
 
     template<typename TEntry>
     bool find_tail_entry(block_index_t block) {
@@ -237,11 +152,13 @@ public:
         return true;
     }
 
-    bool write_head(block_index_t block, THead &head) {
+    bool write_head(block_index_t block, THead &head, bool erased = false) {
         auto address = BlockAddress{ block, 0 };
 
-        if (!storage_.erase(block)) {
-            return false;
+        if (!erased) {
+            if (!storage_.erase(block)) {
+                return false;
+            }
         }
 
         #ifdef PHYLUM_LAYOUT_DEBUG
@@ -254,12 +171,13 @@ public:
         return true;
     }
 
-    bool write_head(block_index_t block, block_index_t linked = BLOCK_INDEX_INVALID) {
+    bool write_head(block_index_t block, block_index_t linked = BLOCK_INDEX_INVALID, block_age_t age = 0) {
         assert(type_ != BlockType::Error);
 
         THead head(type_);
         head.fill();
         head.block.linked_block = linked;
+        head.block.age = age;
 
         return write_head(block, head);
     }
@@ -370,6 +288,191 @@ private:
 
 };
 
+template<typename THead, typename TTail, typename TEntry, size_t BufferSize = SectorSize>
+class LayoutIterator {
+    static_assert(sizeof(TEntry) <= BufferSize, "Entries must fit in the buffer.");
+    static_assert(sizeof(TTail) <= BufferSize, "Tails must fit in the buffer.");
+
+private:
+    StorageBackend *storage_;
+    Geometry *g_;
+    BlockAddress address_;
+    BlockAddress following_;
+    BlockAddress buffered_;
+    uint32_t size_{ 0 };
+    uint8_t buffer_[BufferSize];
+
+public:
+    /**
+     * Where the entry returned last is. Once the walk is over this is where
+     * the following entry would be appended, or invalid if the chain
+     * couldn't be read.
+     */
+    BlockAddress address() {
+        return address_;
+    }
+
+public:
+    LayoutIterator(StorageBackend &storage, BlockAddress address)
+        : storage_(&storage), g_(&storage.geometry()), following_(address) {
+    }
+
+public:
+    /**
+     * Entries are found the same way BlockLayout::append places them, so
+     * this follows the chain of blocks until an invalid entry.
+     */
+    bool next(TEntry &entry) {
+        while (true) {
+            if (following_.is_beginning_of_block()) {
+                THead head(BlockType::Error);
+                if (!read(following_, &head, sizeof(THead)) || !head.valid()) {
+                    address_.invalid();
+                    return false;
+                }
+                following_.add(SectorSize);
+            }
+
+            if (following_.remaining_in_block(*g_) >= sizeof(TEntry) + sizeof(TTail)) {
+                break;
+            }
+
+            TTail tail;
+            auto tl = BlockAddress::tail_data_of(following_.block, *g_, sizeof(TTail));
+            if (!read(tl, &tail, sizeof(TTail))) {
+                address_.invalid();
+                return false;
+            }
+
+            if (!is_valid_block(tail.block.linked_block)) {
+                address_ = following_;
+                return false;
+            }
+
+            following_ = { tail.block.linked_block, 0 };
+        }
+
+        assert(following_.find_room(*g_, sizeof(TEntry)));
+
+        address_ = following_;
+
+        if (!read(address_, &entry, sizeof(TEntry))) {
+            address_.invalid();
+            return false;
+        }
+
+        if (!entry.valid()) {
+            return false;
+        }
+
+        following_.add(sizeof(TEntry));
+
+        return true;
+    }
+
+private:
+    // Entries never straddle sectors, so we read as much of the sector as
+    // the buffer holds and decode from that until we're past it.
+    bool read(BlockAddress address, void *ptr, size_t n) {
+        auto buffered = address.block == buffered_.block &&
+            address.position >= buffered_.position &&
+            address.position + n <= buffered_.position + size_;
+        if (!buffered) {
+            auto size = std::min((uint32_t)BufferSize, address.remaining_in_sector(*g_));
+            if (size < n) {
+                return storage_->read(address, ptr, n);
+            }
+
+            #ifdef PHYLUM_LAYOUT_DEBUG
+            sdebug() << "layout: Buffer: " << address << " " << size << endl;
+            #endif
+            if (!storage_->read(address, buffer_, size)) {
+                size_ = 0;
+                return false;
+            }
+
+            buffered_ = address;
+            size_ = size;
+        }
+
+        memcpy(ptr, buffer_ + (address.position - buffered_.position), n);
+
+        return true;
+    }
+
+};
+
+template<typename THead, typename TTail>
+template<typename TEntry>
+bool BlockLayout<THead, TTail>::find_append_location(block_index_t block) {
+    // Tails are only written once a block is full, so we can follow them to
+    // the last block of the chain without reading any entries.
+    for (auto i = (block_index_t)0; ; ++i) {
+        if (!is_valid_block(block) || i == g_.number_of_blocks) {
+            return false;
+        }
+
+        THead head(BlockType::Error);
+        if (!storage_.read(BlockAddress{ block, 0 }, &head, sizeof(THead))) {
+            return false;
+        }
+
+        if (!head.valid() || head.block.type != type_) {
+            return false;
+        }
+
+        TTail tail;
+        if (!storage_.read(BlockAddress::tail_data_of(block, g_, sizeof(TTail)), &tail, sizeof(TTail))) {
+            return false;
+        }
+
+        if (!is_valid_block(tail.block.linked_block)) {
+            break;
+        }
+
+        block = tail.block.linked_block;
+    }
+
+    // Entries never straddle sectors, so the first one in each sector is at
+    // its beginning, except in those shared with the head. Bisect for the
+    // last sector that has any and then look through that one.
+    auto first = (uint32_t)(SectorSize / g_.sector_size);
+    auto beginning = [&](uint32_t sector) -> BlockAddress {
+        return { block, std::max((uint32_t)SectorSize, sector * g_.sector_size) };
+    };
+
+    auto low = first;
+    auto high = (uint32_t)g_.sectors_per_block();
+    while (low < high) {
+        auto middle = low + (high - low) / 2;
+        TEntry entry;
+        if (!storage_.read(beginning(middle), &entry, sizeof(TEntry))) {
+            return false;
+        }
+
+        if (entry.valid()) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    LayoutIterator<THead, TTail, TEntry> iterator{ storage_, beginning(low > first ? low - 1 : first) };
+    TEntry entry;
+
+    while (iterator.next(entry)) {
+    }
+
+    if (!iterator.address().valid()) {
+        return false;
+    }
+
+    address_ = iterator.address();
+
+    return true;
+}
+
 }
 
 #endif
@@ -0,0 +1,115 @@
+#ifndef __PHYLUM_MEMTABLE_H_INCLUDED
+#define __PHYLUM_MEMTABLE_H_INCLUDED
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+
+#include "phylum/keys.h"
+
+namespace phylum {
+
+/**
+ * A small sorted buffer of pairs that sits in front of a persisted tree,
+ * absorbing adds so they can be written to the tree together, in order.
+ * Lookups should consult this and the tree, this having the newer values.
+ */
+template<typename KEY, typename VALUE, size_t SIZE>
+class MemTable {
+private:
+    KEY keys_[SIZE];
+    VALUE values_[SIZE];
+    size_t size_{ 0 };
+
+public:
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    bool full() const {
+        return size_ == SIZE;
+    }
+
+    const KEY *keys() const {
+        return keys_;
+    }
+
+    const VALUE *values() const {
+        return values_;
+    }
+
+public:
+    // Adds or replaces the pair, returning false if there's no room.
+    bool add(KEY key, VALUE value) {
+        auto index = Keys::leaf_position_for(key, keys_, size_);
+        if (index < size_ && keys_[index] == key) {
+            values_[index] = value;
+            return true;
+        }
+
+        if (full()) {
+            return false;
+        }
+
+        for (auto i = size_; i > index; --i) {
+            keys_[i] = keys_[i - 1];
+            values_[i] = values_[i - 1];
+        }
+        keys_[index] = key;
+        values_[index] = value;
+        size_++;
+
+        return true;
+    }
+
+    bool find(KEY key, VALUE *value) const {
+        auto index = Keys::leaf_position_for(key, keys_, size_);
+        if (index < size_ && keys_[index] == key) {
+            *value = values_[index];
+            return true;
+        }
+        return false;
+    }
+
+    // Finds the last pair with a key less than the given one.
+    bool find_less_then(KEY key, VALUE *value, KEY *found) const {
+        auto index = Keys::leaf_position_for(key, keys_, size_);
+        if (index == 0) {
+            return false;
+        }
+        *value = values_[index - 1];
+        *found = keys_[index - 1];
+        return true;
+    }
+
+    // Removes the pairs with keys in [first, last], returning how many.
+    size_t remove(KEY first, KEY last) {
+        auto begin = Keys::leaf_position_for(first, keys_, size_);
+        auto end = begin;
+        while (end < size_ && !(last < keys_[end])) {
+            end++;
+        }
+
+        auto removing = end - begin;
+        for (auto i = end; i < size_; ++i) {
+            keys_[i - removing] = keys_[i];
+            values_[i - removing] = values_[i];
+        }
+        size_ -= removing;
+
+        return removing;
+    }
+
+    void clear() {
+        size_ = 0;
+    }
+
+};
+
+}
+
+#endif
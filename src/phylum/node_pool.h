@@ -0,0 +1,136 @@
+#ifndef __PHYLUM_NODE_POOL_H_INCLUDED
+#define __PHYLUM_NODE_POOL_H_INCLUDED
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
+namespace phylum {
+
+/**
+ * Hands out nodes from slabs of SlabSize nodes at a time. Freed nodes are
+ * kept on a free list and reused before another slab is allocated, so a
+ * tree that grows and shrinks settles on a fixed amount of memory. Slabs are
+ * only returned when the pool is cleared or destroyed, all at once and
+ * without running destructors.
+ */
+template<typename T, size_t Alignment = alignof(T), size_t SlabSize = 32>
+class NodePool {
+    static_assert(std::is_trivially_destructible<T>::value, "Pooled nodes are released without being destroyed.");
+    static_assert((Alignment & (Alignment - 1)) == 0, "Alignment should be a power of two.");
+    static_assert(Alignment >= alignof(T), "Alignment is less than the node requires.");
+
+public:
+    // Every node gets a slot rounded up to the alignment, so with cache line
+    // alignment the start of a node, its header and first keys, never
+    // straddles two lines.
+    static constexpr size_t SlotSize = ((sizeof(T) > sizeof(void *) ? sizeof(T) : sizeof(void *)) + Alignment - 1) / Alignment * Alignment;
+
+private:
+    struct Slab {
+        Slab *next;
+    };
+
+    struct FreeSlot {
+        FreeSlot *next;
+    };
+
+    Slab *slabs_{ nullptr };
+    FreeSlot *free_{ nullptr };
+    size_t capacity_{ 0 };
+    size_t size_{ 0 };
+
+public:
+    NodePool() {
+    }
+
+    NodePool(const NodePool &other) = delete;
+
+    NodePool &operator=(const NodePool &other) = delete;
+
+    ~NodePool() {
+        clear();
+    }
+
+public:
+    // Number of nodes handed out and not yet released.
+    size_t size() const {
+        return size_;
+    }
+
+    // Number of nodes the pool can hand out without allocating.
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    bool reserve(size_t nodes) {
+        while (capacity_ < nodes) {
+            if (!grow()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    T *allocate() {
+        if (free_ == nullptr && !grow()) {
+            return nullptr;
+        }
+
+        auto slot = free_;
+        free_ = slot->next;
+        size_++;
+
+        return new (slot) T();
+    }
+
+    void release(T *node) {
+        auto slot = reinterpret_cast<FreeSlot *>(node);
+        slot->next = free_;
+        free_ = slot;
+        size_--;
+    }
+
+    // Returns every slab, invalidating all of the nodes handed out.
+    void clear() {
+        while (slabs_ != nullptr) {
+            auto next = slabs_->next;
+            free(slabs_);
+            slabs_ = next;
+        }
+        free_ = nullptr;
+        capacity_ = 0;
+        size_ = 0;
+    }
+
+private:
+    bool grow() {
+        auto memory = reinterpret_cast<uint8_t *>(malloc(sizeof(Slab) + Alignment - 1 + SlotSize * SlabSize));
+        if (memory == nullptr) {
+            return false;
+        }
+
+        auto slab = reinterpret_cast<Slab *>(memory);
+        slab->next = slabs_;
+        slabs_ = slab;
+
+        auto first = (reinterpret_cast<uintptr_t>(memory) + sizeof(Slab) + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
+
+        // Push in reverse so nodes are handed out in address order.
+        for (auto i = SlabSize; i > 0; --i) {
+            auto slot = reinterpret_cast<FreeSlot *>(first + (i - 1) * SlotSize);
+            slot->next = free_;
+            free_ = slot;
+        }
+
+        capacity_ += SlabSize;
+
+        return true;
+    }
+
+};
+
+}
+
+#endif
@@ -1,8 +1,52 @@
 #ifndef __PHYLUM_NODES_SERIALIZER_H_INCLUDED
 #define __PHYLUM_NODES_SERIALIZER_H_INCLUDED
 
+#include <type_traits>
+
+#include "phylum/crc.h"
+#include "phylum/persisted_tree.h"
+
 namespace phylum {
 
+/**
+ * Sizes of the pieces of a serialized node, see NodeSerializer.
+ */
+struct NodeRecordLayout {
+    static constexpr size_t HeaderSize = 5;
+    static constexpr size_t CrcSize = sizeof(uint32_t);
+    static constexpr size_t MaximumVarintSize = 10;
+    static constexpr size_t TimestampSize = MaximumVarintSize;
+
+    // Largest record for a node with room for the given number of keys,
+    // including the timestamp written with head nodes. Every key, value and
+    // child is at most one varint, children are two.
+    static constexpr size_t maximum_size(size_t inner, size_t leaf) {
+        return HeaderSize + TimestampSize + inner * MaximumVarintSize +
+            (leaf > inner + 1 ? leaf : inner + 1) * MaximumVarintSize + CrcSize;
+    }
+
+    // Largest number of keys a node can hold and still always fit in the
+    // given number of bytes.
+    static constexpr size_t fanout(size_t available) {
+        return (available - HeaderSize - TimestampSize - CrcSize - MaximumVarintSize) / (2 * MaximumVarintSize);
+    }
+
+    // Records are written alongside the block tail in the final sector, so
+    // this is how much room the largest one can take.
+    static constexpr size_t MaximumRecordSize = SectorSize - sizeof(BlockTail);
+};
+
+/**
+ * Nodes are stored as variable length records:
+ *
+ *   kind (1) depth (1) number_keys (1) size (2) [timestamp] keys... values/children... crc32 (4)
+ *
+ * Keys and values are stored as zigzag encoded varint deltas from the one
+ * before, which in our trees are usually small as neighbouring keys share
+ * the file id in their upper bits. Children are stored as a block delta and
+ * the position in that block. Records never span sectors and the kind byte is
+ * never 0x00 or 0xff, so erased space is never mistaken for a record.
+ */
 template<typename NODE>
 class NodeSerializer {
 public:
@@ -11,150 +55,251 @@ public:
     using VALUE = typename NODE::ValueType;
     using ADDRESS = typename NODE::AddressType;
 
-public:
-    struct serialized_inner_node_t {
-        DepthType level;
-        uint16_t size;
-        IndexType number_keys;
-        KEY keys[NODE::InnerSize];
-        ADDRESS children[NODE::InnerSize + 1];
-    };
+private:
+    static constexpr uint8_t NodeKind = 0x4e;
+    static constexpr uint8_t HeadKind = 0x48;
+    static constexpr size_t HeaderSize = NodeRecordLayout::HeaderSize;
+    static constexpr size_t CrcSize = NodeRecordLayout::CrcSize;
 
-    struct serialized_leaf_node_t {
-        DepthType level;
-        uint16_t size;
-        IndexType number_keys;
-        KEY keys[NODE::LeafSize];
-        VALUE values[NODE::LeafSize];
-    };
+public:
+    // The largest a record can be. Most are a fraction of this.
+    static constexpr size_t HeadNodeSize = NodeRecordLayout::maximum_size(NODE::InnerSize, NODE::LeafSize);
 
-    union serialized_node_t {
-        DepthType level;
-        serialized_inner_node_t inner;
-        serialized_leaf_node_t leaf;
+    static_assert(HeadNodeSize <= NodeRecordLayout::MaximumRecordSize, "Nodes must fit in a sector.");
 
-        serialized_node_t() {
+public:
+    bool deserialize(const void *ptr, size_t available, NodeType *node, TreeHead *head) {
+        auto size = record_size(ptr, available);
+        if (size == 0) {
+            return false;
         }
 
-        bool valid() {
-            if (level == 0xff) {
+        auto p = reinterpret_cast<const uint8_t*>(ptr);
+        auto end = p + size - CrcSize;
+        auto kind = p[0];
+
+        node->depth = p[1];
+        node->number_keys = p[2];
+        p += HeaderSize;
+
+        uint64_t value;
+
+        if (kind == HeadKind) {
+            if ((p = read_varint(p, end, value)) == nullptr) {
                 return false;
             }
-            if (level == 0) {
-                return leaf.size > 0;
+            if (head != nullptr) {
+                head->timestamp = (timestamp_t)value;
             }
-            else {
-                return inner.size > 0;
+        }
+
+        uint64_t previous = 0;
+        for (auto i = 0; i < node->number_keys; ++i) {
+            if ((p = read_varint(p, end, value)) == nullptr) {
+                return false;
             }
+            previous += unzigzag(value);
+            node->keys[i] = (KEY)previous;
         }
-    };
 
-    struct serialized_head_t {
-        serialized_node_t node;
-        timestamp_t timestamp;
-        BlockMagic magic;
-    };
+        if (node->depth == 0) {
+            previous = 0;
+            for (auto i = 0; i < node->number_keys; ++i) {
+                if ((p = read_varint(p, end, value)) == nullptr) {
+                    return false;
+                }
+                previous += unzigzag(value);
+                node->d.values[i] = (VALUE)previous;
+            }
+        }
+        else {
+            for (auto &child : node->d.children) {
+                child.clear();
+            }
 
-public:
-    static constexpr size_t HeadNodeSize = sizeof(serialized_head_t);
+            uint64_t block = 0;
+            for (auto i = 0; i <= node->number_keys; ++i) {
+                uint64_t position;
+                if ((p = read_varint(p, end, value)) == nullptr) {
+                    return false;
+                }
+                if ((p = read_varint(p, end, position)) == nullptr) {
+                    return false;
+                }
+                block += unzigzag(value);
+                node->d.children[i].address(ADDRESS{ (block_index_t)block, (uint32_t)position });
+            }
 
-public:
-    bool deserialize(const void *ptr, NodeType *node, TreeHead *head) {
-        if (head) {
-            return deserialize(reinterpret_cast<const serialized_head_t*>(ptr), node);
+            assert(!node->empty());
         }
-        return deserialize(reinterpret_cast<const serialized_node_t*>(ptr), node);
+
+        return p == end;
     }
 
     bool serialize(void *ptr, const NodeType *node, const TreeHead *head) {
-        if (head) {
-            return serialize(node, reinterpret_cast<serialized_head_t*>(ptr));
-        }
-        return serialize(node, reinterpret_cast<serialized_node_t*>(ptr));
+        encode(reinterpret_cast<uint8_t*>(ptr), node, head);
+        return true;
     }
 
+    // Returns the size of the record for the given node.
+    size_t size(const NodeType *node, const TreeHead *head) {
+        return encode(nullptr, node, head);
+    }
+
+    // Returns the largest size a record can be.
     size_t size(bool head) {
-        // Pretend all nodes are the same size, in this case the size of the
-        // head node. This makes some things easier and with how big things are
-        // now it doesn't really make a difference. 128 vs 112 doesn't give us
-        // any extra room unless we split nodes across sectors.
-        return sizeof(serialized_head_t);
+        return HeadNodeSize;
     }
 
-private:
-    bool serialize(const NodeType *node, serialized_head_t *s) {
-        s->magic.fill();
+    // Returns the size of the valid record at ptr, or 0 if there isn't one.
+    size_t record_size(const void *ptr, size_t available) {
+        auto p = reinterpret_cast<const uint8_t*>(ptr);
 
-        return serialize(node, &s->node);
-    }
+        if (available < HeaderSize + CrcSize) {
+            return 0;
+        }
 
-    bool deserialize(const serialized_head_t *s, NodeType *node) {
-        if (!deserialize(&s->node, node)) {
-            return false;
+        if (p[0] != NodeKind && p[0] != HeadKind) {
+            return 0;
+        }
+
+        auto size = (size_t)(p[3] | (p[4] << 8));
+        if (size < HeaderSize + CrcSize || size > available) {
+            return 0;
         }
 
-        // Ideally this would be enough. We mix head and other index nodes
-        // though. If head ever grows beyond 128 bytes we'll just keep them in
-        // their own blocks or come up with a better scheme of packing them. For
-        // now we can rely on this test below to find valid deserialized
-        // entries. It's low risk, we do erase blocks to either 0x00 or 0xff
-        if (s->magic.valid()) {
-            return true;
+        uint32_t expected;
+        memcpy(&expected, p + size - CrcSize, CrcSize);
+        if (crc32_checksum(const_cast<uint8_t*>(p), size - CrcSize) != expected) {
+            return 0;
         }
-        return s->node.leaf.size == sizeof(serialized_node_t) || s->node.inner.size == sizeof(serialized_node_t);
+
+        return size;
+    }
+
+    bool is_head(const void *ptr) {
+        return reinterpret_cast<const uint8_t*>(ptr)[0] == HeadKind;
     }
 
-    bool serialize(const NodeType *node, serialized_node_t *s) {
+private:
+    struct Writer {
+        uint8_t *ptr;
+        size_t position;
+
+        void byte(uint8_t value) {
+            if (ptr != nullptr) {
+                ptr[position] = value;
+            }
+            position++;
+        }
+
+        void varint(uint64_t value) {
+            while (value >= 0x80) {
+                byte((uint8_t)(value | 0x80));
+                value >>= 7;
+            }
+            byte((uint8_t)value);
+        }
+    };
+
+    size_t encode(uint8_t *ptr, const NodeType *node, const TreeHead *head) {
+        Writer w{ ptr, 0 };
+
+        w.byte(head != nullptr ? HeadKind : NodeKind);
+        w.byte(node->depth);
+        w.byte(node->number_keys);
+        w.byte(0);
+        w.byte(0);
+
+        if (head != nullptr) {
+            w.varint(head->timestamp);
+        }
+
+        uint64_t previous = 0;
+        for (auto i = 0; i < node->number_keys; ++i) {
+            auto bits = to_bits(node->keys[i]);
+            w.varint(zigzag(bits - previous));
+            previous = bits;
+        }
+
         if (node->depth == 0) {
-            s->leaf.level = node->depth;
-            s->leaf.size = sizeof(serialized_node_t);
-            s->leaf.number_keys = node->number_keys;
-            memcpy(&s->leaf.keys, &node->keys, sizeof(node->keys));
-            memcpy(&s->leaf.values, &node->d.values, sizeof(node->d.values));
+            previous = 0;
+            for (auto i = 0; i < node->number_keys; ++i) {
+                auto bits = to_bits(node->d.values[i]);
+                w.varint(zigzag(bits - previous));
+                previous = bits;
+            }
         }
         else {
             assert(!node->empty());
-            s->inner.level = node->depth;
-            s->inner.size = sizeof(serialized_node_t);
-            s->inner.number_keys = node->number_keys;
-            memcpy(&s->inner.keys, &node->keys, sizeof(node->keys));
-            for (auto i = (IndexType)0; i < NODE::InnerSize + 1; ++i) {
-                if (i <= node->number_keys) {
-                    assert(node->d.children[i].address().valid());
-                }
-                s->inner.children[i] = node->d.children[i].address();
+
+            uint64_t block = 0;
+            for (auto i = 0; i <= node->number_keys; ++i) {
+                auto address = node->d.children[i].address();
+                assert(address.valid());
+                w.varint(zigzag((uint64_t)address.block - block));
+                w.varint(address.position);
+                block = address.block;
             }
         }
-        return true;
-    }
 
-    bool deserialize(const serialized_node_t *s, NodeType *node) {
-        assert(sizeof(node->keys) == sizeof(s->leaf.keys));
-        assert(sizeof(node->d.values) == sizeof(s->leaf.values));
+        auto size = w.position + CrcSize;
+        assert(size <= HeadNodeSize);
 
-        if (s->level == 0) {
-            node->depth = s->leaf.level;
-            node->number_keys = s->leaf.number_keys;
-            memcpy(&node->keys, &s->leaf.keys, sizeof(node->keys));
-            memcpy(&node->d.values, &s->leaf.values, sizeof(node->d.values));
+        if (ptr != nullptr) {
+            ptr[3] = (uint8_t)(size & 0xff);
+            ptr[4] = (uint8_t)((size >> 8) & 0xff);
+            auto crc = crc32_checksum(ptr, w.position);
+            memcpy(ptr + w.position, &crc, CrcSize);
         }
-        else {
-            node->depth = s->inner.level;
-            node->number_keys = s->inner.number_keys;
-            memcpy(&node->keys, &s->inner.keys, sizeof(node->keys));
-            for (auto i = (IndexType)0; i < NODE::InnerSize + 1; ++i) {
-                node->d.children[i].clear();
-                if (s->inner.children[i].valid()) {
-                    node->d.children[i].address(s->inner.children[i]);
-                }
+
+        return size;
+    }
+
+    template<typename T>
+    static uint64_t to_bits(T value) {
+        using Wide = typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type;
+        return (uint64_t)(Wide)value;
+    }
+
+    static uint64_t zigzag(uint64_t value) {
+        return (value << 1) ^ (uint64_t)((int64_t)value >> 63);
+    }
+
+    static uint64_t unzigzag(uint64_t value) {
+        return (value >> 1) ^ (~(value & 1) + 1);
+    }
+
+    static const uint8_t *read_varint(const uint8_t *p, const uint8_t *end, uint64_t &value) {
+        value = 0;
+        for (auto shift = 0; shift < 64; shift += 7) {
+            if (p == end) {
+                return nullptr;
+            }
+            auto b = *p++;
+            value |= (uint64_t)(b & 0x7f) << shift;
+            if ((b & 0x80) == 0) {
+                return p;
             }
-            assert(!node->empty());
         }
-        return true;
+        return nullptr;
     }
 
 };
 
+/**
+ * The widest node whose record is always guaranteed to fit in a sector. Wider
+ * nodes mean shallower trees and so fewer reads per lookup.
+ */
+template<typename KEY, typename VALUE, typename ADDRESS>
+struct SectorSizedNode {
+    static constexpr size_t Fanout = NodeRecordLayout::fanout(NodeRecordLayout::MaximumRecordSize);
+
+    using NodeType = Node<KEY, VALUE, ADDRESS, Fanout, Fanout>;
+
+    static_assert(NodeRecordLayout::maximum_size(Fanout, Fanout) <= NodeRecordLayout::MaximumRecordSize, "Fanout too large.");
+};
+
 }
 
 #endif
@@ -1,6 +1,8 @@
 #ifndef __PHYLUM_PERSISTED_TREE_H_INCLUDED
 #define __PHYLUM_PERSISTED_TREE_H_INCLUDED
 
+#include <limits>
+
 #include "phylum/private.h"
 #include "phylum/keys.h"
 
@@ -188,6 +190,10 @@ public:
     using NodeCacheType = NodeCache<NodeType>;
     using NodeRefType = NodeRef<ADDRESS>;
 
+    // Deepest tree an Iterator can walk. Even with the smallest fanouts this is
+    // far more keys than we'll ever keep.
+    static constexpr DepthType MaximumDepth = 8;
+
 private:
     NodeCacheType *nodes_;
     NodeRefType ref_;
@@ -196,6 +202,223 @@ public:
     PersistedTree(NodeCacheType &nodes, ADDRESS address = ADDRESS()) : nodes_(&nodes), ref_(address) {
     }
 
+public:
+    /**
+     * Walks the pairs with keys in [first, last], forwards or in reverse. Only
+     * the nodes along the path to the current leaf are kept in the node cache,
+     * so this is safe to use with MemoryConstrainedNodeCache. The cache is
+     * cleared when the iterator is closed or destroyed, so the tree shouldn't
+     * be modified while one is open.
+     */
+    class Iterator {
+    private:
+        PersistedTree *tree_;
+        KEY first_;
+        KEY last_;
+        bool reverse_;
+        DepthType height_{ 0 };
+        NodeRefType path_[MaximumDepth + 1];
+        IndexType positions_[MaximumDepth + 1];
+
+    public:
+        Iterator(PersistedTree &tree, KEY first, KEY last, bool reverse = false) :
+            tree_(&tree), first_(first), last_(last), reverse_(reverse) {
+            seek(reverse ? last : first);
+        }
+
+        Iterator(const Iterator &other) = delete;
+
+        Iterator &operator=(const Iterator &other) = delete;
+
+        ~Iterator() {
+            close();
+        }
+
+    public:
+        bool valid() const {
+            return height_ > 0;
+        }
+
+        KEY key() const {
+            assert(valid());
+            return top()->keys[positions_[height_ - 1]];
+        }
+
+        VALUE value() const {
+            assert(valid());
+            return top()->d.values[positions_[height_ - 1]];
+        }
+
+        /**
+         * Moves to the key nearest to `key` in the direction of iteration,
+         * forgetting the current path.
+         */
+        bool seek(KEY key) {
+            close();
+
+            if (!tree_->ref_.valid()) {
+                return false;
+            }
+
+            if (reverse_) {
+                if (key < first_) {
+                    return false;
+                }
+                if (key > last_) {
+                    key = last_;
+                }
+            }
+            else {
+                if (key > last_) {
+                    return false;
+                }
+                if (key < first_) {
+                    key = first_;
+                }
+            }
+
+            push(tree_->nodes_->load(tree_->ref_, true));
+
+            auto node = top();
+            while (node->depth > 0) {
+                auto index = Keys::inner_position_for(key, node->keys, node->number_keys);
+                positions_[height_ - 1] = index;
+                push(tree_->load_child(node, index));
+                node = top();
+            }
+
+            if (reverse_) {
+                auto index = Keys::inner_position_for(key, node->keys, node->number_keys);
+                if (index == 0) {
+                    positions_[height_ - 1] = 0;
+                    return settle(retreat());
+                }
+                positions_[height_ - 1] = index - 1;
+            }
+            else {
+                positions_[height_ - 1] = Keys::leaf_position_for(key, node->keys, node->number_keys);
+                if (positions_[height_ - 1] == node->number_keys) {
+                    return settle(advance());
+                }
+            }
+
+            return settle(true);
+        }
+
+        bool next() {
+            if (!valid()) {
+                return false;
+            }
+            return settle(reverse_ ? retreat() : advance());
+        }
+
+        void close() {
+            if (height_ > 0) {
+                tree_->nodes_->clear();
+                height_ = 0;
+            }
+        }
+
+    private:
+        NodeType *top() const {
+            return tree_->nodes_->resolve(path_[height_ - 1]);
+        }
+
+        void push(NodeRefType nref) {
+            assert(height_ <= MaximumDepth);
+            path_[height_] = nref;
+            positions_[height_] = 0;
+            height_++;
+        }
+
+        void pop() {
+            tree_->nodes_->unload(path_[--height_]);
+        }
+
+        // Skips deleted values and stops once we're outside of the range.
+        bool settle(bool moved) {
+            while (moved) {
+                auto k = key();
+                if (reverse_ ? k < first_ : k > last_) {
+                    break;
+                }
+                if (value()) {
+                    return true;
+                }
+                moved = reverse_ ? retreat() : advance();
+            }
+            close();
+            return false;
+        }
+
+        bool advance() {
+            auto i = height_ - 1;
+            if (++positions_[i] < top()->number_keys) {
+                return true;
+            }
+
+            while (true) {
+                pop();
+                if (height_ == 0) {
+                    return false;
+                }
+
+                i = height_ - 1;
+                auto node = top();
+                if (++positions_[i] > node->number_keys) {
+                    continue;
+                }
+
+                push(tree_->load_child(node, positions_[i]));
+                node = top();
+                while (node->depth > 0) {
+                    push(tree_->load_child(node, 0));
+                    node = top();
+                }
+
+                if (node->number_keys > 0) {
+                    return true;
+                }
+            }
+        }
+
+        bool retreat() {
+            auto i = height_ - 1;
+            if (positions_[i] > 0) {
+                positions_[i]--;
+                return true;
+            }
+
+            while (true) {
+                pop();
+                if (height_ == 0) {
+                    return false;
+                }
+
+                i = height_ - 1;
+                auto node = top();
+                if (positions_[i] == 0) {
+                    continue;
+                }
+
+                positions_[i]--;
+                push(tree_->load_child(node, positions_[i]));
+                node = top();
+                while (node->depth > 0) {
+                    positions_[height_ - 1] = node->number_keys;
+                    push(tree_->load_child(node, node->number_keys));
+                    node = top();
+                }
+
+                if (node->number_keys > 0) {
+                    positions_[height_ - 1] = node->number_keys - 1;
+                    return true;
+                }
+            }
+        }
+
+    };
+
 public:
     void head(ADDRESS address) {
         ref_ = { address };
@@ -230,65 +453,30 @@ public:
     }
 
     // Finds the LAST item that is < key. That is, the next item in the tree is not < key, but this
-    // item is. If we were to insert key into the tree, it would go after this item. This is weird,
-    // but is easier than implementing iterators. In STL terms, this would be "lower_bound(key)--"
-    // WARNING: This does *not* work when values are deleted. Thankfully, TPC-C does not use deletes.
+    // item is. If we were to insert key into the tree, it would go after this item. In STL terms,
+    // this would be "lower_bound(key)--"
     bool find_less_then(const KEY &key, VALUE *value = 0, KEY *found = 0) {
         create_if_necessary();
 
         assert(ref_.valid());
 
-        auto nref = nodes_->load(ref_, true);
-        auto node = nodes_->resolve(nref);
-        auto d = node->depth;
-
-        while (d-- != 0) {
-            auto index = Keys::inner_position_for(key, node->keys, node->number_keys);
-            // We need to rewind in the case where they are equal
-            if (index > 0 && key == node->keys[index - 1]) {
-                index -= 1;
-            }
-            assert(index == 0 || node->keys[index - 1] < key);
+        Iterator iter{ *this, std::numeric_limits<KEY>::lowest(), key, true };
+        if (iter.valid() && iter.key() == key) {
+            iter.next();
+        }
 
-            nref = load_child(node, index);
-            node = nodes_->resolve(nref);
+        if (!iter.valid()) {
+            return false;
         }
 
-        auto index = Keys::leaf_position_for(key, node->keys, node->number_keys);
-        if (index <= node->number_keys) {
-            index -= 1;
-            if (index < node->number_keys && key == node->keys[index]) {
-                index -= 1;
-            }
-
-            if (index < node->number_keys) {
-                assert(node->keys[index] < key);
-                if (node->d.values[index]) {
-                    if (value != nullptr) {
-                        *value = node->d.values[index];
-                    }
-                    if (found != nullptr) {
-                        *found = node->keys[index];
-                    }
-                    nodes_->clear();
-                    return true;
-                }
-                else {
-                    assert(false);
-                    /*
-                    // This is a deleted key! Try again with the new key value
-                    // HACK: This is because this implementation doesn't do deletes correctly. However,
-                    // this makes it work. We need this for TPC-C undo. The solution is to use a
-                    // more complete b-tree implementation.
-                    nodes_->clear();
-                    return find_last_less_then(node->keys[index], value, found);
-                    */
-                }
-            }
+        if (value != nullptr) {
+            *value = iter.value();
+        }
+        if (found != nullptr) {
+            *found = iter.key();
         }
 
-        nodes_->clear();
-        return false;
+        return true;
     }
 
     ADDRESS add(KEY key, VALUE value) {
@@ -325,33 +513,169 @@ public:
         return address();
     }
 
+    /**
+     * Adds pairs that are sorted by key. Following keys that belong in the
+     * same leaf are added to it while it has room, so a run of neighbouring
+     * keys costs a single write of the path to that leaf instead of one per
+     * key. Leaves and nodes that are full are split by adding the key alone.
+     */
+    ADDRESS add(const KEY *keys, const VALUE *values, size_t number) {
+        auto added = (size_t)0;
+        while (added < number) {
+            create_if_necessary();
+
+            auto nref = nodes_->load(ref_, true);
+            auto node = nodes_->resolve(nref);
+            auto room = true;
+            auto bounded = false;
+            KEY upper{ };
+
+            // Separators get tighter the deeper we go, so the last one to the
+            // right of the path is the first key of the following leaf.
+            while (node->depth > 0) {
+                room = room && node->number_keys < N;
+                auto index = Keys::inner_position_for(keys[added], node->keys, node->number_keys);
+                if (index < node->number_keys) {
+                    upper = node->keys[index];
+                    bounded = true;
+                }
+                nref = load_child(node, index);
+                node = nodes_->resolve(nref);
+            }
+
+            if (!room || node->number_keys == M) {
+                nodes_->clear();
+                add(keys[added], values[added]);
+                added++;
+                continue;
+            }
+
+            while (added < number && node->number_keys < M && (!bounded || keys[added] < upper)) {
+                auto index = Keys::leaf_position_for(keys[added], node->keys, node->number_keys);
+                leaf_insert_nonfull(nref, index, keys[added], values[added]);
+                added++;
+            }
+
+            ref_ = nodes_->flush();
+        }
+
+        return address();
+    }
+
     ADDRESS address() {
         return ref_.address();
     }
 
+    /**
+     * Removes the key from the tree, refilling or merging any nodes that are
+     * left less than half full. Only the path to the key and the siblings
+     * being rebalanced at one level are ever in the cache at once.
+     */
     bool remove(const KEY key) {
+        if (!ref_.valid()) {
+            return false;
+        }
+
         auto nref = nodes_->load(ref_, true);
         auto node = nodes_->resolve(nref);
 
-        auto d = node->depth;
-        while (d-- != 0) {
-            auto index = Keys::inner_position_for(key, node->keys, node->number_keys);
-            assert(index < node->number_keys + 1);
-
-            nref = load_child(node, index);
-            node = nodes_->resolve(nref);
-        }
-
-        auto index = Keys::leaf_position_for(key, node->keys, node->number_keys);
-        if (node->keys[index] == key) {
-            node->d.values[index] = 0;
-            ref_ = nodes_->flush();
-            return true;
+        auto removed = false;
+        if (node->depth == 0) {
+            removed = leaf_remove(nref, key);
         }
         else {
+            removed = inner_remove(nref, key);
+        }
+
+        if (!removed) {
             nodes_->clear();
             return false;
         }
+
+        if (node->depth > 0 && node->number_keys == 0) {
+            // The root is left with one child, which becomes the new root. It's
+            // already been written though, so we load it again to write it
+            // as the head.
+            auto child = node->d.children[0].address();
+            nodes_->clear();
+            nref = nodes_->load(child, true);
+        }
+
+        ref_ = nodes_->flush(nref, true);
+        nodes_->clear();
+
+        return true;
+    }
+
+    /**
+     * Removes every key from first to last, inclusive, returning how many
+     * were removed. Keys in the same leaf are removed together while that
+     * leaves it at least half full, so a run of neighbouring keys costs a
+     * single write of the path to that leaf instead of one per key. The
+     * rest are removed alone, rebalancing as they go.
+     */
+    size_t remove(KEY first, const KEY last) {
+        auto removed = (size_t)0;
+        while (ref_.valid() && !(last < first)) {
+            auto nref = nodes_->load(ref_, true);
+            auto node = nodes_->resolve(nref);
+            auto root = node->depth == 0;
+            auto bounded = false;
+            KEY upper{ };
+
+            while (node->depth > 0) {
+                auto index = Keys::inner_position_for(first, node->keys, node->number_keys);
+                if (index < node->number_keys) {
+                    upper = node->keys[index];
+                    bounded = true;
+                }
+                nref = load_child(node, index);
+                node = nodes_->resolve(nref);
+            }
+
+            auto begin = Keys::leaf_position_for(first, node->keys, node->number_keys);
+            auto end = begin;
+            while (end < node->number_keys && !(last < node->keys[end])) {
+                end++;
+            }
+
+            // Nothing here, so carry on from the following leaf if it can
+            // have any of them.
+            if (begin == end) {
+                nodes_->clear();
+                if (!bounded || last < upper) {
+                    break;
+                }
+                first = upper;
+                continue;
+            }
+
+            auto spare = root ? node->number_keys : (IndexType)0;
+            if (!root && node->number_keys > LeafMinimum) {
+                spare = node->number_keys - LeafMinimum;
+            }
+            if (spare == 0) {
+                auto key = node->keys[begin];
+                nodes_->clear();
+                if (!remove(key)) {
+                    return removed;
+                }
+                removed++;
+                continue;
+            }
+
+            auto removing = (IndexType)(end - begin) < spare ? (IndexType)(end - begin) : spare;
+            for (auto i = begin; i + removing < node->number_keys; ++i) {
+                node->keys[i] = node->keys[i + removing];
+                node->d.values[i] = node->d.values[i + removing];
+            }
+            node->number_keys -= removing;
+            removed += removing;
+
+            ref_ = nodes_->flush();
+        }
+
+        return removed;
     }
 
     ADDRESS create_if_necessary() {
@@ -423,6 +747,106 @@ public:
         return new_head;
     }
 
+    /**
+     * Rewrites the nodes for which `moving(address)` is true, along with their
+     * ancestors, walking the tree in key order from `key`. Work is done one
+     * bottom inner node at a time until `budget` node reads and writes have
+     * been spent, and `key` is left where the following call should resume.
+     * Returns false once the end of the tree has been reached. Nodes written
+     * since the walk began will never be moved, so after the walk is
+     * complete none of the live nodes are at addresses matching `moving`.
+     */
+    template<typename FN>
+    bool relocate(KEY &key, FN moving, uint32_t &budget) {
+        create_if_necessary();
+
+        assert(ref_.valid());
+
+        do {
+            NodeRefType path[MaximumDepth + 1];
+            IndexType positions[MaximumDepth + 1];
+            DepthType height = 0;
+            auto used = 0u;
+
+            path[height++] = nodes_->load(ref_, true);
+            used++;
+
+            auto node = nodes_->resolve(path[0]);
+            if (node->depth == 0) {
+                if (moving(ref_.address())) {
+                    ref_ = nodes_->flush(path[0], true);
+                    used++;
+                }
+                nodes_->clear();
+                budget = budget > used ? budget - used : 0;
+                return false;
+            }
+
+            while (node->depth > 1) {
+                assert(height <= MaximumDepth);
+                auto index = Keys::inner_position_for(key, node->keys, node->number_keys);
+                positions[height - 1] = index;
+                path[height++] = load_child(node, index);
+                node = nodes_->resolve(path[height - 1]);
+                used++;
+            }
+
+            // Leaves can be moved without ever looking at their parent's
+            // siblings, as their addresses are right here.
+            auto modified = false;
+            for (auto i = 0; i <= node->number_keys; ++i) {
+                if (moving(node->d.children[i].address())) {
+                    load_child(node, i);
+                    release_child(node, i, true);
+                    modified = true;
+                    used += 2;
+                }
+            }
+
+            // Resume from the separator following this subtree. Searching for
+            // it takes us into the following subtree.
+            auto more = false;
+            for (auto level = (int32_t)height - 2; level >= 0; --level) {
+                auto parent = nodes_->resolve(path[level]);
+                if (positions[level] < parent->number_keys) {
+                    key = parent->keys[positions[level]];
+                    more = true;
+                    break;
+                }
+            }
+
+            // Working our way up, release the nodes that don't need writing.
+            // Anything above a modified node will need writing as well.
+            auto writing = (uint32_t)height;
+            for (auto level = (int32_t)height - 1; level >= 0; --level) {
+                modified = modified || moving(path[level].address());
+                if (modified) {
+                    break;
+                }
+                if (level > 0) {
+                    release_child(nodes_->resolve(path[level - 1]), positions[level - 1], false);
+                }
+                writing--;
+            }
+
+            if (modified) {
+                ref_ = nodes_->flush(path[0], true);
+                used += writing;
+            }
+
+            nodes_->clear();
+
+            budget = budget > used ? budget - used : 0;
+
+            if (!more) {
+                return false;
+            }
+        }
+        while (budget > 0);
+
+        return true;
+    }
+
 private:
     struct SplitOutcome {
         KEY key;
@@ -435,10 +859,222 @@ private:
         }
     };
 
+    // Nodes left with fewer keys than these after a remove are refilled from
+    // or merged with a sibling.
+    static constexpr IndexType LeafMinimum = M / 2;
+    static constexpr IndexType InnerMinimum = (N - 1) / 2;
+
     NodeRefType load_child(NodeType *node, IndexType i) {
         return node->d.children[i] = nodes_->load(node->d.children[i]);
     }
 
+    // Releases a child loaded with load_child, writing it first if it's been
+    // modified. Children must be released in the reverse order they were
+    // loaded in.
+    void release_child(NodeType *node, IndexType i, bool modified) {
+        auto cref = node->d.children[i];
+        if (modified) {
+            cref = nodes_->flush(cref, false);
+        }
+        nodes_->unload(cref);
+        node->d.children[i] = NodeRefType{ cref.address() };
+    }
+
+    bool leaf_remove(NodeRefType nref, KEY key) {
+        auto node = nodes_->resolve(nref);
+
+        assert(node->depth == 0);
+
+        auto index = Keys::leaf_position_for(key, node->keys, node->number_keys);
+        if (index == node->number_keys || node->keys[index] != key) {
+            return false;
+        }
+
+        for (auto i = index; i < (unsigned)node->number_keys - 1; ++i) {
+            node->keys[i] = node->keys[i + 1];
+            node->d.values[i] = node->d.values[i + 1];
+        }
+        node->number_keys--;
+
+        return true;
+    }
+
+    bool inner_remove(NodeRefType nref, KEY key) {
+        auto node = nodes_->resolve(nref);
+
+        assert(node->depth > 0);
+
+        auto index = Keys::inner_position_for(key, node->keys, node->number_keys);
+        auto cref = load_child(node, index);
+        auto child = nodes_->resolve(cref);
+
+        auto removed = false;
+        if (child->depth == 0) {
+            removed = leaf_remove(cref, key);
+        }
+        else {
+            removed = inner_remove(cref, key);
+        }
+
+        if (!removed) {
+            release_child(node, index, false);
+            return false;
+        }
+
+        auto minimum = child->depth == 0 ? LeafMinimum : InnerMinimum;
+        if (child->number_keys >= minimum && child->number_keys > 0) {
+            release_child(node, index, true);
+            return true;
+        }
+
+        rebalance(nref, index);
+
+        return true;
+    }
+
+    // Refills the underfull child at `index` from a sibling that can spare a
+    // key, or merges it with one. The child is loaded and the siblings are
+    // loaded one at a time, so at most two children are in the cache.
+    void rebalance(NodeRefType nref, IndexType index) {
+        auto node = nodes_->resolve(nref);
+        auto child = nodes_->resolve(node->d.children[index]);
+        auto minimum = child->depth == 0 ? LeafMinimum : InnerMinimum;
+
+        if (index > 0) {
+            auto left = nodes_->resolve(load_child(node, index - 1));
+            if (left->number_keys > minimum && left->number_keys > 1) {
+                borrow_from_left(node, index);
+                release_child(node, index - 1, true);
+                release_child(node, index, true);
+                return;
+            }
+
+            if (index == node->number_keys) {
+                merge(node, index - 1);
+                release_child(node, index - 1, true);
+                nodes_->unload(node->d.children[index]);
+                remove_separator(node, index - 1);
+                return;
+            }
+
+            release_child(node, index - 1, false);
+        }
+
+        assert(index < node->number_keys);
+
+        auto right = nodes_->resolve(load_child(node, index + 1));
+        if (right->number_keys > minimum && right->number_keys > 1) {
+            borrow_from_right(node, index);
+            release_child(node, index + 1, true);
+            release_child(node, index, true);
+            return;
+        }
+
+        merge(node, index);
+        nodes_->unload(node->d.children[index + 1]);
+        release_child(node, index, true);
+        remove_separator(node, index);
+    }
+
+    void borrow_from_left(NodeType *node, IndexType index) {
+        auto left = nodes_->resolve(node->d.children[index - 1]);
+        auto child = nodes_->resolve(node->d.children[index]);
+
+        if (child->depth == 0) {
+            for (auto i = child->number_keys; i > 0; --i) {
+                child->keys[i] = child->keys[i - 1];
+                child->d.values[i] = child->d.values[i - 1];
+            }
+            child->keys[0] = left->keys[left->number_keys - 1];
+            child->d.values[0] = left->d.values[left->number_keys - 1];
+            child->number_keys++;
+            left->number_keys--;
+            node->keys[index - 1] = child->keys[0];
+        }
+        else {
+            // Rotate the last child of the left sibling through the parent.
+            child->d.children[child->number_keys + 1] = child->d.children[child->number_keys];
+            for (auto i = child->number_keys; i > 0; --i) {
+                child->keys[i] = child->keys[i - 1];
+                child->d.children[i] = child->d.children[i - 1];
+            }
+            child->keys[0] = node->keys[index - 1];
+            child->d.children[0] = left->d.children[left->number_keys];
+            child->number_keys++;
+            node->keys[index - 1] = left->keys[left->number_keys - 1];
+            left->d.children[left->number_keys].clear();
+            left->number_keys--;
+        }
+    }
+
+    void borrow_from_right(NodeType *node, IndexType index) {
+        auto child = nodes_->resolve(node->d.children[index]);
+        auto right = nodes_->resolve(node->d.children[index + 1]);
+
+        if (child->depth == 0) {
+            child->keys[child->number_keys] = right->keys[0];
+            child->d.values[child->number_keys] = right->d.values[0];
+            child->number_keys++;
+            for (auto i = 0; i < right->number_keys - 1; ++i) {
+                right->keys[i] = right->keys[i + 1];
+                right->d.values[i] = right->d.values[i + 1];
+            }
+            right->number_keys--;
+            node->keys[index] = right->keys[0];
+        }
+        else {
+            // Rotate the first child of the right sibling through the parent.
+            child->keys[child->number_keys] = node->keys[index];
+            child->d.children[child->number_keys + 1] = right->d.children[0];
+            child->number_keys++;
+            node->keys[index] = right->keys[0];
+            for (auto i = 0; i < right->number_keys - 1; ++i) {
+                right->keys[i] = right->keys[i + 1];
+                right->d.children[i] = right->d.children[i + 1];
+            }
+            right->d.children[right->number_keys - 1] = right->d.children[right->number_keys];
+            right->d.children[right->number_keys].clear();
+            right->number_keys--;
+        }
+    }
+
+    // Moves everything in the child to the right of `separator` into the
+    // child to its left. The caller removes the separator afterwards.
+    void merge(NodeType *node, IndexType separator) {
+        auto left = nodes_->resolve(node->d.children[separator]);
+        auto right = nodes_->resolve(node->d.children[separator + 1]);
+
+        if (left->depth == 0) {
+            assert((size_t)(left->number_keys + right->number_keys) <= M);
+
+            for (auto i = 0; i < right->number_keys; ++i) {
+                left->keys[left->number_keys + i] = right->keys[i];
+                left->d.values[left->number_keys + i] = right->d.values[i];
+            }
+            left->number_keys += right->number_keys;
+        }
+        else {
+            assert((size_t)(left->number_keys + right->number_keys + 1) <= N);
+
+            left->keys[left->number_keys] = node->keys[separator];
+            for (auto i = 0; i < right->number_keys; ++i) {
+                left->keys[left->number_keys + 1 + i] = right->keys[i];
+                left->d.children[left->number_keys + 1 + i] = right->d.children[i];
+            }
+            left->d.children[left->number_keys + 1 + right->number_keys] = right->d.children[right->number_keys];
+            left->number_keys += right->number_keys + 1;
+        }
+    }
+
+    void remove_separator(NodeType *node, IndexType separator) {
+        for (auto i = separator; i < node->number_keys - 1; ++i) {
+            node->keys[i] = node->keys[i + 1];
+            node->d.children[i + 1] = node->d.children[i + 2];
+        }
+        node->d.children[node->number_keys].clear();
+        node->number_keys--;
+    }
+
     SplitOutcome leaf_insert(NodeRefType nref, KEY key, VALUE value) {
         auto node = nodes_->resolve(nref);
  
@@ -487,7 +1123,7 @@ private:
             " keys=" << (size_t)node->number_keys << std::endl;
         #endif
 
-        if (node->keys[index] == key) {
+        if (index < node->number_keys && node->keys[index] == key) {
             // We are inserting a duplicate value. Simply overwrite the old one
             node->d.values[index] = value;
         }
@@ -34,7 +34,8 @@ enum class BlockType : uint8_t {
     Index,
     Free,
     Error,
-    Unallocated
+    Unallocated,
+    SuperBlockDelta
 };
 
 struct BlockHead {
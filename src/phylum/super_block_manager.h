@@ -25,27 +25,90 @@ struct MinimumSuperBlock {
     SuperBlockLink link{ BlockType::SuperBlock };
 };
 
+/**
+ * Saved in place of a whole super block when only a few of the words after
+ * its link have changed since the whole one that starts its sector. The
+ * head lines up with BlockHead's, so these are found the same way.
+ */
+struct SuperBlockDelta {
+    static constexpr uint8_t MaximumWords = 5;
+
+    BlockMagic magic;
+    BlockType type{ BlockType::SuperBlockDelta };
+    uint8_t number{ 0 };
+    // Bit i is set when the i-th word after the link is in words.
+    uint32_t changed{ 0 };
+    timestamp_t timestamp{ TIMESTAMP_INVALID };
+    uint32_t words[MaximumWords];
+};
+
 class SuperBlockManager {
+public:
+    static constexpr int32_t DefaultChainLength = 2;
+    // Locating gives up on chains longer than this, so managers configured
+    // with any length up to here can find each other's super blocks.
+    static constexpr int32_t MaximumChainLength = 8;
+
 private:
     static constexpr block_index_t AnchorBlocks[] = { 1, 2 };
-    // TODO: Store more than one super block in a sector?
-    SectorAddress location_;
+    // Number of links just before the end of a block's links that are all
+    // checked when locating.
+    static constexpr uint16_t TornLinks = 2;
+    BlockAddress location_;
+    // Index of the record at location_ in its block, and how far apart the
+    // records after the first in each sector are, or 0 until that's known.
+    uint32_t record_{ 0 };
+    uint32_t stride_{ 0 };
     StorageBackend *storage_;
     ReusableBlockAllocator *blocks_;
+    // Whole super blocks and links are packed into sectors this far apart,
+    // with any deltas in between, so a block holds several revisions per
+    // sector before it's rolled over.
+    uint32_t record_size_{ sizeof(MinimumSuperBlock) };
+    int32_t chain_length_{ DefaultChainLength };
 
 public:
     SuperBlockManager(StorageBackend &storage, ReusableBlockAllocator &blocks);
 
 public:
-    SectorAddress location() {
+    BlockAddress location() {
         return location_;
     }
 
+    int32_t chain_length() {
+        return chain_length_;
+    }
+
+    /**
+     * Number of link blocks between the anchors and the super block. Longer
+     * chains erase the anchors less often. Only takes effect when creating.
+     */
+    void chain_length(int32_t length) {
+        assert(length > 0 && length <= MaximumChainLength);
+        chain_length_ = length;
+    }
+
+    /**
+     * Number of whole records that fit in a block. Saving deltas fits more.
+     */
+    uint32_t records_per_block();
+
 public:
     bool locate(MinimumSuperBlock &sb, size_t size);
+    /**
+     * Also fills `base` with the whole super block that the one found may be
+     * a delta of, for passing to save.
+     */
+    bool locate(MinimumSuperBlock &sb, MinimumSuperBlock *base, size_t size);
     bool create(MinimumSuperBlock &sb, size_t size);
     bool create(MinimumSuperBlock &sb, size_t size, std::function<void()> update);
     bool save(MinimumSuperBlock &sb, size_t size);
+    /**
+     * Saves only the words that differ from `base` when that's smaller and
+     * fits in the sector, otherwise the whole thing, which then becomes the
+     * new base. The base is kept by the caller as it's the caller's type.
+     */
+    bool save(MinimumSuperBlock &sb, MinimumSuperBlock *base, size_t size);
     bool walk(BlockVisitor *visitor);
 
 private:
@@ -55,13 +118,31 @@ private:
         size_t n;
     };
 
-    int32_t chain_length();
-    bool walk(block_index_t desired, SuperBlockLink &link, SectorAddress &where, BlockVisitor *visitor);
-    bool find_link(block_index_t block, SuperBlockLink &found, SectorAddress &where);
-    bool rollover(SectorAddress addr, SectorAddress &new_location, PendingWrite write);
-    bool read(SectorAddress addr, SuperBlockLink &link);
-    bool write(SectorAddress addr, SuperBlockLink &link);
-    bool write(SectorAddress addr, PendingWrite write);
+    struct Probe {
+        SuperBlockLink link;
+        bool valid{ false };
+        // Records left empty when a whole super block started a new sector.
+        bool skipped{ false };
+    };
+
+    void record_size(size_t size);
+    uint32_t records_per_sector(uint32_t stride);
+    bool fits(uint32_t offset, size_t n);
+    bool stride_of(block_index_t block, uint32_t &stride, Probe *second);
+    BlockAddress address(block_index_t block, uint32_t record, uint32_t stride);
+    uint32_t record_of(BlockAddress addr, uint32_t stride);
+    bool probe(block_index_t block, uint32_t record, uint32_t stride, Probe &probe);
+    bool check(block_index_t block, uint32_t record, uint32_t stride, Probe &probe);
+    bool link_of(block_index_t block, uint32_t record, uint32_t stride, SuperBlockLink &link);
+    bool diff(MinimumSuperBlock &base, MinimumSuperBlock &sb, size_t size, SuperBlockDelta &delta);
+    bool apply(BlockAddress addr, MinimumSuperBlock &sb, size_t size);
+    bool walk(block_index_t desired, SuperBlockLink &link, BlockAddress &where, uint32_t &stride, BlockVisitor *visitor);
+    bool find_link(block_index_t block, SuperBlockLink &found, BlockAddress &where, uint32_t &found_stride);
+    bool find_link_linear(block_index_t block, SuperBlockLink &found, BlockAddress &where, uint32_t &found_stride);
+    bool rollover(BlockAddress addr, uint32_t record, uint32_t stride, BlockAddress &new_location, PendingWrite write);
+    bool read(BlockAddress addr, SuperBlockLink &link);
+    bool write(BlockAddress addr, SuperBlockLink &link);
+    bool write(BlockAddress addr, PendingWrite write);
 
 };
 
@@ -5,12 +5,16 @@
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <limits>
 #if !defined(ARDUINO)
+#include <atomic>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #endif
 
 #include "phylum/keys.h"
+#include "phylum/node_pool.h"
 
 namespace phylum {
 
@@ -50,16 +54,222 @@ public:
         }
     };
 
+    static constexpr size_t MaximumDepth{ 16 };
+
+    // Nodes are allocated on cache line boundaries, except on the small
+    // boards where every byte counts.
+    #if defined(ARDUINO)
+    static constexpr size_t NodeAlignment{ alignof(void *) };
+    #else
+    static constexpr size_t NodeAlignment{ 64 };
+    #endif
+
+    /**
+     * Walks the pairs with keys in [first, last], forwards or in reverse,
+     * skipping removed values. The tree shouldn't be modified while one of
+     * these is in use.
+     */
+    class Iterator {
+    private:
+        const BPlusTree *tree_;
+        KEY first_;
+        KEY last_;
+        bool reverse_;
+        unsigned height_{ 0 };
+        const Node *path_[MaximumDepth + 1];
+        unsigned positions_[MaximumDepth + 1];
+
+    public:
+        Iterator(const BPlusTree &tree, KEY first, KEY last, bool reverse = false) :
+            tree_(&tree), first_(first), last_(last), reverse_(reverse) {
+            seek(reverse ? last : first);
+        }
+
+    public:
+        bool valid() const {
+            return height_ > 0;
+        }
+
+        KEY key() const {
+            assert(valid());
+            return leaf()->keys[positions_[height_ - 1]];
+        }
+
+        VALUE value() const {
+            assert(valid());
+            return leaf()->values[positions_[height_ - 1]];
+        }
+
+        // Moves to the key nearest to `key` in the direction of iteration.
+        bool seek(KEY key) {
+            height_ = 0;
+
+            if (reverse_) {
+                if (key < first_) {
+                    return false;
+                }
+                if (key > last_) {
+                    key = last_;
+                }
+            }
+            else {
+                if (key > last_) {
+                    return false;
+                }
+                if (key < first_) {
+                    key = first_;
+                }
+            }
+
+            auto node = tree_->root;
+            for (auto d = tree_->depth; d > 0; --d) {
+                auto inner = node->inner();
+                assert(inner->type == NODE_INNER);
+                auto index = Keys::inner_position_for(key, inner->keys, inner->num_keys);
+                push(node, index);
+                node = inner->children[index];
+            }
+
+            auto l = node->leaf();
+            assert(l->type == NODE_LEAF);
+            if (reverse_) {
+                auto index = Keys::inner_position_for(key, l->keys, l->num_keys);
+                push(node, index == 0 ? 0 : index - 1);
+                if (index == 0) {
+                    return settle(retreat());
+                }
+            }
+            else {
+                auto index = Keys::leaf_position_for(key, l->keys, l->num_keys);
+                push(node, index);
+                if (index == l->num_keys) {
+                    return settle(advance());
+                }
+            }
+
+            return settle(true);
+        }
+
+        bool next() {
+            if (!valid()) {
+                return false;
+            }
+            return settle(reverse_ ? retreat() : advance());
+        }
+
+    private:
+        const LeafNode *leaf() const {
+            return path_[height_ - 1]->leaf();
+        }
+
+        void push(const Node *node, unsigned position) {
+            assert(height_ <= MaximumDepth);
+            path_[height_] = node;
+            positions_[height_] = position;
+            height_++;
+        }
+
+        bool settle(bool moved) {
+            while (moved) {
+                auto k = key();
+                if (reverse_ ? k < first_ : k > last_) {
+                    break;
+                }
+                if (value()) {
+                    return true;
+                }
+                moved = reverse_ ? retreat() : advance();
+            }
+            height_ = 0;
+            return false;
+        }
+
+        bool advance() {
+            if (++positions_[height_ - 1] < leaf()->num_keys) {
+                return true;
+            }
+
+            while (--height_ > 0) {
+                auto inner = path_[height_ - 1]->inner();
+                auto &position = positions_[height_ - 1];
+                if (++position > inner->num_keys) {
+                    continue;
+                }
+
+                const Node *node = inner->children[position];
+                while (height_ < tree_->depth) {
+                    push(node, 0);
+                    node = node->inner()->children[0];
+                }
+                push(node, 0);
+
+                if (leaf()->num_keys > 0) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool retreat() {
+            if (positions_[height_ - 1] > 0) {
+                positions_[height_ - 1]--;
+                return true;
+            }
+
+            while (--height_ > 0) {
+                auto inner = path_[height_ - 1]->inner();
+                auto &position = positions_[height_ - 1];
+                if (position == 0) {
+                    continue;
+                }
+
+                const Node *node = inner->children[--position];
+                while (height_ < tree_->depth) {
+                    auto child = node->inner();
+                    push(node, child->num_keys);
+                    node = child->children[child->num_keys];
+                }
+                push(node, 0);
+
+                if (leaf()->num_keys > 0) {
+                    positions_[height_ - 1] = leaf()->num_keys - 1;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+    };
+
 public:
     BPlusTree() : depth(0), root(allocate_leaf()) {
         assert(N > 2); // N must be greater than two to make the split of two inner nodes sensible.
         assert(M > 0); // Leaf nodes must be able to hold at least one element
     }
 
-    ~BPlusTree() {
-    }
+    BPlusTree(const BPlusTree &other) = delete;
+
+    BPlusTree &operator=(const BPlusTree &other) = delete;
 
 public:
+    // Sets aside room for the given number of nodes so that the tree can
+    // grow that large without allocating.
+    bool reserve(size_t leafs, size_t inners) {
+        return leaves_.reserve(leafs) && inners_.reserve(inners);
+    }
+
+    // Removes everything, releasing all of the nodes at once.
+    void clear() {
+        leaves_.clear();
+        inners_.clear();
+        allocated_leafs = 0;
+        allocated_inners = 0;
+        depth = 0;
+        root = allocate_leaf();
+    }
+
     bool empty() const {
         if (depth == 0) {
             return reinterpret_cast<LeafNode *>(root)->num_keys == 0;
@@ -146,116 +356,60 @@ public:
         }
     }
 
-    bool find_all(const KEY &key, const KEY &last_key) const {
-        const InnerNode *inner;
-        const Node *node = root;
-        unsigned d = depth, index;
-        while (d-- != 0) {
-            inner = node->inner();
-            assert(inner->type == NODE_INNER);
-            index = Keys::inner_position_for(key, inner->keys, inner->num_keys);
-            assert(index < inner->num_keys + 1);
-            node = inner->children[index];
-        }
-        const LeafNode *leaf = node->leaf();
-        assert(leaf->type == NODE_LEAF);
-        index = Keys::leaf_position_for(key, leaf->keys, leaf->num_keys);
-        assert(index <= leaf->num_keys);
-
-        auto total_leaves = 0;
-        while (leaf != nullptr) {
-            total_leaves++;
-
-            auto this_leaf = 0;
-            for (unsigned i = 0; i < leaf->num_keys; ++i) {
-                if (leaf->keys[i] > key && leaf->keys[i] < last_key) {
-                    this_leaf++;
-                }
-            }
-
-            if (this_leaf == 0) {
-                break;
-            }
-
-            leaf = leaf->nl;
+    // Calls fn(key, value) for each pair with a key in [first, last], in
+    // order, and returns how many were visited.
+    template<typename FN>
+    size_t find_all(const KEY &first, const KEY &last, FN fn) const {
+        size_t visited = 0;
+        for (Iterator iter{ *this, first, last }; iter.valid(); iter.next()) {
+            fn(iter.key(), iter.value());
+            visited++;
         }
-
-        return false;
+        return visited;
     }
 
     // Finds the LAST item that is < key. That is, the next item in the tree is not < key, but this
-    // item is. If we were to insert key into the tree, it would go after this item. This is weird,
-    // but is easier than implementing iterators. In STL terms, this would be "lower_bound(key)--"
-    // WARNING: This does *not* work when values are deleted. Thankfully, TPC-C does not use deletes.
+    // item is. If we were to insert key into the tree, it would go after this item. In STL terms,
+    // this would be "lower_bound(key)--"
     bool find_last_less_then(const KEY &key, VALUE *value = 0, KEY *out_key = 0) const {
-        const Node *node = root;
-        unsigned int d = depth;
-        while (d-- != 0) {
-            const InnerNode *inner = node->inner();
-            assert(inner->type == NODE_INNER);
-            unsigned int pos = Keys::inner_position_for(key, inner->keys, inner->num_keys);
-            // We need to rewind in the case where they are equal
-            if (pos > 0 && key == inner->keys[pos - 1]) {
-                pos -= 1;
-            }
-            assert(pos == 0 || inner->keys[pos - 1] < key);
-            node = inner->children[pos];
+        Iterator iter{ *this, std::numeric_limits<KEY>::lowest(), key, true };
+        if (iter.valid() && iter.key() == key) {
+            iter.next();
         }
-        const LeafNode *leaf = node->leaf();
-        assert(leaf->type == NODE_LEAF);
-        unsigned int pos = Keys::leaf_position_for(key, leaf->keys, leaf->num_keys);
-        if (pos <= leaf->num_keys) {
-            pos -= 1;
-            if (pos < leaf->num_keys && key == leaf->keys[pos]) {
-                pos -= 1;
-            }
-
-            if (pos < leaf->num_keys) {
-                assert(leaf->keys[pos] < key);
-                if (leaf->values[pos]) {
-                    if (value != NULL) {
-                        *value = leaf->values[pos];
-                    }
-                    if (out_key != NULL) {
-                        *out_key = leaf->keys[pos];
-                    }
-                    return true;
-                } else {
-                    // This is a deleted key! Try again with the new key value
-                    // HACK: This is because this implementation doesn't do deletes correctly. However,
-                    // this makes it work. We need this for TPC-C undo. The solution is to use a
-                    // more complete b-tree implementation.
-                    return find_last_less_then(leaf->keys[pos], value, out_key);
-                }
-            }
+        if (!iter.valid()) {
+            return false;
         }
-
-        return false;
+        if (value != nullptr) {
+            *value = iter.value();
+        }
+        if (out_key != nullptr) {
+            *out_key = iter.key();
+        }
+        return true;
     }
 
     // Looks for the given key. If it is not found, it returns false, if it is
-    // found, it returns true and sets the associated value to NULL.
-    // Note: Currently leaks memory.
+    // found, it removes the pair, merging or rebalancing nodes that are left
+    // less than half full, and returns true.
     bool remove(const KEY &key) {
-        InnerNode *inner;
-        Node *node = root;
-        unsigned d = depth, index;
-        while (d-- != 0) {
-            inner = node->inner();
-            assert(inner->type == NODE_INNER);
-            index = Keys::inner_position_for(key, inner->keys, inner->num_keys);
-            node = inner->children[index];
+        auto removed = false;
+        if (depth == 0) {
+            removed = leaf_remove(root->leaf(), key);
         }
-
-        LeafNode *leaf = node->leaf();
-        assert(leaf->type == NODE_LEAF);
-        index = Keys::leaf_position_for(key, leaf->keys, leaf->num_keys);
-        if (leaf->keys[index] == key) {
-            leaf->values[index] = 0;
-            return true;
-        } else {
-            return false;
+        else {
+            removed = inner_remove(root->inner(), depth, key);
+
+            // If the root has been left with a single child then that child
+            // becomes the new root.
+            auto inner = root->inner();
+            if (inner->num_keys == 0) {
+                root = inner->children[0];
+                depth--;
+                free_inner(inner);
+            }
         }
+
+        return removed;
     }
 
     // Returns the size of an inner node
@@ -405,18 +559,202 @@ public:
 
     LeafNode *allocate_leaf() {
         allocated_leafs++;
-        return new LeafNode();
+        auto node = leaves_.allocate();
+        assert(node != nullptr);
+        return node;
     }
 
     InnerNode *allocate_inner() {
         allocated_inners++;
-        return new InnerNode();
+        auto node = inners_.allocate();
+        assert(node != nullptr);
+        return node;
     }
 
+    void free_leaf(LeafNode *node) {
+        allocated_leafs--;
+        leaves_.release(node);
+    }
+
+    void free_inner(InnerNode *node) {
+        allocated_inners--;
+        inners_.release(node);
+    }
+
+private:
+    NodePool<LeafNode, NodeAlignment> leaves_;
+    NodePool<InnerNode, NodeAlignment> inners_;
+
+public:
     size_t allocated_leafs{ 0 };
     size_t allocated_inners{ 0 };
 
 private:
+    // Nodes left with fewer keys than these after a remove are refilled from
+    // or merged with a sibling.
+    static constexpr unsigned LeafMinimum = M / 2;
+    static constexpr unsigned InnerMinimum = (N - 1) / 2;
+
+    bool leaf_remove(LeafNode *node, const KEY &key) {
+        assert(node->type == NODE_LEAF);
+
+        unsigned index = Keys::leaf_position_for(key, node->keys, node->num_keys);
+        if (index == node->num_keys || node->keys[index] != key) {
+            return false;
+        }
+
+        for (auto i = index; i < node->num_keys - 1; ++i) {
+            node->keys[i] = node->keys[i + 1];
+            node->values[i] = node->values[i + 1];
+        }
+        node->num_keys--;
+
+        return true;
+    }
+
+    bool inner_remove(InnerNode *node, unsigned current_depth, const KEY &key) {
+        assert(node->type == NODE_INNER);
+        assert(current_depth != 0);
+
+        unsigned index = Keys::inner_position_for(key, node->keys, node->num_keys);
+        auto child = node->children[index];
+
+        if (current_depth - 1 == 0) {
+            if (!leaf_remove(child->leaf(), key)) {
+                return false;
+            }
+            if (child->leaf()->num_keys < LeafMinimum || child->leaf()->num_keys == 0) {
+                leaf_rebalance(node, index);
+            }
+        }
+        else {
+            if (!inner_remove(child->inner(), current_depth - 1, key)) {
+                return false;
+            }
+            if (child->inner()->num_keys < InnerMinimum || child->inner()->num_keys == 0) {
+                inner_rebalance(node, index);
+            }
+        }
+
+        return true;
+    }
+
+    // Removes the separator at `index` and the child to its right from the
+    // given inner node.
+    static void inner_erase(InnerNode *node, unsigned index) {
+        for (auto i = index; i < node->num_keys - 1; ++i) {
+            node->keys[i] = node->keys[i + 1];
+            node->children[i + 1] = node->children[i + 2];
+        }
+        node->children[node->num_keys] = nullptr;
+        node->num_keys--;
+    }
+
+    void leaf_rebalance(InnerNode *parent, unsigned index) {
+        auto node = parent->children[index]->leaf();
+        auto left = index > 0 ? parent->children[index - 1]->leaf() : nullptr;
+        auto right = index < parent->num_keys ? parent->children[index + 1]->leaf() : nullptr;
+
+        if (left != nullptr && left->num_keys > LeafMinimum && left->num_keys > 1) {
+            for (auto i = node->num_keys; i > 0; --i) {
+                node->keys[i] = node->keys[i - 1];
+                node->values[i] = node->values[i - 1];
+            }
+            node->keys[0] = left->keys[left->num_keys - 1];
+            node->values[0] = left->values[left->num_keys - 1];
+            node->num_keys++;
+            left->num_keys--;
+            parent->keys[index - 1] = node->keys[0];
+        }
+        else if (right != nullptr && right->num_keys > LeafMinimum && right->num_keys > 1) {
+            node->keys[node->num_keys] = right->keys[0];
+            node->values[node->num_keys] = right->values[0];
+            node->num_keys++;
+            for (unsigned i = 0; i < right->num_keys - 1; ++i) {
+                right->keys[i] = right->keys[i + 1];
+                right->values[i] = right->values[i + 1];
+            }
+            right->num_keys--;
+            parent->keys[index] = right->keys[0];
+        }
+        else if (left != nullptr) {
+            leaf_merge(parent, index - 1, left, node);
+        }
+        else if (right != nullptr) {
+            leaf_merge(parent, index, node, right);
+        }
+    }
+
+    void leaf_merge(InnerNode *parent, unsigned separator, LeafNode *left, LeafNode *right) {
+        assert(left->num_keys + right->num_keys <= M);
+
+        for (unsigned i = 0; i < right->num_keys; ++i) {
+            left->keys[left->num_keys + i] = right->keys[i];
+            left->values[left->num_keys + i] = right->values[i];
+        }
+        left->num_keys += right->num_keys;
+        left->nl = right->nl;
+
+        inner_erase(parent, separator);
+        free_leaf(right);
+    }
+
+    void inner_rebalance(InnerNode *parent, unsigned index) {
+        auto node = parent->children[index]->inner();
+        auto left = index > 0 ? parent->children[index - 1]->inner() : nullptr;
+        auto right = index < parent->num_keys ? parent->children[index + 1]->inner() : nullptr;
+
+        if (left != nullptr && left->num_keys > InnerMinimum && left->num_keys > 1) {
+            // Rotate the last child of our left sibling through the parent.
+            node->children[node->num_keys + 1] = node->children[node->num_keys];
+            for (auto i = node->num_keys; i > 0; --i) {
+                node->keys[i] = node->keys[i - 1];
+                node->children[i] = node->children[i - 1];
+            }
+            node->keys[0] = parent->keys[index - 1];
+            node->children[0] = left->children[left->num_keys];
+            node->num_keys++;
+            parent->keys[index - 1] = left->keys[left->num_keys - 1];
+            left->children[left->num_keys] = nullptr;
+            left->num_keys--;
+        }
+        else if (right != nullptr && right->num_keys > InnerMinimum && right->num_keys > 1) {
+            // Rotate the first child of our right sibling through the parent.
+            node->keys[node->num_keys] = parent->keys[index];
+            node->children[node->num_keys + 1] = right->children[0];
+            node->num_keys++;
+            parent->keys[index] = right->keys[0];
+            for (unsigned i = 0; i < right->num_keys - 1; ++i) {
+                right->keys[i] = right->keys[i + 1];
+                right->children[i] = right->children[i + 1];
+            }
+            right->children[right->num_keys - 1] = right->children[right->num_keys];
+            right->children[right->num_keys] = nullptr;
+            right->num_keys--;
+        }
+        else if (left != nullptr) {
+            inner_merge(parent, index - 1, left, node);
+        }
+        else if (right != nullptr) {
+            inner_merge(parent, index, node, right);
+        }
+    }
+
+    void inner_merge(InnerNode *parent, unsigned separator, InnerNode *left, InnerNode *right) {
+        assert(left->num_keys + right->num_keys + 1 <= N);
+
+        left->keys[left->num_keys] = parent->keys[separator];
+        for (unsigned i = 0; i < right->num_keys; ++i) {
+            left->keys[left->num_keys + 1 + i] = right->keys[i];
+            left->children[left->num_keys + 1 + i] = right->children[i];
+        }
+        left->children[left->num_keys + 1 + right->num_keys] = right->children[right->num_keys];
+        left->num_keys += right->num_keys + 1;
+
+        inner_erase(parent, separator);
+        free_inner(right);
+    }
+
     // Data type returned by the private insertion methods.
     struct InsertionResult {
         KEY key;
@@ -476,7 +814,7 @@ private:
         assert(index < M);
         assert(index <= node->num_keys);
 
-        if (node->keys[index] == key) {
+        if (index < node->num_keys && node->keys[index] == key) {
             // We are inserting a duplicate value. Simply overwrite the old one
             node->values[index] = value;
         }
@@ -592,6 +930,484 @@ public:
 };
 
 
+
+#if !defined(ARDUINO)
+
+/**
+ * A B+ tree that many threads may use at once, using optimistic lock
+ * coupling. Every node has a version that writers bump when they unlock it.
+ * Readers never write to shared memory, they note the version of a node
+ * before reading it and check that it's unchanged afterwards, starting over
+ * if it isn't. Writers descend the same way and only lock the one or two
+ * nodes they change. Full nodes are split on the way down, so a split never
+ * has to travel back up the tree.
+ *
+ * Nodes are never freed while the tree is alive, as a reader may still be
+ * looking at them. So removes take keys out of leaves and don't merge them.
+ */
+template <typename KEY, typename VALUE, unsigned N, unsigned M>
+class ConcurrentBPlusTree {
+public:
+    static constexpr size_t InnerWidth{ N };
+    static constexpr size_t LeafWidth{ M };
+    static constexpr size_t NodeAlignment{ 64 };
+
+    using KeyType = KEY;
+    using ValueType = VALUE;
+
+private:
+    struct InnerNode;
+    struct LeafNode;
+
+    // The lowest bit marks a node as locked. Locking and unlocking both add
+    // one, so every change leaves the node with a new version.
+    static constexpr uint64_t LockedBit = 1;
+
+    struct Node {
+        std::atomic<uint64_t> version{ 0 };
+        unsigned level{ 0 };
+        unsigned num_keys{ 0 };
+
+        InnerNode *inner() {
+            return static_cast<InnerNode*>(this);
+        }
+
+        LeafNode *leaf() {
+            return static_cast<LeafNode*>(this);
+        }
+
+        // Returns false if a writer has the node.
+        bool read_lock(uint64_t &observed) const {
+            observed = version.load(std::memory_order_acquire);
+            return (observed & LockedBit) == 0;
+        }
+
+        // Returns true if the node hasn't changed since we read it.
+        bool validate(uint64_t observed) const {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return version.load(std::memory_order_relaxed) == observed;
+        }
+
+        // Locks the node, only if it hasn't changed since we read it.
+        bool upgrade(uint64_t observed) {
+            return version.compare_exchange_strong(observed, observed + LockedBit, std::memory_order_acquire);
+        }
+
+        void unlock() {
+            version.fetch_add(LockedBit, std::memory_order_release);
+        }
+    };
+
+    struct LeafNode : Node {
+        KEY keys[M];
+        VALUE values[M];
+        LeafNode *nl{ nullptr };
+    };
+
+    struct InnerNode : Node {
+        KEY keys[N];
+        Node *children[N + 1]{ };
+    };
+
+    std::atomic<Node*> root_;
+    std::mutex allocation_;
+    NodePool<LeafNode, NodeAlignment> leaves_;
+    NodePool<InnerNode, NodeAlignment> inners_;
+
+public:
+    ConcurrentBPlusTree() {
+        static_assert(N > 2, "N must be greater than two to make the split of two inner nodes sensible.");
+        static_assert(M > 1, "Leaf nodes must be able to hold at least two elements.");
+        root_.store(allocate_leaf());
+    }
+
+    ConcurrentBPlusTree(const ConcurrentBPlusTree &other) = delete;
+
+    ConcurrentBPlusTree &operator=(const ConcurrentBPlusTree &other) = delete;
+
+public:
+    // Inserts a pair (key, value). If there is a previous pair with
+    // the same key, the old value is overwritten with the new one.
+    bool add(KEY key, VALUE value) {
+        while (!try_add(key, value)) {
+        }
+        return true;
+    }
+
+    // Looks for the given key. If it is not found, it returns false,
+    // if it is found, it returns true and copies the associated value
+    // unless the pointer is null.
+    bool find(const KEY &key, VALUE *value = nullptr) const {
+        bool found;
+        while (!try_find(key, value, found)) {
+        }
+        return found;
+    }
+
+    VALUE lookup(const KEY &key) const {
+        VALUE value;
+        if (find(key, &value)) {
+            return value;
+        }
+        return VALUE{ };
+    }
+
+    // Looks for the given key, removing the pair and returning true if it
+    // was found.
+    bool remove(const KEY &key) {
+        bool removed;
+        while (!try_remove(key, removed)) {
+        }
+        return removed;
+    }
+
+    // Calls fn(key, value) for each pair with a key in [first, last], in
+    // order, and returns how many were visited. Each leaf is copied and
+    // checked before fn sees any of it, so every pair is one that was in the
+    // tree at some point during the scan.
+    template<typename FN>
+    size_t find_all(const KEY &first, const KEY &last, FN fn) const {
+        size_t visited = 0;
+        auto resume = first;
+        auto skip_resume = false;
+
+        KEY keys[M];
+        VALUE values[M];
+
+        while (true) {
+            uint64_t version;
+            auto leaf = descend(resume, version);
+            if (leaf == nullptr) {
+                continue;
+            }
+
+            while (true) {
+                unsigned copied = 0;
+                auto finished = false;
+                auto number_keys = clamp(leaf->num_keys, M);
+                for (unsigned i = 0; i < number_keys; ++i) {
+                    auto key = leaf->keys[i];
+                    if (key < resume || (skip_resume && key == resume)) {
+                        continue;
+                    }
+                    if (last < key) {
+                        finished = true;
+                        break;
+                    }
+                    keys[copied] = key;
+                    values[copied] = leaf->values[i];
+                    copied++;
+                }
+                auto next = leaf->nl;
+                if (!leaf->validate(version)) {
+                    break;
+                }
+
+                for (unsigned i = 0; i < copied; ++i) {
+                    fn(keys[i], values[i]);
+                }
+                visited += copied;
+
+                if (copied > 0) {
+                    resume = keys[copied - 1];
+                    skip_resume = true;
+                }
+
+                if (finished || next == nullptr) {
+                    return visited;
+                }
+
+                // Hold on to this leaf until we've got the next one, so a
+                // split between them sends us back to look again.
+                uint64_t next_version;
+                if (!next->read_lock(next_version) || !leaf->validate(version)) {
+                    break;
+                }
+                leaf = next;
+                version = next_version;
+            }
+        }
+    }
+
+    // Returns the number of levels above the leaves.
+    unsigned depth() const {
+        return root_.load(std::memory_order_acquire)->level;
+    }
+
+    size_t allocated_leafs() {
+        std::lock_guard<std::mutex> lock{ allocation_ };
+        return leaves_.size();
+    }
+
+    size_t allocated_inners() {
+        std::lock_guard<std::mutex> lock{ allocation_ };
+        return inners_.size();
+    }
+
+private:
+    // A reader may see a count that's being changed, which we'll notice
+    // when validating. Until then it mustn't take us outside of the node.
+    static unsigned clamp(unsigned number_keys, unsigned maximum) {
+        return number_keys > maximum ? maximum : number_keys;
+    }
+
+    static unsigned child_for(InnerNode *inner, const KEY &key) {
+        return Keys::inner_position_for(key, inner->keys, clamp(inner->num_keys, N));
+    }
+
+    // Finds the leaf for the given key, returning nullptr if we have to
+    // start over. The parent is checked both before we follow a child, so
+    // the pointer is sound, and after we've read the child's version, so the
+    // child wasn't split in between.
+    LeafNode *descend(const KEY &key, uint64_t &version) const {
+        auto node = root_.load(std::memory_order_acquire);
+        if (!node->read_lock(version)) {
+            return nullptr;
+        }
+        if (node != root_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        while (node->level > 0) {
+            auto inner = node->inner();
+            auto child = inner->children[child_for(inner, key)];
+            if (!inner->validate(version)) {
+                return nullptr;
+            }
+            uint64_t child_version;
+            if (!child->read_lock(child_version)) {
+                return nullptr;
+            }
+            if (!inner->validate(version)) {
+                return nullptr;
+            }
+            node = child;
+            version = child_version;
+        }
+        return node->leaf();
+    }
+
+    bool try_find(const KEY &key, VALUE *value, bool &found) const {
+        uint64_t version;
+        auto leaf = descend(key, version);
+        if (leaf == nullptr) {
+            return false;
+        }
+
+        auto number_keys = clamp(leaf->num_keys, M);
+        auto index = Keys::leaf_position_for(key, leaf->keys, number_keys);
+        found = index < number_keys && leaf->keys[index] == key;
+        auto copy = found ? leaf->values[index] : VALUE{ };
+
+        if (!leaf->validate(version)) {
+            return false;
+        }
+        if (found && value != nullptr) {
+            *value = copy;
+        }
+        return true;
+    }
+
+    bool try_add(KEY &key, VALUE &value) {
+        uint64_t version;
+        auto node = root_.load(std::memory_order_acquire);
+        if (!node->read_lock(version)) {
+            return false;
+        }
+        if (node != root_.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        InnerNode *parent = nullptr;
+        uint64_t parent_version = 0;
+
+        while (node->level > 0) {
+            auto inner = node->inner();
+            if (inner->num_keys == N) {
+                if (!lock_for_split(parent, parent_version, node, version)) {
+                    return false;
+                }
+                KEY separator;
+                auto sibling = inner_split(inner, separator);
+                link(parent, node, separator, sibling);
+                return false;
+            }
+
+            if (parent != nullptr && !parent->validate(parent_version)) {
+                return false;
+            }
+
+            parent = inner;
+            parent_version = version;
+
+            node = inner->children[child_for(inner, key)];
+            if (!inner->validate(version)) {
+                return false;
+            }
+            if (!node->read_lock(version)) {
+                return false;
+            }
+        }
+
+        auto leaf = node->leaf();
+        if (leaf->num_keys == M) {
+            if (!lock_for_split(parent, parent_version, node, version)) {
+                return false;
+            }
+            KEY separator;
+            auto sibling = leaf_split(leaf, separator);
+            link(parent, node, separator, sibling);
+            return false;
+        }
+
+        if (!leaf->upgrade(version)) {
+            return false;
+        }
+        if (parent != nullptr && !parent->validate(parent_version)) {
+            leaf->unlock();
+            return false;
+        }
+
+        auto index = Keys::leaf_position_for(key, leaf->keys, leaf->num_keys);
+        if (index < leaf->num_keys && leaf->keys[index] == key) {
+            leaf->values[index] = value;
+        }
+        else {
+            for (auto i = leaf->num_keys; i > index; --i) {
+                leaf->keys[i] = leaf->keys[i - 1];
+                leaf->values[i] = leaf->values[i - 1];
+            }
+            leaf->keys[index] = key;
+            leaf->values[index] = value;
+            leaf->num_keys++;
+        }
+
+        leaf->unlock();
+
+        return true;
+    }
+
+    bool try_remove(const KEY &key, bool &removed) {
+        uint64_t version;
+        auto leaf = descend(key, version);
+        if (leaf == nullptr) {
+            return false;
+        }
+        if (!leaf->upgrade(version)) {
+            return false;
+        }
+
+        auto index = Keys::leaf_position_for(key, leaf->keys, leaf->num_keys);
+        removed = index < leaf->num_keys && leaf->keys[index] == key;
+        if (removed) {
+            for (auto i = index; i < leaf->num_keys - 1; ++i) {
+                leaf->keys[i] = leaf->keys[i + 1];
+                leaf->values[i] = leaf->values[i + 1];
+            }
+            leaf->num_keys--;
+        }
+
+        leaf->unlock();
+
+        return true;
+    }
+
+    // Locks a full node and its parent, which has room for another child as
+    // we split on the way down. Without a parent the node has to still be
+    // the root.
+    bool lock_for_split(InnerNode *parent, uint64_t parent_version, Node *node, uint64_t version) {
+        if (parent != nullptr && !parent->upgrade(parent_version)) {
+            return false;
+        }
+        if (!node->upgrade(version)) {
+            if (parent != nullptr) {
+                parent->unlock();
+            }
+            return false;
+        }
+        if (parent == nullptr && node != root_.load(std::memory_order_acquire)) {
+            node->unlock();
+            return false;
+        }
+        return true;
+    }
+
+    // Adds the new sibling to the right of node in the parent, or in a new
+    // root above them both, and releases the locks taken for the split.
+    void link(InnerNode *parent, Node *node, KEY separator, Node *sibling) {
+        if (parent == nullptr) {
+            auto root = allocate_inner();
+            root->level = node->level + 1;
+            root->num_keys = 1;
+            root->keys[0] = separator;
+            root->children[0] = node;
+            root->children[1] = sibling;
+            root_.store(root, std::memory_order_release);
+        }
+        else {
+            auto index = Keys::inner_position_for(separator, parent->keys, parent->num_keys);
+            for (auto i = parent->num_keys; i > index; --i) {
+                parent->keys[i] = parent->keys[i - 1];
+                parent->children[i + 1] = parent->children[i];
+            }
+            parent->keys[index] = separator;
+            parent->children[index + 1] = sibling;
+            parent->num_keys++;
+        }
+
+        node->unlock();
+        if (parent != nullptr) {
+            parent->unlock();
+        }
+    }
+
+    LeafNode *leaf_split(LeafNode *leaf, KEY &separator) {
+        auto threshold = (M + 1) / 2;
+        auto sibling = allocate_leaf();
+        sibling->num_keys = leaf->num_keys - threshold;
+        for (unsigned i = 0; i < sibling->num_keys; ++i) {
+            sibling->keys[i] = leaf->keys[threshold + i];
+            sibling->values[i] = leaf->values[threshold + i];
+        }
+        sibling->nl = leaf->nl;
+        leaf->nl = sibling;
+        leaf->num_keys = threshold;
+        separator = sibling->keys[0];
+        return sibling;
+    }
+
+    InnerNode *inner_split(InnerNode *inner, KEY &separator) {
+        auto threshold = (N + 1) / 2;
+        auto sibling = allocate_inner();
+        sibling->level = inner->level;
+        sibling->num_keys = inner->num_keys - threshold;
+        for (unsigned i = 0; i < sibling->num_keys; ++i) {
+            sibling->keys[i] = inner->keys[threshold + i];
+            sibling->children[i] = inner->children[threshold + i];
+        }
+        sibling->children[sibling->num_keys] = inner->children[inner->num_keys];
+        separator = inner->keys[threshold - 1];
+        inner->num_keys = threshold - 1;
+        return sibling;
+    }
+
+    LeafNode *allocate_leaf() {
+        std::lock_guard<std::mutex> lock{ allocation_ };
+        auto node = leaves_.allocate();
+        assert(node != nullptr);
+        return node;
+    }
+
+    InnerNode *allocate_inner() {
+        std::lock_guard<std::mutex> lock{ allocation_ };
+        auto node = inners_.allocate();
+        assert(node != nullptr);
+        return node;
+    }
+
+};
+
+#endif
+
 }
 
 #endif
@@ -5,14 +5,31 @@
 
 namespace phylum {
 
+struct TreeGcState {
+    // The oldest block in each of the tree's chains that may still hold live
+    // nodes, or BLOCK_INDEX_INVALID if those need to be found again.
+    block_index_t leaf{ BLOCK_INDEX_INVALID };
+    block_index_t index{ BLOCK_INDEX_INVALID };
+    // Which of those blocks nodes are being moved out of, and the key to
+    // continue moving them from.
+    uint8_t relocating{ 0 };
+    uint64_t key{ 0 };
+
+    static constexpr uint8_t RelocatingLeaf = 1;
+    static constexpr uint8_t RelocatingIndex = 2;
+};
+
 struct TreeFileSystemSuperBlock : public MinimumSuperBlock  {
     AllocatorState allocator;
     timestamp_t last_gc{ 0 };
     block_index_t tree{ 0 };
     block_index_t journal{ BLOCK_INDEX_INVALID };
     block_index_t free{ BLOCK_INDEX_INVALID };
+    // Last block of the free pile as of this save, where locating starts.
+    block_index_t free_tail{ BLOCK_INDEX_INVALID };
     BlockAddress leaf;
     BlockAddress index;
+    TreeGcState gc;
 
     TreeFileSystemSuperBlock() {
     }
@@ -23,6 +40,8 @@ private:
     BlockManager *blocks_;
     SuperBlockManager manager_;
     TreeFileSystemSuperBlock sb_;
+    // Last whole super block saved, which saves only write changes from.
+    TreeFileSystemSuperBlock base_;
 
 public:
     TreeFileSystemSuperBlock &block() {
@@ -33,16 +52,26 @@ public:
         return sb_.link.header.timestamp;
     }
 
-    SectorAddress location() {
+    BlockAddress location() {
         return manager_.location();
     }
 
+    SuperBlockManager &manager() {
+        return manager_;
+    }
+
 public:
     TreeFileSystemSuperBlockManager(StorageBackend &storage, BlockManager &blocks);
 
 public:
     bool locate();
     bool create();
+
+    /**
+     * Creates the super block, along with the first blocks of the journal
+     * and the free pile, which are left for the caller to format.
+     */
+    bool create(AllocatedBlock &journal, AllocatedBlock &free);
     bool save();
 
 protected:
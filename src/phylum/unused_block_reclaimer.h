@@ -13,7 +13,7 @@ private:
 
 public:
     UnusedBlockReclaimer(Files &files, SuperBlockManager &sbm) :
-        files_(&files), sbm_(&sbm) {
+        files_(&files), sbm_(&sbm), tracker_(files.backend_->geometry().number_of_blocks) {
     }
 
 public:
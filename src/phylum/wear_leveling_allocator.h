@@ -0,0 +1,138 @@
+#ifndef __PHYLUM_WEAR_LEVELING_ALLOCATOR_H_INCLUDED
+#define __PHYLUM_WEAR_LEVELING_ALLOCATOR_H_INCLUDED
+
+#include "phylum/backend.h"
+#include "phylum/block_alloc.h"
+#include "phylum/block_bitmap.h"
+#include "phylum/block_heap.h"
+
+namespace phylum {
+
+/**
+ * Moves the data in one block to another, for static wear leveling. Only
+ * the owner of the data knows what refers to a block, so this is theirs.
+ */
+class BlockMigrator {
+public:
+    /**
+     * Whether `block` can be moved at all. Those that can't are passed over
+     * for the next coldest block.
+     */
+    virtual bool movable(block_index_t block) {
+        return true;
+    }
+
+    /**
+     * Copies `from` into `to`, which is already erased, and updates anything
+     * that refers to `from`. The allocator frees `from` afterwards.
+     */
+    virtual bool migrate(block_index_t from, AllocatedBlock to) = 0;
+
+};
+
+/**
+ * Hands out the least worn free block first, using the age in each block's
+ * head, which counts the number of times it's been freed. Blocks that
+ * stay taken for a long time never wear, so once the gap between them and
+ * the most worn block grows past a threshold, level moves the coldest
+ * block's data into a worn free block, so the young block can be used.
+ */
+class WearLevelingBlockAllocator : public BlockManager {
+public:
+    static constexpr block_age_t DefaultThreshold = 32;
+    // Enough to get past the blocks a FileSystem keeps for itself.
+    static constexpr uint32_t MaximumPassedOver = 8;
+
+private:
+    StorageBackend *storage_;
+    Geometry *geometry_{ nullptr };
+    block_age_t *ages_{ nullptr };
+    BlockBitmap free_;
+    // Entries are left behind when a block's taken, freed or ages, and are
+    // dropped when they reach the top, so the heaps are rebuilt when full.
+    // Free blocks, youngest first.
+    BlockHeap available_;
+    // Free blocks, most worn first, kept as the age subtracted from the
+    // largest possible one.
+    BlockHeap worn_;
+    // Taken blocks besides the anchors, youngest first.
+    BlockHeap taken_;
+    block_age_t threshold_{ DefaultThreshold };
+    block_age_t maximum_age_{ 0 };
+    uint32_t migrations_{ 0 };
+
+public:
+    WearLevelingBlockAllocator(StorageBackend &storage);
+    WearLevelingBlockAllocator(const WearLevelingBlockAllocator&) = delete;
+    WearLevelingBlockAllocator &operator=(const WearLevelingBlockAllocator&) = delete;
+    virtual ~WearLevelingBlockAllocator();
+
+public:
+    block_age_t threshold() const {
+        return threshold_;
+    }
+
+    void threshold(block_age_t threshold) {
+        threshold_ = threshold;
+    }
+
+    uint32_t number_of_free_blocks() const {
+        return free_.number_of_free();
+    }
+
+    uint32_t migrations() const {
+        return migrations_;
+    }
+
+    block_age_t age(block_index_t block) const {
+        return block < free_.size() ? ages_[block] : BLOCK_AGE_INVALID;
+    }
+
+    block_age_t maximum_age() const {
+        return maximum_age_;
+    }
+
+public:
+    /**
+     * Difference between the most worn block and the least worn taken one.
+     */
+    block_age_t spread();
+
+    /**
+     * Counts the blocks of each age into `size` buckets that are `width`
+     * ages wide, with the last bucket counting everything older. Returns
+     * the number of blocks counted.
+     */
+    uint32_t histogram(uint32_t *counts, uint32_t size, block_age_t width = 1);
+
+    /**
+     * Moves the coldest block if the spread is past the threshold. This is
+     * at most one block at a time, so it can be called whenever there's a
+     * moment to spare.
+     */
+    bool level(BlockMigrator &migrator);
+
+public:
+    bool initialize(Geometry &geometry) override;
+    AllocatorState state() override;
+    void state(AllocatorState state) override;
+    AllocatedBlock allocate(BlockType type) override;
+    bool free(block_index_t block, block_age_t age) override;
+    bool keeps_free_blocks() override {
+        return true;
+    }
+
+private:
+    void release();
+    bool scan();
+    void rebuild();
+    void track(block_index_t block);
+    bool current(const BlockHeap::Entry &entry, bool free, bool worn);
+    block_index_t coldest_taken();
+    block_index_t most_worn_free();
+
+};
+
+}
+
+#endif
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cstring>
+
 #include "phylum/phylum.h"
 #include "phylum/private.h"
 #include "phylum/super_block_manager.h"
@@ -6,20 +9,21 @@ using namespace alogging;
 
 namespace phylum {
 
-constexpr uint16_t SuperBlockStartSector = 0;
 constexpr block_index_t SuperBlockManager::AnchorBlocks[];
+constexpr int32_t SuperBlockManager::DefaultChainLength;
+constexpr int32_t SuperBlockManager::MaximumChainLength;
 
 SuperBlockManager::SuperBlockManager(StorageBackend &storage, ReusableBlockAllocator &blocks) :
     storage_(&storage), blocks_(&blocks) {
 }
 
-bool SuperBlockManager::walk(block_index_t desired, SuperBlockLink &link, SectorAddress &where, BlockVisitor *visitor) {
+bool SuperBlockManager::walk(block_index_t desired, SuperBlockLink &link, BlockAddress &where, uint32_t &stride, BlockVisitor *visitor) {
     link = { };
     where.invalid();
 
     // Find link in anchor block so we can follow the chain from there.
     for (auto block : AnchorBlocks) {
-        if (!find_link(block, link, where)) {
+        if (!find_link(block, link, where, stride)) {
             return false;
         }
     }
@@ -35,13 +39,13 @@ bool SuperBlockManager::walk(block_index_t desired, SuperBlockLink &link, Sector
         return true;
     }
 
-    for (auto i = 0; i < chain_length() + 1; ++i) {
+    for (auto i = 0; i < MaximumChainLength + 1; ++i) {
         if (visitor != nullptr) {
             auto info = VisitInfo{ link.chained_block, 0 };
             visitor->block(info);
         }
 
-        if (!find_link(link.chained_block, link, where)) {
+        if (!find_link(link.chained_block, link, where, stride)) {
             return false;
         }
 
@@ -61,31 +65,54 @@ bool SuperBlockManager::walk(block_index_t desired, SuperBlockLink &link, Sector
 }
 
 bool SuperBlockManager::locate(MinimumSuperBlock &sb, size_t size) {
+    return locate(sb, nullptr, size);
+}
+
+bool SuperBlockManager::locate(MinimumSuperBlock &sb, MinimumSuperBlock *base, size_t size) {
     SuperBlockLink link;
-    SectorAddress where;
+    BlockAddress where;
 
+    record_size(size);
     location_.invalid();
 
-    if (!walk(BLOCK_INDEX_INVALID, link, where, nullptr)) {
+    uint32_t stride;
+    if (!walk(BLOCK_INDEX_INVALID, link, where, stride, nullptr)) {
         sdebug() << "SuperBlockManager::walk failed." << endl;
         return false;
     }
 
     location_ = where;
-
-    if (!storage_->read({ storage_->geometry(), location_, 0 }, &sb, size)) {
+    record_ = record_of(where, stride);
+    stride_ = record_ > 0 ? stride : 0;
+
+    // Deltas are relative to the whole super block starting their sector,
+    // and are the only thing after that in sectors of blocks that have them.
+    auto &g = storage_->geometry();
+    auto delta = stride != record_size_ && where.sector_offset(g) != 0;
+    auto whole = delta ? BlockAddress{ where.block, (uint32_t)(where.sector_number(g) * g.sector_size) } : where;
+    if (!storage_->read(whole, &sb, size)) {
         sdebug() << "SuperBlockManager::read_super failed." << endl;
         return false;
     }
 
+    if (base != nullptr) {
+        memcpy(base, &sb, size);
+    }
+
+    if (delta && !apply(where, sb, size)) {
+        sdebug() << "SuperBlockManager::apply failed." << endl;
+        return false;
+    }
+
     return true;
 }
 
 bool SuperBlockManager::walk(BlockVisitor *visitor) {
     SuperBlockLink link;
-    SectorAddress where;
+    BlockAddress where;
 
-    if (!walk(BLOCK_INDEX_INVALID, link, where, visitor)) {
+    uint32_t stride;
+    if (!walk(BLOCK_INDEX_INVALID, link, where, stride, visitor)) {
         sdebug() << "SuperBlockManager::walk failed." << endl;
         return false;
     }
@@ -93,36 +120,284 @@ bool SuperBlockManager::walk(BlockVisitor *visitor) {
     return true;
 }
 
-bool SuperBlockManager::find_link(block_index_t block, SuperBlockLink &found, SectorAddress &where) {
-    for (auto s = SuperBlockStartSector; s < storage_->geometry().sectors_per_block(); ++s) {
-        SuperBlockLink link;
+bool SuperBlockManager::find_link(block_index_t block, SuperBlockLink &found, BlockAddress &where, uint32_t &found_stride) {
+    // Links are written in order, so the valid ones are all at the start of
+    // the block. We gallop forward to bracket the first invalid one and then
+    // bisect, so a block with a few links costs a few reads and a full one
+    // around log2 of its records.
+    uint32_t stride;
+    Probe second;
+    if (!stride_of(block, stride, &second)) {
+        return false;
+    }
+
+    auto low = (uint32_t)0;
+    auto high = storage_->geometry().sectors_per_block() * records_per_sector(stride);
+    auto newest = (uint32_t)0;
+    auto valid = false;
+    SuperBlockLink beginning;
+    SuperBlockLink last;
 
-        SectorAddress addr{ block, s };
+    // Finding the stride read the second record already.
+    auto cached = records_per_sector(stride) > 1;
 
-        if (!read(addr, link)) {
-            sdebug() << "Read failed: " << addr << endl;
+    auto visit = [&](uint32_t record) -> bool {
+        Probe p = second;
+        if ((record != 1 || !cached) && !probe(block, record, stride, p)) {
+            sdebug() << "Read failed: " << block << " " << record << endl;
             return false;
         }
 
-        if (link.header.magic.valid()) {
-            // NOTE: This first test serves two purposes. It ensures an
-            // uninitialized found gets set to the first one we come across and
-            // also makes the find_link work when a wrap around has occured. In
-            // that case we automatically select a block that was prceeded by
-            // the maximum value.
-            if (found.header.timestamp == TIMESTAMP_INVALID || link.header.timestamp > found.header.timestamp) {
-                found = link;
-                where = addr;
+        valid = p.valid;
+        if (valid) {
+            if (record == 0) {
+                beginning = p.link;
             }
+            if (!p.skipped) {
+                last = p.link;
+                newest = record;
+            }
+            low = record + 1;
         }
         else {
+            high = record;
+        }
+
+        return true;
+    };
+
+    for (auto distance = (uint32_t)1; distance - 1 < high; distance *= 2) {
+        if (!visit(distance - 1)) {
+            return false;
+        }
+        if (!valid) {
+            break;
+        }
+    }
+
+    while (low < high) {
+        if (!visit(low + (high - low) / 2)) {
+            return false;
+        }
+    }
+
+    if (low == 0) {
+        return true;
+    }
+
+    // Searching skips most sectors, so if a torn write left a gap near the
+    // end we'd never know. We check the links just before the last one and
+    // if they aren't all there go back to looking at every one.
+    auto first = low > TornLinks ? low - TornLinks : 0;
+    for (auto r = first; r < low - 1; ++r) {
+        Probe p;
+        if (!probe(block, r, stride, p)) {
+            sdebug() << "Read failed: " << block << " " << r << endl;
+            return false;
+        }
+
+        if (!p.valid) {
+            return find_link_linear(block, found, where, found_stride);
+        }
+    }
+
+    if (!link_of(block, newest, stride, last)) {
+        return false;
+    }
+
+    // Same as checking every link like find_link_linear does. The last link
+    // is the newest, and is preferred over the found one unless it's older.
+    // Timestamps that wrapped around in this block passed the maximum on the
+    // way, which is always preferred.
+    auto wrapped = beginning.header.timestamp > last.header.timestamp;
+    if (found.header.timestamp == TIMESTAMP_INVALID || last.header.timestamp > found.header.timestamp || wrapped) {
+        found = last;
+        where = address(block, newest, stride);
+        found_stride = stride;
+    }
+
+    return true;
+}
+
+bool SuperBlockManager::find_link_linear(block_index_t block, SuperBlockLink &found, BlockAddress &where, uint32_t &found_stride) {
+    uint32_t stride;
+    if (!stride_of(block, stride, nullptr)) {
+        return false;
+    }
+
+    auto records = storage_->geometry().sectors_per_block() * records_per_sector(stride);
+    for (auto r = (uint32_t)0; r < records; ++r) {
+        Probe p;
+        if (!probe(block, r, stride, p)) {
+            sdebug() << "Read failed: " << block << " " << r << endl;
+            return false;
+        }
+
+        if (!p.valid) {
             break;
         }
+
+        if (p.skipped) {
+            continue;
+        }
+
+        auto &link = p.link;
+        if (!link_of(block, r, stride, link)) {
+            return false;
+        }
+
+        // NOTE: This first test serves two purposes. It ensures an
+        // uninitialized found gets set to the first one we come across and
+        // also makes the find_link work when a wrap around has occured. In
+        // that case we automatically select a block that was prceeded by
+        // the maximum value.
+        if (found.header.timestamp == TIMESTAMP_INVALID || link.header.timestamp > found.header.timestamp) {
+            found = link;
+            where = address(block, r, stride);
+            found_stride = stride;
+        }
+    }
+
+    return true;
+}
+
+bool SuperBlockManager::stride_of(block_index_t block, uint32_t &stride, Probe *second) {
+    // The second record is right after the first either way, and is a delta
+    // when the rest of the block's sectors are filled out with them.
+    stride = record_size_;
+
+    if (!fits(record_size_, sizeof(SuperBlockLink))) {
+        return true;
+    }
+
+    Probe p;
+    if (!read(BlockAddress{ block, record_size_ }, p.link)) {
+        return false;
+    }
+
+    if (p.link.header.magic.valid() && p.link.header.type == BlockType::SuperBlockDelta) {
+        stride = sizeof(SuperBlockDelta);
+    }
+
+    if (second != nullptr && records_per_sector(stride) > 1) {
+        *second = p;
+        return check(block, 1, stride, *second);
     }
 
     return true;
 }
 
+bool SuperBlockManager::probe(block_index_t block, uint32_t record, uint32_t stride, Probe &probe) {
+    probe = Probe{ };
+
+    if (!read(address(block, record, stride), probe.link)) {
+        return false;
+    }
+
+    return check(block, record, stride, probe);
+}
+
+bool SuperBlockManager::check(block_index_t block, uint32_t record, uint32_t stride, Probe &probe) {
+    auto per_sector = records_per_sector(stride);
+
+    probe.valid = probe.link.header.magic.valid();
+
+    if (probe.valid && probe.link.header.type == BlockType::SuperBlockDelta) {
+        SuperBlockDelta delta;
+        memcpy((void *)&delta, &probe.link, offsetof(SuperBlockDelta, number) + sizeof(delta.number));
+        probe.valid = record % per_sector != 0 && delta.number <= SuperBlockDelta::MaximumWords;
+    }
+
+    // Whole super blocks never follow deltas in a sector, they start the
+    // following one, which is the only way one of these is left empty.
+    if (!probe.valid && stride != record_size_ && record % per_sector != 0) {
+        auto following = (record / per_sector + 1) * per_sector;
+        if (following < storage_->geometry().sectors_per_block() * per_sector) {
+            SuperBlockLink link;
+            if (!read(address(block, following, stride), link)) {
+                return false;
+            }
+
+            probe.valid = probe.skipped = link.header.magic.valid();
+        }
+    }
+
+    return true;
+}
+
+bool SuperBlockManager::link_of(block_index_t block, uint32_t record, uint32_t stride, SuperBlockLink &link) {
+    if (link.header.type != BlockType::SuperBlockDelta) {
+        return true;
+    }
+
+    // Deltas only have the timestamp, the rest of the link is the same as
+    // the whole super block starting the sector.
+    auto timestamp = link.header.timestamp;
+    auto per_sector = records_per_sector(stride);
+    if (!read(address(block, record - record % per_sector, stride), link)) {
+        return false;
+    }
+
+    link.header.timestamp = timestamp;
+
+    return true;
+}
+
+bool SuperBlockManager::diff(MinimumSuperBlock &base, MinimumSuperBlock &sb, size_t size, SuperBlockDelta &delta) {
+    auto words = (size - sizeof(SuperBlockLink)) / sizeof(uint32_t);
+    if (size <= sizeof(SuperBlockDelta) || size % sizeof(uint32_t) != 0 || words > sizeof(delta.changed) * 8) {
+        return false;
+    }
+
+    // Links only change with whole records, apart from their timestamp.
+    auto link = sb.link;
+    link.header.timestamp = base.link.header.timestamp;
+    if (memcmp(&link, &base.link, sizeof(SuperBlockLink)) != 0) {
+        return false;
+    }
+
+    delta = SuperBlockDelta{ };
+    delta.magic.fill();
+    delta.timestamp = sb.link.header.timestamp;
+
+    auto before = reinterpret_cast<uint8_t*>(&base) + sizeof(SuperBlockLink);
+    auto after = reinterpret_cast<uint8_t*>(&sb) + sizeof(SuperBlockLink);
+    for (auto i = (uint32_t)0; i < words; ++i) {
+        auto offset = i * sizeof(uint32_t);
+        if (memcmp(before + offset, after + offset, sizeof(uint32_t)) != 0) {
+            if (delta.number == SuperBlockDelta::MaximumWords) {
+                return false;
+            }
+            memcpy(&delta.words[delta.number++], after + offset, sizeof(uint32_t));
+            delta.changed |= (uint32_t)1 << i;
+        }
+    }
+
+    return true;
+}
+
+bool SuperBlockManager::apply(BlockAddress addr, MinimumSuperBlock &sb, size_t size) {
+    SuperBlockDelta delta;
+    if (!storage_->read(addr, &delta, sizeof(SuperBlockDelta))) {
+        return false;
+    }
+
+    auto bytes = reinterpret_cast<uint8_t*>(&sb) + sizeof(SuperBlockLink);
+    auto number = (uint8_t)0;
+    for (auto i = (uint32_t)0; i < sizeof(delta.changed) * 8; ++i) {
+        if (delta.changed & ((uint32_t)1 << i)) {
+            if (number == delta.number || sizeof(SuperBlockLink) + (i + 1) * sizeof(uint32_t) > size) {
+                return false;
+            }
+            memcpy(bytes + i * sizeof(uint32_t), &delta.words[number++], sizeof(uint32_t));
+        }
+    }
+
+    sb.link.header.timestamp = delta.timestamp;
+
+    return number == delta.number;
+}
+
 bool SuperBlockManager::create(MinimumSuperBlock &sb, size_t size) {
     return create(sb, size, [] {});
 }
@@ -130,6 +405,9 @@ bool SuperBlockManager::create(MinimumSuperBlock &sb, size_t size) {
 bool SuperBlockManager::create(MinimumSuperBlock &sb, size_t size, std::function<void()> update) {
     block_index_t super_block_block = BLOCK_INDEX_INVALID;
     SuperBlockLink link;
+
+    record_size(size);
+
     link.chained_block = BLOCK_INDEX_INVALID;
     link.header.magic.fill();
     link.header.timestamp = chain_length() + 2 + 1;
@@ -145,6 +423,8 @@ bool SuperBlockManager::create(MinimumSuperBlock &sb, size_t size, std::function
             return false;
         }
 
+        link.header.age = alloc.age;
+
         // First of these blocks is actually where the super block goes.
         if (i == 0) {
             super_block_block = block;
@@ -152,7 +432,7 @@ bool SuperBlockManager::create(MinimumSuperBlock &sb, size_t size, std::function
             sb.link.header.type = BlockType::SuperBlock;
         }
         else {
-            if (!write({ block, SuperBlockStartSector }, link)) {
+            if (!write(BlockAddress{ block, 0 }, link)) {
                 sdebug() << "Write failed: " << block << endl;
                 return false;
             }
@@ -167,13 +447,14 @@ bool SuperBlockManager::create(MinimumSuperBlock &sb, size_t size, std::function
     // Overwrite both so an older one doesn't confuse us.
     for (auto anchor : AnchorBlocks) {
         link.header.type = BlockType::Anchor;
+        link.header.age = 0;
 
         if (!storage_->erase(anchor)) {
             sdebug() << "Erase failed: " << anchor << endl;
             return false;
         }
 
-        if (!write({ anchor, SuperBlockStartSector }, link)) {
+        if (!write(BlockAddress{ anchor, 0 }, link)) {
             sdebug() << "Write failed: " << anchor << endl;
             return false;
         }
@@ -185,13 +466,13 @@ bool SuperBlockManager::create(MinimumSuperBlock &sb, size_t size, std::function
 
     update();
 
-    SectorAddress addr = { super_block_block, SuperBlockStartSector };
-    if (!storage_->write({ storage_->geometry(), addr, 0 }, &sb, size)) {
-        sdebug() << "Write failed: " << addr << endl;
+    auto addr = BlockAddress{ super_block_block, 0 };
+    if (!storage_->write(addr, &sb, size)) {
+        sdebug() << "Write failed: " << super_block_block << endl;
         return false;
     }
 
-    sdebug() << "Create done, locating: " << addr << endl;
+    sdebug() << "Create done, locating: " << super_block_block << endl;
     if (locate(sb, size)) {
         return true;
     }
@@ -202,12 +483,12 @@ bool SuperBlockManager::create(MinimumSuperBlock &sb, size_t size, std::function
     return false;
 }
 
-bool SuperBlockManager::rollover(SectorAddress addr, SectorAddress &relocated, PendingWrite pending) {
-    // Move to the following sector and see if we need to perform the rollover.
-    addr.sector++;
-
-    if (addr.sector < storage_->geometry().sectors_per_block()) {
-        relocated = addr;
+bool SuperBlockManager::rollover(BlockAddress addr, uint32_t record, uint32_t stride, BlockAddress &relocated, PendingWrite pending) {
+    // See if the given record is still in this block, or if we need to
+    // perform the rollover. Records share sectors, so this is usually a
+    // partial write to the sector we wrote last.
+    if (record < storage_->geometry().sectors_per_block() * records_per_sector(stride)) {
+        relocated = address(addr.block, record, stride);
         return write(relocated, pending);
     }
 
@@ -215,10 +496,7 @@ bool SuperBlockManager::rollover(SectorAddress addr, SectorAddress &relocated, P
     constexpr auto number_of_anchors = (int32_t)(sizeof(AnchorBlocks) / sizeof(AnchorBlocks[0]));
     for (auto i = 0; i < number_of_anchors; ++i) {
         if (AnchorBlocks[i] == addr.block) {
-            relocated = {
-                AnchorBlocks[(i + 1) % number_of_anchors],
-                SuperBlockStartSector
-            };
+            relocated = BlockAddress{ AnchorBlocks[(i + 1) % number_of_anchors], 0 };
 
             if (!storage_->erase(relocated.block)) {
                 return false;
@@ -230,7 +508,7 @@ bool SuperBlockManager::rollover(SectorAddress addr, SectorAddress &relocated, P
 
     auto alloc = blocks_->allocate(pending.type);
     auto block = alloc.block;
-    relocated = { block, SuperBlockStartSector };
+    relocated = BlockAddress{ block, 0 };
     if (!alloc.erased) {
         if (!storage_->erase(block)) {
             return false;
@@ -245,8 +523,9 @@ bool SuperBlockManager::rollover(SectorAddress addr, SectorAddress &relocated, P
 
     // Find the chain link that references this now obsolete location.
     MinimumSuperBlock msb;
-    SectorAddress previous;
-    if (!walk(addr.block, msb.link, previous, nullptr)) {
+    BlockAddress previous;
+    uint32_t previous_stride;
+    if (!walk(addr.block, msb.link, previous, previous_stride, nullptr)) {
         return false;
     }
 
@@ -259,8 +538,9 @@ bool SuperBlockManager::rollover(SectorAddress addr, SectorAddress &relocated, P
         sizeof(SuperBlockLink)
     };
 
-    SectorAddress actually_wrote;
-    if (!rollover(previous, actually_wrote, link_write)) {
+    // Link blocks only ever hold whole records.
+    BlockAddress actually_wrote;
+    if (!rollover(previous, record_of(previous, record_size_) + 1, record_size_, actually_wrote, link_write)) {
         return false;
     }
 
@@ -270,37 +550,121 @@ bool SuperBlockManager::rollover(SectorAddress addr, SectorAddress &relocated, P
 }
 
 bool SuperBlockManager::save(MinimumSuperBlock &sb, size_t size) {
+    return save(sb, nullptr, size);
+}
+
+bool SuperBlockManager::save(MinimumSuperBlock &sb, MinimumSuperBlock *base, size_t size) {
     sb.link.header.timestamp++;
     sb.link.header.fill();
 
     assert(location_.valid());
 
+    record_size(size);
+
+    // Most saves only change the allocator and the tree's frontiers, so
+    // those fill out the sector after the whole super block starting it.
+    if (base != nullptr && stride_ != record_size_) {
+        auto stride = (uint32_t)sizeof(SuperBlockDelta);
+        auto record = record_ + 1;
+        SuperBlockDelta delta;
+        if (record % records_per_sector(stride) != 0 && diff(*base, sb, size, delta)) {
+            auto addr = address(location_.block, record, stride);
+            if (!storage_->write(addr, &delta, sizeof(SuperBlockDelta))) {
+                return false;
+            }
+
+            location_ = addr;
+            record_ = record;
+            stride_ = stride;
+
+            return true;
+        }
+    }
+
+    // Whole ones go right after others, or start the following sector.
+    auto stride = stride_ == 0 ? record_size_ : stride_;
+    auto record = record_ + 1;
+    if (stride != record_size_) {
+        auto per_sector = records_per_sector(stride);
+        record = (record_ / per_sector + 1) * per_sector;
+    }
+
     auto write = PendingWrite{ BlockType::SuperBlock, &sb, size };
 
-    SectorAddress actually_wrote;
-    if (!rollover(location_, actually_wrote, write)) {
+    BlockAddress actually_wrote;
+    if (!rollover(location_, record, stride, actually_wrote, write)) {
         return false;
     }
 
+    if (actually_wrote.block != location_.block) {
+        record_ = 0;
+        stride_ = 0;
+    }
+    else {
+        record_ = record;
+        stride_ = stride;
+    }
+
     location_ = actually_wrote;
 
+    if (base != nullptr) {
+        memcpy(base, &sb, size);
+    }
+
     return true;
 }
 
-int32_t SuperBlockManager::chain_length() {
-    return 2;
+void SuperBlockManager::record_size(size_t size) {
+    assert(size >= sizeof(MinimumSuperBlock));
+    assert(size <= storage_->geometry().sector_size);
+    record_size_ = size;
+}
+
+uint32_t SuperBlockManager::records_per_sector(uint32_t stride) {
+    // Records never straddle sectors, and each is read as a link to find
+    // it, so there's always room for one of those where a record goes.
+    auto sector_size = (uint32_t)storage_->geometry().sector_size;
+    auto required = std::max(stride, (uint32_t)sizeof(SuperBlockLink));
+    if (record_size_ + required > sector_size) {
+        return 1;
+    }
+    return 2 + (sector_size - record_size_ - required) / stride;
+}
+
+uint32_t SuperBlockManager::records_per_block() {
+    return storage_->geometry().sectors_per_block() * records_per_sector(record_size_);
+}
+
+bool SuperBlockManager::fits(uint32_t offset, size_t n) {
+    return offset + n <= storage_->geometry().sector_size;
+}
+
+BlockAddress SuperBlockManager::address(block_index_t block, uint32_t record, uint32_t stride) {
+    // The first record in each sector is a whole one, which the rest follow.
+    auto per_sector = records_per_sector(stride);
+    auto sector = (sector_index_t)(record / per_sector);
+    auto slot = record % per_sector;
+    auto offset = slot == 0 ? 0 : record_size_ + (slot - 1) * stride;
+    return { storage_->geometry(), SectorAddress{ block, sector }, offset };
+}
+
+uint32_t SuperBlockManager::record_of(BlockAddress addr, uint32_t stride) {
+    auto &g = storage_->geometry();
+    auto offset = addr.sector_offset(g);
+    auto slot = offset == 0 ? 0 : (offset - record_size_) / stride + 1;
+    return addr.sector_number(g) * records_per_sector(stride) + slot;
 }
 
-bool SuperBlockManager::read(SectorAddress addr, SuperBlockLink &link) {
-    return storage_->read({ storage_->geometry(), addr, 0 }, &link, sizeof(SuperBlockLink));
+bool SuperBlockManager::read(BlockAddress addr, SuperBlockLink &link) {
+    return storage_->read(addr, &link, sizeof(SuperBlockLink));
 }
 
-bool SuperBlockManager::write(SectorAddress addr, SuperBlockLink &link) {
-    return storage_->write({ storage_->geometry(), addr, 0 }, &link, sizeof(SuperBlockLink));
+bool SuperBlockManager::write(BlockAddress addr, SuperBlockLink &link) {
+    return storage_->write(addr, &link, sizeof(SuperBlockLink));
 }
 
-bool SuperBlockManager::write(SectorAddress addr, PendingWrite write) {
-    return storage_->write({ storage_->geometry(), addr, 0 }, write.ptr, write.n);
+bool SuperBlockManager::write(BlockAddress addr, PendingWrite write) {
+    return storage_->write(addr, write.ptr, write.n);
 }
 
 }
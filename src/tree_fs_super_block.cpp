@@ -8,7 +8,7 @@ TreeFileSystemSuperBlockManager::TreeFileSystemSuperBlockManager(StorageBackend
 }
 
 bool TreeFileSystemSuperBlockManager::locate() {
-    if (!manager_.locate(sb_, sizeof(TreeFileSystemSuperBlock))) {
+    if (!manager_.locate(sb_, &base_, sizeof(TreeFileSystemSuperBlock))) {
         return false;
     }
 
@@ -18,12 +18,20 @@ bool TreeFileSystemSuperBlockManager::locate() {
 }
 
 bool TreeFileSystemSuperBlockManager::create() {
+    AllocatedBlock journal;
+    AllocatedBlock free;
+    return create(journal, free);
+}
+
+bool TreeFileSystemSuperBlockManager::create(AllocatedBlock &journal, AllocatedBlock &free) {
     // We pull allocator state after doing the above allocations to ensure the
     // first state we write is correct.
     sb_ = TreeFileSystemSuperBlock{ };
     sb_.tree = BLOCK_INDEX_INVALID;
-    sb_.journal = blocks_->allocate(BlockType::Journal).block;
-    sb_.free = blocks_->allocate(BlockType::Free).block;
+    journal = blocks_->allocate(BlockType::Journal);
+    free = blocks_->allocate(BlockType::Free);
+    sb_.journal = journal.block;
+    sb_.free = free.block;
 
     assert(sb_.journal != BLOCK_INDEX_INVALID);
     assert(sb_.free != BLOCK_INDEX_INVALID);
@@ -39,7 +47,7 @@ bool TreeFileSystemSuperBlockManager::save() {
     sb_.link.header.timestamp++;
     sb_.allocator = blocks_->state();
 
-    if (!manager_.save(sb_, sizeof(TreeFileSystemSuperBlock))) {
+    if (!manager_.save(sb_, &base_, sizeof(TreeFileSystemSuperBlock))) {
         return false;
     }
 
@@ -0,0 +1,264 @@
+#include "phylum/wear_leveling_allocator.h"
+
+namespace phylum {
+
+WearLevelingBlockAllocator::WearLevelingBlockAllocator(StorageBackend &storage) : storage_(&storage) {
+}
+
+WearLevelingBlockAllocator::~WearLevelingBlockAllocator() {
+    release();
+}
+
+void WearLevelingBlockAllocator::release() {
+    ::free(ages_);
+    ages_ = nullptr;
+}
+
+bool WearLevelingBlockAllocator::initialize(Geometry &geometry) {
+    geometry_ = &geometry;
+
+    auto nblocks = geometry.number_of_blocks;
+
+    if (free_.size() != nblocks) {
+        release();
+
+        ages_ = (block_age_t *)malloc(sizeof(block_age_t) * nblocks);
+        if (ages_ == nullptr) {
+            return false;
+        }
+
+        if (!free_.initialize(nblocks) || !available_.initialize(nblocks) || !worn_.initialize(nblocks) ||
+            !taken_.initialize(nblocks)) {
+            return false;
+        }
+    }
+
+    return scan();
+}
+
+bool WearLevelingBlockAllocator::scan() {
+    maximum_age_ = 0;
+
+    for (auto block = (block_index_t)0; block < geometry_->number_of_blocks; ++block) {
+        ages_[block] = 0;
+
+        // Anchor blocks are never handed out, though we still read their
+        // ages so they show up in the histogram.
+        BlockHead head;
+        if (!storage_->read({ block, 0 }, &head, sizeof(BlockHead))) {
+            return false;
+        }
+
+        if (head.valid()) {
+            ages_[block] = head.age;
+            if (head.age > maximum_age_) {
+                maximum_age_ = head.age;
+            }
+        }
+
+        if (block < 3 || (head.valid() && head.type != BlockType::Unallocated)) {
+            free_.set_taken(block);
+        }
+        else {
+            free_.set_free(block);
+        }
+    }
+
+    rebuild();
+
+    return true;
+}
+
+void WearLevelingBlockAllocator::rebuild() {
+    available_.clear();
+    worn_.clear();
+    taken_.clear();
+
+    for (auto block = (block_index_t)3; block < free_.size(); ++block) {
+        if (free_.is_free(block)) {
+            available_.push(block, ages_[block]);
+            worn_.push(block, BLOCK_AGE_INVALID - ages_[block]);
+        }
+        else {
+            taken_.push(block, ages_[block]);
+        }
+    }
+}
+
+void WearLevelingBlockAllocator::track(block_index_t block) {
+    auto pushed = free_.is_free(block) ?
+        available_.push(block, ages_[block]) && worn_.push(block, BLOCK_AGE_INVALID - ages_[block]) :
+        taken_.push(block, ages_[block]);
+
+    // Only when a heap's full of stale entries, and this block's among the
+    // ones it's rebuilt with.
+    if (!pushed) {
+        rebuild();
+    }
+}
+
+bool WearLevelingBlockAllocator::current(const BlockHeap::Entry &entry, bool free, bool worn) {
+    auto age = worn ? BLOCK_AGE_INVALID - entry.age : entry.age;
+    return free_.is_free(entry.block) == free && ages_[entry.block] == age;
+}
+
+AllocatorState WearLevelingBlockAllocator::state() {
+    return { BLOCK_INDEX_INVALID };
+}
+
+void WearLevelingBlockAllocator::state(AllocatorState state) {
+}
+
+AllocatedBlock WearLevelingBlockAllocator::allocate(BlockType type) {
+    while (!available_.empty()) {
+        auto selected = available_.pop();
+        if (current(selected, true, false)) {
+            free_.set_taken(selected.block);
+            track(selected.block);
+            return { selected.block, selected.age, false };
+        }
+    }
+
+    return { };
+}
+
+bool WearLevelingBlockAllocator::free(block_index_t block, block_age_t age) {
+    if (block < 3 || block >= free_.size()) {
+        return false;
+    }
+
+    // Our own count wins over whatever the caller thinks, heads written by
+    // others may not have kept the age.
+    BlockHead head;
+    if (!storage_->read({ block, 0 }, &head, sizeof(BlockHead))) {
+        return false;
+    }
+
+    if (head.valid() && head.age > age) {
+        age = head.age;
+    }
+    if (ages_[block] > age) {
+        age = ages_[block];
+    }
+    age++;
+
+    if (!storage_->erase(block)) {
+        return false;
+    }
+
+    head.fill();
+    head.age = age;
+    head.type = BlockType::Unallocated;
+    if (!storage_->write({ block, 0 }, &head, sizeof(BlockHead))) {
+        return false;
+    }
+
+    ages_[block] = age;
+    if (age > maximum_age_) {
+        maximum_age_ = age;
+    }
+
+    free_.set_free(block);
+    track(block);
+
+    return true;
+}
+
+block_index_t WearLevelingBlockAllocator::coldest_taken() {
+    while (!taken_.empty()) {
+        if (current(taken_.top(), false, false)) {
+            return taken_.top().block;
+        }
+        taken_.pop();
+    }
+    return BLOCK_INDEX_INVALID;
+}
+
+block_index_t WearLevelingBlockAllocator::most_worn_free() {
+    while (!worn_.empty()) {
+        if (current(worn_.top(), true, true)) {
+            return worn_.top().block;
+        }
+        worn_.pop();
+    }
+    return BLOCK_INDEX_INVALID;
+}
+
+block_age_t WearLevelingBlockAllocator::spread() {
+    auto coldest = coldest_taken();
+    if (coldest == BLOCK_INDEX_INVALID) {
+        return 0;
+    }
+    return maximum_age_ - ages_[coldest];
+}
+
+uint32_t WearLevelingBlockAllocator::histogram(uint32_t *counts, uint32_t size, block_age_t width) {
+    if (size == 0 || width == 0) {
+        return 0;
+    }
+
+    for (auto i = (uint32_t)0; i < size; ++i) {
+        counts[i] = 0;
+    }
+
+    for (auto block = (block_index_t)0; block < free_.size(); ++block) {
+        auto bucket = ages_[block] / width;
+        counts[bucket < size ? bucket : size - 1]++;
+    }
+
+    return free_.size();
+}
+
+bool WearLevelingBlockAllocator::level(BlockMigrator &migrator) {
+    // Blocks that can't be moved are set aside while we look at the next
+    // coldest, a few at most, and put back after.
+    BlockHeap::Entry passed[MaximumPassedOver];
+    auto npassed = (uint32_t)0;
+    auto coldest = coldest_taken();
+    while (coldest != BLOCK_INDEX_INVALID && maximum_age_ - ages_[coldest] > threshold_ && !migrator.movable(coldest)) {
+        if (npassed == MaximumPassedOver) {
+            coldest = BLOCK_INDEX_INVALID;
+            break;
+        }
+        passed[npassed++] = taken_.pop();
+        coldest = coldest_taken();
+    }
+
+    for (auto i = (uint32_t)0; i < npassed; ++i) {
+        taken_.push(passed[i].block, passed[i].age);
+    }
+
+    if (coldest == BLOCK_INDEX_INVALID || maximum_age_ - ages_[coldest] <= threshold_) {
+        return true;
+    }
+
+    // The most worn free block gets the cold data, so it gets to rest while
+    // the young block goes back to work.
+    auto worn = most_worn_free();
+    if (worn == BLOCK_INDEX_INVALID || ages_[worn] <= ages_[coldest]) {
+        return true;
+    }
+
+    free_.set_taken(worn);
+    track(worn);
+
+    if (!storage_->erase(worn)) {
+        return false;
+    }
+
+    if (!migrator.migrate(coldest, AllocatedBlock{ worn, ages_[worn], true })) {
+        free_.set_free(worn);
+        track(worn);
+        return false;
+    }
+
+    if (!free(coldest, ages_[coldest])) {
+        return false;
+    }
+
+    migrations_++;
+
+    return true;
+}
+
+}
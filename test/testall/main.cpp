@@ -6,6 +6,7 @@
 
 int main(int argc, char **argv) {
     auto include_memory_intesive = false;
+    auto include_benchmarks = false;
 
     for (auto i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -19,10 +20,20 @@ int main(int argc, char **argv) {
         if (arg == "--dev") {
             include_memory_intesive = true;
         }
+        if (arg == "--bench") {
+            include_benchmarks = true;
+        }
     }
 
+    std::string excluded;
     if (!include_memory_intesive) {
-        ::testing::GTEST_FLAG(filter) = "-LargeDevices*";
+        excluded += ":LargeDevices*";
+    }
+    if (!include_benchmarks) {
+        excluded += ":Benchmark*";
+    }
+    if (!excluded.empty()) {
+        ::testing::GTEST_FLAG(filter) = "-" + excluded.substr(1);
     }
 
     ::testing::InitGoogleTest(&argc, argv);
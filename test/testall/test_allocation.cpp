@@ -45,3 +45,134 @@ TEST_F(AllocationSuite, FormattingLayoutLargerThanGeometry) {
     ASSERT_FALSE(allocator.allocate(4, files[4], allocation));
 }
 
+
+TEST_F(AllocationSuite, SequentialExtentsAreReturnedWhenLast) {
+    Geometry geometry{ 1024, 4, 4, 512 };
+    SequentialBlockAllocator allocator;
+    ASSERT_TRUE(allocator.initialize(geometry));
+
+    auto extent = allocator.reserve(BlockType::File, 8);
+    ASSERT_EQ(extent.block, (block_index_t)3);
+    ASSERT_EQ(extent.size, (uint32_t)8);
+    ASSERT_EQ(allocator.state().head, (block_index_t)11);
+
+    ASSERT_EQ(extent.take().block, (block_index_t)3);
+    ASSERT_EQ(extent.take().block, (block_index_t)4);
+
+    ASSERT_TRUE(allocator.release(extent));
+    ASSERT_EQ(allocator.state().head, (block_index_t)5);
+
+    // Once something else is allocated the extent's blocks stay taken.
+    extent = allocator.reserve(BlockType::File, 8);
+    ASSERT_EQ(allocator.allocate(BlockType::Leaf).block, (block_index_t)13);
+    ASSERT_TRUE(allocator.release(extent));
+    ASSERT_EQ(allocator.state().head, (block_index_t)14);
+}
+
+TEST_F(AllocationSuite, DefaultExtentsKeepTheBlockAsAllocated) {
+    class AgedBlockManager : public BlockManager {
+    public:
+        block_index_t freed{ BLOCK_INDEX_INVALID };
+        block_age_t freed_age{ 0 };
+
+    public:
+        bool initialize(Geometry &geometry) override {
+            return true;
+        }
+        AllocatorState state() override {
+            return { };
+        }
+        void state(AllocatorState state) override {
+        }
+        AllocatedBlock allocate(BlockType type) override {
+            return { 7, 12, true };
+        }
+        bool free(block_index_t block, block_age_t age) override {
+            freed = block;
+            freed_age = age;
+            return true;
+        }
+    };
+
+    AgedBlockManager manager;
+
+    auto extent = manager.reserve(BlockType::File, 8);
+    ASSERT_EQ(extent.size, (uint32_t)1);
+
+    auto alloc = BlockExtent{ extent }.take();
+    ASSERT_EQ(alloc.block, (block_index_t)7);
+    ASSERT_EQ(alloc.age, (block_age_t)12);
+    ASSERT_TRUE(alloc.erased);
+
+    ASSERT_TRUE(manager.release(extent));
+    ASSERT_EQ(manager.freed, (block_index_t)7);
+    ASSERT_EQ(manager.freed_age, (block_age_t)12);
+}
+
+TEST_F(AllocationSuite, SequentialStreamsHaveTheirOwnFrontiers) {
+    Geometry geometry{ 1024, 4, 4, 512 };
+    SequentialBlockAllocator allocator;
+    allocator.separate_streams(true);
+    ASSERT_TRUE(allocator.initialize(geometry));
+
+    ASSERT_EQ(allocator.allocate(BlockType::File).block, (block_index_t)3);
+    ASSERT_EQ(allocator.allocate(BlockType::Leaf).block, (block_index_t)1023);
+    ASSERT_EQ(allocator.allocate(BlockType::Free).block, (block_index_t)1022);
+    ASSERT_EQ(allocator.allocate(BlockType::File).block, (block_index_t)4);
+
+    auto extent = allocator.reserve(BlockType::Index, 4);
+    ASSERT_EQ(extent.block, (block_index_t)1018);
+    ASSERT_EQ(extent.size, (uint32_t)4);
+
+    // Only extents that are untouched go back, taken blocks sit below the
+    // rest of a hot extent.
+    ASSERT_TRUE(allocator.release(extent));
+    ASSERT_EQ(allocator.state().head, (block_index_t)5);
+    ASSERT_EQ(allocator.state().hot, (block_index_t)1021);
+
+    extent = allocator.reserve(BlockType::Index, 4);
+    ASSERT_EQ(extent.take().block, (block_index_t)1018);
+    ASSERT_TRUE(allocator.release(extent));
+    ASSERT_EQ(allocator.state().hot, (block_index_t)1017);
+
+    SequentialBlockAllocator restored;
+    restored.separate_streams(true);
+    ASSERT_TRUE(restored.initialize(geometry));
+    restored.state(allocator.state());
+    ASSERT_EQ(restored.allocate(BlockType::Leaf).block, (block_index_t)1017);
+    ASSERT_EQ(restored.allocate(BlockType::File).block, (block_index_t)5);
+}
+
+TEST_F(AllocationSuite, SequentialStreamsMeetInTheMiddle) {
+    Geometry geometry{ 16, 4, 4, 512 };
+    SequentialBlockAllocator allocator;
+    allocator.separate_streams(true);
+    ASSERT_TRUE(allocator.initialize(geometry));
+
+    auto extent = allocator.reserve(BlockType::File, 10);
+    ASSERT_EQ(extent.size, (uint32_t)10);
+
+    extent = allocator.reserve(BlockType::Leaf, 10);
+    ASSERT_EQ(extent.block, (block_index_t)13);
+    ASSERT_EQ(extent.size, (uint32_t)3);
+}
+
+TEST_F(AllocationSuite, QueueExtentsAreRunsFromTheFront) {
+    Geometry geometry{ 1024, 4, 4, 512 };
+    QueueBlockAllocator allocator;
+    ASSERT_TRUE(allocator.initialize(geometry));
+
+    auto extent = allocator.reserve(BlockType::File, 8);
+    ASSERT_EQ(extent.block, (block_index_t)3);
+    ASSERT_EQ(extent.size, (uint32_t)8);
+    ASSERT_EQ(allocator.allocate(BlockType::File).block, (block_index_t)11);
+
+    extent.take();
+    ASSERT_TRUE(allocator.release(extent));
+
+    // Released blocks go to the back of the queue.
+    ASSERT_EQ(allocator.reserve(BlockType::File, 2048).size, (uint32_t)(1024 - 12));
+    extent = allocator.reserve(BlockType::File, 8);
+    ASSERT_EQ(extent.block, (block_index_t)4);
+    ASSERT_EQ(extent.size, (uint32_t)7);
+}
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "phylum/block_alloc.h"
+#include "phylum/tree.h"
+#include "phylum/inodes.h"
+#include "phylum/persisted_tree.h"
+#include "phylum/backend_nodes.h"
+#include "phylum/stack_node_cache.h"
+#include "backends/linux_memory/linux_memory.h"
+
+#include "utilities.h"
+
+using namespace phylum;
+
+// These only run when given --bench, see main.cpp.
+class BenchmarkSuite : public ::testing::Test {
+protected:
+    static constexpr size_t NumberOfFiles = 16;
+    static constexpr size_t KeysPerFile = 512;
+
+    template<size_t N>
+    void lookups() {
+        using NodeType = Node<uint64_t, uint64_t, BlockAddress, N, N>;
+
+        Geometry geometry{ 4096, 4, 4, 512 };
+        LinuxMemoryBackend backend;
+        DebuggingBlockAllocator allocator;
+
+        ASSERT_TRUE(backend.initialize(geometry));
+        ASSERT_TRUE(backend.open());
+        ASSERT_TRUE(allocator.initialize(geometry));
+
+        StorageBackendNodeStorage<NodeType> storage{ backend, allocator };
+        MemoryConstrainedNodeCache<NodeType, 16> cache{ storage };
+        PersistedTree<NodeType> tree{ cache };
+
+        std::vector<uint64_t> keys;
+        for (auto file = (uint32_t)0; file < NumberOfFiles; ++file) {
+            for (auto i = (uint32_t)0; i < KeysPerFile; ++i) {
+                keys.push_back(INodeKey((file_id_t)(file * 7919 + 1), i * 8 * 8192));
+            }
+        }
+
+        auto value = (uint64_t)1;
+        for (auto key : keys) {
+            tree.add(key, value++);
+        }
+
+        std::mt19937 rng{ 1 };
+        std::shuffle(keys.begin(), keys.end(), rng);
+
+        auto started = std::chrono::steady_clock::now();
+        for (auto key : keys) {
+            ASSERT_NE(tree.find(key), (uint64_t)0);
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        backend.log().logging(true);
+        for (auto key : keys) {
+            tree.find(key);
+        }
+        backend.log().logging(false);
+
+        auto reads = (double)backend.log().size() / keys.size();
+
+        std::cout << "fanout=" << N << " lookups/s=" << (uint64_t)(keys.size() / elapsed)
+                  << " reads/lookup=" << reads << std::endl;
+
+        ASSERT_TRUE(backend.close());
+    }
+
+    static constexpr size_t OperationsPerThread = 1 << 17;
+
+    // Every thread adds its own keys and then looks up random keys added by
+    // any thread, through the given functions. Returns operations per second.
+    template<typename ADD, typename FIND>
+    double operations(size_t threads, ADD add, FIND find) {
+        auto started = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> workers;
+        for (auto t = (uint64_t)0; t < threads; ++t) {
+            workers.emplace_back([=] {
+                for (auto i = (uint64_t)0; i < OperationsPerThread; ++i) {
+                    auto key = INodeKey((file_id_t)(t + 1), (uint32_t)i);
+                    add(key, i + 1);
+                }
+
+                std::mt19937 rng{ (uint32_t)t };
+                for (auto i = (uint64_t)0; i < OperationsPerThread; ++i) {
+                    auto key = INodeKey((file_id_t)(rng() % threads + 1), (uint32_t)(rng() % OperationsPerThread));
+                    find(key);
+                }
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return threads * OperationsPerThread * 2 / elapsed;
+    }
+};
+
+TEST_F(BenchmarkSuite, LookupsByFanout) {
+    lookups<6>();
+    lookups<12>();
+    lookups<16>();
+    lookups<SectorSizedNode<uint64_t, uint64_t, BlockAddress>::Fanout>();
+}
+
+TEST_F(BenchmarkSuite, ConcurrentTreeScaling) {
+    using ConcurrentTree = ConcurrentBPlusTree<uint64_t, uint64_t, 16, 16>;
+    using LockedTree = BPlusTree<uint64_t, uint64_t, 16, 16>;
+
+    auto maximum = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (auto threads = (size_t)1; threads <= maximum; threads *= 2) {
+        ConcurrentTree concurrent;
+        auto lock_free = operations(threads, [&](uint64_t key, uint64_t value) {
+            concurrent.add(key, value);
+        }, [&](uint64_t key) {
+            return concurrent.lookup(key);
+        });
+
+        // The same work with one mutex around an ordinary tree.
+        std::mutex mutex;
+        LockedTree locked;
+        auto serialized = operations(threads, [&](uint64_t key, uint64_t value) {
+            std::lock_guard<std::mutex> lock{ mutex };
+            locked.add(key, value);
+        }, [&](uint64_t key) {
+            std::lock_guard<std::mutex> lock{ mutex };
+            return locked.lookup(key);
+        });
+
+        std::cout << "threads=" << threads << " concurrent ops/s=" << (uint64_t)lock_free
+                  << " mutex ops/s=" << (uint64_t)serialized << std::endl;
+    }
+}
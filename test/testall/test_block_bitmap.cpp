@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include "phylum/block_bitmap.h"
+
+#include "utilities.h"
+
+using namespace phylum;
+
+class BlockBitmapSuite : public ::testing::Test {
+protected:
+    BlockBitmap map_;
+
+};
+
+TEST_F(BlockBitmapSuite, StartsWithEveryBlockFree) {
+    ASSERT_TRUE(map_.initialize(100));
+
+    ASSERT_EQ(map_.size(), (uint32_t)100);
+    ASSERT_EQ(map_.number_of_free(), (uint32_t)100);
+    ASSERT_EQ(map_.first_free(), (block_index_t)0);
+    ASSERT_TRUE(map_.is_free(99));
+    ASSERT_FALSE(map_.is_free(100));
+}
+
+TEST_F(BlockBitmapSuite, CountsBlocksAsTheyChange) {
+    ASSERT_TRUE(map_.initialize(100));
+
+    map_.set_taken(3);
+    map_.set_taken(3);
+    map_.set_taken(70);
+    ASSERT_EQ(map_.number_of_free(), (uint32_t)98);
+
+    map_.set_free(3);
+    map_.set_free(3);
+    ASSERT_EQ(map_.number_of_free(), (uint32_t)99);
+    ASSERT_TRUE(map_.is_free(3));
+    ASSERT_FALSE(map_.is_free(70));
+}
+
+TEST_F(BlockBitmapSuite, FindsFreeBlocksPastTakenWords) {
+    ASSERT_TRUE(map_.initialize(5000));
+
+    for (auto block = (block_index_t)0; block < 5000; ++block) {
+        map_.set_taken(block);
+    }
+
+    ASSERT_EQ(map_.number_of_free(), (uint32_t)0);
+    ASSERT_EQ(map_.first_free(), BLOCK_INDEX_INVALID);
+
+    map_.set_free(17);
+    map_.set_free(3000);
+    map_.set_free(4999);
+
+    ASSERT_EQ(map_.first_free(), (block_index_t)17);
+    ASSERT_EQ(map_.first_free(18), (block_index_t)3000);
+    ASSERT_EQ(map_.first_free(3001), (block_index_t)4999);
+    ASSERT_EQ(map_.first_free(5000), BLOCK_INDEX_INVALID);
+    ASSERT_EQ(map_.last_free(), (block_index_t)4999);
+
+    map_.set_taken(4999);
+    ASSERT_EQ(map_.last_free(), (block_index_t)3000);
+}
+
+TEST_F(BlockBitmapSuite, NeverFindsBlocksPastTheEnd) {
+    ASSERT_TRUE(map_.initialize(40));
+
+    for (auto block = (block_index_t)0; block < 40; ++block) {
+        map_.set_taken(block);
+    }
+
+    ASSERT_EQ(map_.first_free(), BLOCK_INDEX_INVALID);
+    ASSERT_EQ(map_.first_free(39), BLOCK_INDEX_INVALID);
+    ASSERT_EQ(map_.last_free(), BLOCK_INDEX_INVALID);
+}
+
+TEST_F(BlockBitmapSuite, HundredsOfThousandsOfBlocks) {
+    auto number_of_blocks = (uint32_t)500 * 1000;
+
+    ASSERT_TRUE(map_.initialize(number_of_blocks));
+
+    for (auto block = (block_index_t)0; block < number_of_blocks - 1; ++block) {
+        map_.set_taken(block);
+    }
+
+    ASSERT_EQ(map_.number_of_free(), (uint32_t)1);
+    ASSERT_EQ(map_.first_free(), (block_index_t)(number_of_blocks - 1));
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+#include "phylum/erase_scheduler.h"
+#include "backends/arduino_serial_flash/serial_flash_allocator.h"
+#include "backends/linux_memory/linux_memory.h"
+
+#include "utilities.h"
+
+using namespace phylum;
+
+class EraseSchedulerSuite : public ::testing::Test {
+protected:
+    Geometry geometry_{ 32, 4, 4, 512 };
+    LinuxMemoryBackend storage_;
+    SerialFlashAllocator allocator_{ storage_ };
+
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(storage_.initialize(geometry_));
+        ASSERT_TRUE(storage_.open());
+        ASSERT_TRUE(allocator_.initialize());
+    }
+
+    void TearDown() override {
+        ASSERT_TRUE(storage_.close());
+    }
+
+};
+
+TEST_F(EraseSchedulerSuite, FreesAreDeferred) {
+    EraseScheduler scheduler{ storage_, allocator_ };
+
+    auto block = scheduler.allocate(BlockType::File).block;
+    auto free_before = allocator_.number_of_free_blocks();
+
+    storage_.log().clear();
+
+    ASSERT_TRUE(scheduler.free(block, 0));
+    ASSERT_EQ(scheduler.pending(), (uint32_t)1);
+    ASSERT_EQ(storage_.log().size(), 0);
+    ASSERT_EQ(allocator_.number_of_free_blocks(), free_before);
+
+    ASSERT_TRUE(scheduler.flush());
+    ASSERT_EQ(scheduler.pending(), (uint32_t)0);
+    ASSERT_EQ(scheduler.pooled(), (uint32_t)0);
+    ASSERT_EQ(allocator_.number_of_free_blocks(), free_before + 1);
+}
+
+TEST_F(EraseSchedulerSuite, FreesPastTheQueueAreImmediate) {
+    EraseScheduler scheduler{ storage_, allocator_, 8, 2 };
+
+    for (auto i = 0; i < 3; ++i) {
+        ASSERT_TRUE(scheduler.free(scheduler.allocate(BlockType::File).block, 0));
+    }
+
+    ASSERT_EQ(scheduler.pending(), (uint32_t)2);
+}
+
+TEST_F(EraseSchedulerSuite, AllocatesErasedBlocksFromPool) {
+    EraseScheduler scheduler{ storage_, allocator_, 12 };
+
+    ASSERT_TRUE(scheduler.service());
+    ASSERT_EQ(scheduler.pooled(BlockStream::Cold), (uint32_t)12);
+    ASSERT_EQ(scheduler.pooled(BlockStream::Hot), (uint32_t)12);
+
+    storage_.log().clear();
+
+    for (auto i = 0; i < 12; ++i) {
+        auto alloc = scheduler.allocate(BlockType::File);
+        ASSERT_TRUE(alloc.valid());
+        ASSERT_TRUE(alloc.erased);
+    }
+
+    ASSERT_EQ(storage_.log().size(), 0);
+    ASSERT_EQ(scheduler.misses(), (uint32_t)0);
+
+    auto alloc = scheduler.allocate(BlockType::File);
+    ASSERT_TRUE(alloc.valid());
+    ASSERT_FALSE(alloc.erased);
+    ASSERT_EQ(scheduler.misses(), (uint32_t)1);
+}
+
+TEST_F(EraseSchedulerSuite, ExtentsKeepPooledBlocksErased) {
+    EraseScheduler scheduler{ storage_, allocator_, 4 };
+
+    ASSERT_TRUE(scheduler.service());
+
+    storage_.log().clear();
+
+    auto extent = scheduler.reserve(BlockType::File, 8);
+    ASSERT_EQ(extent.size, (uint32_t)1);
+    ASSERT_TRUE(extent.erased);
+
+    auto alloc = BlockExtent{ extent }.take();
+    ASSERT_TRUE(alloc.erased);
+    ASSERT_EQ(scheduler.pooled(BlockStream::Cold), (uint32_t)3);
+
+    // Never used, so it goes back to the pool as it was.
+    ASSERT_TRUE(scheduler.release(extent));
+    ASSERT_EQ(scheduler.pooled(BlockStream::Cold), (uint32_t)4);
+    ASSERT_EQ(scheduler.pending(), (uint32_t)0);
+    ASSERT_EQ(scheduler.allocate(BlockType::File).block, alloc.block);
+    ASSERT_EQ(storage_.log().size(), 0);
+}
+
+TEST_F(EraseSchedulerSuite, PoolsKeepStreamsApart) {
+    SequentialBlockAllocator sequential;
+    sequential.separate_streams(true);
+
+    EraseScheduler scheduler{ storage_, sequential, 4 };
+    ASSERT_TRUE(scheduler.initialize(geometry_));
+    ASSERT_TRUE(scheduler.service());
+
+    // Cold blocks come up from the start and hot ones down from the end,
+    // even though both were erased ahead of time.
+    auto file = scheduler.allocate(BlockType::File);
+    ASSERT_TRUE(file.erased);
+    ASSERT_EQ(file.block, (block_index_t)3);
+
+    auto leaf = scheduler.allocate(BlockType::Leaf);
+    ASSERT_TRUE(leaf.erased);
+    ASSERT_EQ(leaf.block, (block_index_t)31);
+}
+
+TEST_F(EraseSchedulerSuite, ServiceIsLimitedToErases) {
+    EraseScheduler scheduler{ storage_, allocator_ };
+
+    ASSERT_TRUE(scheduler.free(scheduler.allocate(BlockType::File).block, 0));
+    ASSERT_TRUE(scheduler.free(scheduler.allocate(BlockType::File).block, 0));
+
+    ASSERT_TRUE(scheduler.service(3));
+    ASSERT_EQ(scheduler.pending(), (uint32_t)0);
+    ASSERT_EQ(scheduler.pooled(), (uint32_t)1);
+}
+
+TEST_F(EraseSchedulerSuite, StopsRefillingWhenAllocatorIsEmpty) {
+    EraseScheduler scheduler{ storage_, allocator_, 64 };
+
+    ASSERT_TRUE(scheduler.service());
+    ASSERT_EQ(scheduler.pooled(), (uint32_t)(32 - 3));
+    ASSERT_EQ(allocator_.number_of_free_blocks(), (uint32_t)0);
+}
+
+TEST_F(EraseSchedulerSuite, WorkerRefillsPool) {
+    EraseScheduler scheduler{ storage_, allocator_ };
+
+    ASSERT_TRUE(scheduler.start());
+
+    auto filled = EraseScheduler::DefaultPoolSize * 2;
+    auto waited = 0;
+    while (scheduler.pooled() < filled && waited++ < 1000) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    ASSERT_EQ(scheduler.pooled(), filled);
+
+    std::vector<block_index_t> blocks;
+    for (auto i = 0; i < 4; ++i) {
+        auto alloc = scheduler.allocate(BlockType::File);
+        ASSERT_TRUE(alloc.erased);
+        blocks.push_back(alloc.block);
+    }
+
+    for (auto block : blocks) {
+        ASSERT_TRUE(scheduler.free(block, 0));
+    }
+
+    waited = 0;
+    while ((scheduler.pending() > 0 || scheduler.pooled() < filled) && waited++ < 1000) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    scheduler.stop();
+
+    ASSERT_EQ(scheduler.pending(), (uint32_t)0);
+    ASSERT_EQ(scheduler.pooled(), filled);
+    ASSERT_EQ(scheduler.misses(), (uint32_t)0);
+}
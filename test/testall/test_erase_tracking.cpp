@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include "phylum/erase_tracking_storage.h"
+#include "phylum/file_system.h"
+#include "backends/arduino_serial_flash/serial_flash_allocator.h"
+#include "backends/linux_memory/linux_memory.h"
+
+#include "utilities.h"
+
+using namespace phylum;
+
+class EraseTrackingSuite : public ::testing::Test {
+protected:
+    Geometry geometry_{ 1024, 4, 4, 512 };
+    LinuxMemoryBackend target_;
+    EraseTrackingStorage storage_{ target_ };
+
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(target_.initialize(geometry_));
+        ASSERT_TRUE(storage_.open());
+    }
+
+    void TearDown() override {
+        ASSERT_TRUE(storage_.close());
+    }
+
+    size_t number_of_erases() {
+        auto erases = (size_t)0;
+        for (auto &entry : target_.log().entries()) {
+            if (entry.type() == OperationType::EraseBlock) {
+                erases++;
+            }
+        }
+        return erases;
+    }
+
+};
+
+TEST_F(EraseTrackingSuite, NothingIsKnownWhenOpened) {
+    ASSERT_FALSE(storage_.is_erased(10));
+
+    ASSERT_TRUE(storage_.erase(10));
+
+    ASSERT_TRUE(storage_.is_erased(10));
+    ASSERT_EQ(number_of_erases(), (size_t)1);
+    ASSERT_EQ(storage_.statistics().erases, (uint32_t)1);
+}
+
+TEST_F(EraseTrackingSuite, SkipsErasingBlankBlocks) {
+    ASSERT_TRUE(storage_.erase(10));
+    ASSERT_TRUE(storage_.erase(10));
+
+    ASSERT_EQ(number_of_erases(), (size_t)1);
+    ASSERT_EQ(storage_.statistics().erases, (uint32_t)1);
+    ASSERT_EQ(storage_.statistics().avoided, (uint32_t)1);
+}
+
+TEST_F(EraseTrackingSuite, WritingForgetsBlockWasErased) {
+    uint8_t data[16] = { 0x1 };
+
+    ASSERT_TRUE(storage_.erase(10));
+    ASSERT_TRUE(storage_.write({ 10, 512 }, data, sizeof(data)));
+    ASSERT_FALSE(storage_.is_erased(10));
+    ASSERT_TRUE(storage_.erase(10));
+
+    ASSERT_EQ(number_of_erases(), (size_t)2);
+    ASSERT_EQ(storage_.statistics().avoided, (uint32_t)0);
+}
+
+TEST_F(EraseTrackingSuite, PreallocatedBlocksAreErasedOnce) {
+    SerialFlashAllocator allocator{ storage_ };
+    ASSERT_TRUE(allocator.initialize());
+    ASSERT_TRUE(allocator.preallocate(1));
+
+    target_.log().clear();
+
+    auto alloc = allocator.allocate(BlockType::File);
+    ASSERT_TRUE(alloc.erased);
+
+    // Writers that don't look at erased still don't erase again.
+    ASSERT_TRUE(storage_.erase(alloc.block));
+    ASSERT_EQ(number_of_erases(), (size_t)0);
+}
+
+TEST_F(EraseTrackingSuite, FreeingUnusedBlocksSkipsErase) {
+    SerialFlashAllocator allocator{ storage_ };
+    ASSERT_TRUE(allocator.initialize());
+    ASSERT_TRUE(allocator.preallocate(1));
+
+    auto alloc = allocator.allocate(BlockType::File);
+    auto avoided = storage_.statistics().avoided;
+
+    ASSERT_TRUE(allocator.free(alloc.block, 0));
+
+    ASSERT_EQ(storage_.statistics().avoided, avoided + 1);
+    ASSERT_FALSE(storage_.is_erased(alloc.block));
+}
+
+TEST_F(EraseTrackingSuite, FileSystemOnTop) {
+    DebuggingBlockAllocator allocator;
+    FileSystem fs{ storage_, allocator };
+
+    ASSERT_TRUE(fs.mount(true));
+
+    PatternHelper helper;
+    auto file = fs.open("test.bin");
+    helper.write(file, (geometry_.block_size() * 4) / helper.size());
+    file.close();
+
+    auto reading = fs.open("test.bin", true);
+    ASSERT_EQ(helper.read(reading), (uint32_t)helper.bytes_written());
+    reading.close();
+
+    ASSERT_TRUE(fs.unmount());
+
+    ASSERT_EQ(storage_.statistics().erases, (uint32_t)number_of_erases());
+}
+
+TEST_F(EraseTrackingSuite, FreePileKeepsBlocksErased) {
+    DebuggingBlockAllocator allocator;
+    FileSystem fs{ storage_, allocator };
+
+    ASSERT_TRUE(fs.mount(true));
+
+    PatternHelper helper;
+    auto writing = fs.open("test.bin");
+    helper.write(writing, (geometry_.block_size() * 2) / helper.size());
+    writing.close();
+
+    ASSERT_TRUE(fs.remove("test.bin"));
+
+    // Removing erases the file's blocks, and when they're given back
+    // unused, like those left in a writer's extent, they stay erased.
+    auto extent = fs.fpm().reserve(BlockType::File, 8);
+    ASSERT_TRUE(extent.valid());
+    ASSERT_TRUE(extent.erased);
+    for (auto i = (uint32_t)0; i < extent.size; ++i) {
+        ASSERT_TRUE(storage_.is_erased(extent.block + i));
+    }
+    ASSERT_TRUE(fs.fpm().release(extent));
+
+    target_.log().clear();
+
+    auto again = fs.open("again.bin");
+    helper.write(again, (geometry_.block_size() * extent.size) / helper.size());
+    again.close();
+
+    for (auto &entry : target_.log().entries()) {
+        if (entry.type() == OperationType::EraseBlock) {
+            ASSERT_TRUE(entry.address().block < extent.block || entry.address().block >= extent.block + extent.size);
+        }
+    }
+
+    ASSERT_EQ(storage_.statistics().avoided, (uint32_t)0);
+
+    ASSERT_TRUE(fs.unmount());
+}
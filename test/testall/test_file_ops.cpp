@@ -2,6 +2,7 @@
 #include <cstring>
 
 #include "phylum/file_system.h"
+#include "phylum/erase_tracking_storage.h"
 #include "backends/linux_memory/linux_memory.h"
 
 #include "utilities.h"
@@ -16,7 +17,7 @@ static void read_and_verify_pattern(OpenFile &file, uint8_t *pattern,
 
 class FileOpsSuite : public ::testing::Test {
 protected:
-    Geometry geometry_{ 1024, 4, 4, 512 };
+    Geometry geometry_{ 2048, 4, 4, 512 };
     LinuxMemoryBackend storage_;
     DebuggingBlockAllocator allocator_;
     FileSystem fs_{ storage_, allocator_ };
@@ -54,6 +55,43 @@ TEST_F(FileOpsSuite, MountingFindsPreviousTree) {
     ASSERT_TRUE(fs_.exists("test.bin"));
 }
 
+TEST_F(FileOpsSuite, PositionKeysSpanLargeFiles) {
+    auto id = INodeKey::file_id("test.bin");
+    auto gigabyte = (uint64_t)1024 * 1024 * 1024;
+    auto large = 5 * gigabyte + 100;
+
+    ASSERT_EQ(INodeKey::file_position(id, 0), INodeKey::file_beginning(id));
+    ASSERT_LT(INodeKey::file_position(id, 4 * gigabyte), INodeKey::file_position(id, large));
+    ASSERT_EQ(INodeKey(INodeKey::file_position(id, large)).upper(), id);
+
+    // Saved positions are only found when looking for ones at or after them.
+    ASSERT_LT(INodeKey::file_position(id, large), INodeKey::file_following(id, large + 256));
+    ASSERT_GE(INodeKey::file_position(id, large), INodeKey::file_following(id, large - 1));
+    ASSERT_EQ(INodeKey::file_following(id, UINT64_MAX), INodeKey::file_maximum(id));
+}
+
+TEST_F(FileOpsSuite, MissingFilesAreFoundWithoutReading) {
+    for (auto name : { "test-1.bin", "test-2.bin", "test-3.bin" }) {
+        auto file = fs_.open(name);
+        file.close();
+    }
+
+    for (auto i = 0; i < 2; ++i) {
+        storage_.log().clear();
+        ASSERT_FALSE(fs_.exists("missing.bin"));
+        auto missing = fs_.open("missing.bin", true);
+        ASSERT_FALSE(missing.open());
+        ASSERT_EQ(storage_.log().size(), (size_t)0);
+
+        ASSERT_TRUE(fs_.exists("test-2.bin"));
+        auto found = fs_.open("test-3.bin", true);
+        ASSERT_TRUE(found.open());
+
+        // The filter is rebuilt from the tree when mounting.
+        ASSERT_TRUE(fs_.mount());
+    }
+}
+
 TEST_F(FileOpsSuite, WriteFile) {
     ASSERT_FALSE(fs_.exists("test.bin"));
 
@@ -289,7 +327,7 @@ TEST_F(FileOpsSuite, Write128BlocksAndCalculateLength) {
     auto reading = fs_.open("test.bin", true);
     storage_.log().clear();
     ASSERT_EQ(reading.size(), (uint32_t)(total_writing));
-    ASSERT_EQ(storage_.log().size(), 19);
+    ASSERT_EQ(storage_.log().size(), 34);
     reading.close();
 }
 
@@ -310,7 +348,7 @@ TEST_F(FileOpsSuite, Write128BlocksAndSeekToEoF) {
 
     auto reading = fs_.open("test.bin", true);
     ASSERT_EQ(reading.seek(Seek::End), (int32_t)total_writing);
-    ASSERT_EQ(storage_.log().size(), 19);
+    ASSERT_EQ(storage_.log().size(), 34);
 
     storage_.log().clear();
     ASSERT_EQ(reading.size(), (uint32_t)(total_writing));
@@ -319,6 +357,51 @@ TEST_F(FileOpsSuite, Write128BlocksAndSeekToEoF) {
     reading.close();
 }
 
+TEST_F(FileOpsSuite, SeekingIsCheapAfterTheFirstWalk) {
+    uint8_t pattern[] = { 'a', 's', 'd', 'f' };
+
+    auto total_writing = (int32_t)(geometry_.block_size() * 128);
+
+    auto wrote = 0;
+    auto writing = fs_.open("test.bin");
+    write_pattern(writing, pattern, sizeof(pattern), total_writing, wrote);
+    writing.close();
+
+    // Appending saved positions sparsely, so the first seek walks a while.
+    storage_.log().clear();
+    auto reading = fs_.open("test.bin", true);
+    ASSERT_EQ(reading.seek(Seek::End), (int32_t)total_writing);
+    auto walking = storage_.log().size();
+
+    // Going back into blocks this handle has seen uses those instead.
+    storage_.log().clear();
+    ASSERT_EQ(reading.seek(total_writing - 100), (int32_t)(total_writing - 100));
+    ASSERT_LE(storage_.log().size(), (size_t)(geometry_.sectors_per_block() + 4));
+    reading.close();
+
+    // Readers leave saving positions to writers, so other readers walk as
+    // far again and nothing was written.
+    auto journal = fs_.journal().location();
+    storage_.log().clear();
+    auto again = fs_.open("test.bin", true);
+    ASSERT_EQ(again.seek(Seek::End), (int32_t)total_writing);
+    ASSERT_EQ(storage_.log().size(), walking);
+    ASSERT_EQ(fs_.journal().location(), journal);
+    again.close();
+
+    // Writers save the one for the block they walked to, so after them
+    // readers find it in the tree.
+    auto appending = fs_.open("test.bin");
+    appending.close();
+
+    storage_.log().clear();
+    auto after = fs_.open("test.bin", true);
+    ASSERT_EQ(after.seek(Seek::End), (int32_t)total_writing);
+    ASSERT_LT(storage_.log().size(), walking);
+    ASSERT_LE(storage_.log().size(), (size_t)(geometry_.sectors_per_block() + 4));
+    after.close();
+}
+
 TEST_F(FileOpsSuite, Write128BlocksAndSeekToMiddle) {
     uint8_t pattern[] = { 'a', 's', 'd', 'f' };
 
@@ -340,19 +423,56 @@ TEST_F(FileOpsSuite, Write128BlocksAndSeekToMiddle) {
     reading.close();
 }
 
+TEST_F(FileOpsSuite, ConcurrentWritersGetContiguousBlocks) {
+    uint8_t pattern[] = { 'a', 's', 'd', 'f' };
+
+    auto wrote = 0;
+    auto first = fs_.open("test-1.bin");
+    auto second = fs_.open("test-2.bin");
+    for (auto i = 0; i < 4 * geometry_.sectors_per_block(); ++i) {
+        write_pattern(first, pattern, sizeof(pattern), SectorSize, wrote);
+        write_pattern(second, pattern, sizeof(pattern), SectorSize, wrote);
+    }
+    first.close();
+    second.close();
+
+    // Each file's blocks are one run, rather than alternating.
+    auto changes = 0;
+    auto previous = FILE_ID_INVALID;
+    for (auto block = (block_index_t)0; block < allocator_.state().head; ++block) {
+        FileBlockHead head;
+        ASSERT_TRUE(storage_.read({ block, 0 }, &head, sizeof(FileBlockHead)));
+        if (head.valid() && head.block.type == BlockType::File) {
+            if (previous != FILE_ID_INVALID && head.file_id != previous) {
+                changes++;
+            }
+            previous = head.file_id;
+        }
+    }
+
+    ASSERT_EQ(changes, 1);
+}
+
 TEST_F(FileOpsSuite, MountingFindsPreviousTreeBlocks) {
     uint8_t pattern[] = { 'a', 's', 'd', 'f' };
 
-    auto total_writing = (int32_t)(geometry_.block_size() * 512);
+    auto total_writing = (int32_t)(geometry_.block_size() * 1400);
 
     auto wrote = 0;
 
+    // Enough positions to fill a few leaf blocks.
+    fs_.position_policy({ 8, 8, 8 });
+
     auto writing1 = fs_.open("test-1.bin");
     write_pattern(writing1, pattern, sizeof(pattern), total_writing, wrote);
     writing1.close();
 
     ASSERT_TRUE(fs_.exists("test-1.bin"));
 
+    // Positions are buffered until they're flushed, which would otherwise
+    // happen after second_fs has started using the same blocks.
+    ASSERT_TRUE(fs_.flush());
+
     // BlockHelper helper1{ storage_, allocator_ };
     // helper1.dump(0, allocator_.state().head);
 
@@ -380,7 +500,291 @@ TEST_F(FileOpsSuite, MountingFindsPreviousTreeBlocks) {
     ASSERT_EQ(helper.number_of_chains(BlockType::File, 0, last_block), 4);
 
     ASSERT_GT(helper.number_of_blocks(BlockType::Leaf, 0, last_block), 1);
-    ASSERT_GT(helper.number_of_blocks(BlockType::Index, 0, last_block), 1);
+    // Positions are added to the tree in batches, which rarely fill more than
+    // a single index block.
+    ASSERT_GE(helper.number_of_blocks(BlockType::Index, 0, last_block), 1);
+}
+
+struct CollectingFileVisitor : FileVisitor {
+    std::vector<FileInfo> files;
+
+    void file(FileInfo info) override {
+        files.push_back(info);
+    }
+};
+
+struct CollectingPositionVisitor : PositionVisitor {
+    std::vector<PositionInfo> positions;
+
+    void position(PositionInfo info) override {
+        positions.push_back(info);
+    }
+};
+
+TEST_F(FileOpsSuite, ListFiles) {
+    uint8_t pattern[] = { 'a', 's', 'd', 'f' };
+
+    std::set<file_id_t> expected;
+
+    for (auto name : { "test-1.bin", "test-2.bin", "test-3.bin", "test-4.bin" }) {
+        auto wrote = 0;
+        auto writing = fs_.open(name);
+        write_pattern(writing, pattern, sizeof(pattern), geometry_.block_size() * 10, wrote);
+        writing.close();
+        expected.insert(INodeKey::file_id(name));
+    }
+
+    CollectingFileVisitor visitor;
+    ASSERT_TRUE(fs_.list(visitor));
+
+    ASSERT_EQ(visitor.files.size(), expected.size());
+
+    auto iter = expected.begin();
+    for (auto &info : visitor.files) {
+        ASSERT_EQ(info.id, *iter++);
+        ASSERT_TRUE(info.head.valid());
+    }
+
+    // Listing leaves the tree usable.
+    ASSERT_TRUE(fs_.exists("test-3.bin"));
+}
+
+TEST_F(FileOpsSuite, ListPositions) {
+    uint8_t pattern[] = { 'a', 's', 'd', 'f' };
+
+    auto wrote = 0;
+    auto writing = fs_.open("test.bin");
+    write_pattern(writing, pattern, sizeof(pattern), geometry_.block_size() * 32, wrote);
+    writing.close();
+
+    auto other = fs_.open("other.bin");
+    write_pattern(other, pattern, sizeof(pattern), geometry_.block_size() * 32, wrote);
+    other.close();
+
+    CollectingPositionVisitor visitor;
+    ASSERT_TRUE(fs_.positions(INodeKey::file_id("test.bin"), visitor));
+
+    // The beginning of the file and then one every few blocks.
+    ASSERT_GT(visitor.positions.size(), (size_t)1);
+    ASSERT_EQ(visitor.positions[0].position, (uint32_t)0);
+
+    auto previous = 0u;
+    for (auto i = 1u; i < visitor.positions.size(); ++i) {
+        ASSERT_GT(visitor.positions[i].position, previous);
+        ASSERT_TRUE(visitor.positions[i].address.valid());
+        previous = visitor.positions[i].position;
+    }
+
+    CollectingPositionVisitor missing;
+    ASSERT_TRUE(fs_.positions(INodeKey::file_id("missing.bin"), missing));
+    ASSERT_EQ(missing.positions.size(), (size_t)0);
+}
+
+TEST_F(FileOpsSuite, RemoveFile) {
+    uint8_t pattern[] = { 'a', 's', 'd', 'f' };
+
+    for (auto name : { "test-1.bin", "test-2.bin", "test-3.bin" }) {
+        auto wrote = 0;
+        auto writing = fs_.open(name);
+        write_pattern(writing, pattern, sizeof(pattern), geometry_.block_size() * 20, wrote);
+        writing.close();
+    }
+
+    ASSERT_TRUE(fs_.remove("test-2.bin"));
+    ASSERT_FALSE(fs_.remove("test-2.bin"));
+
+    ASSERT_TRUE(fs_.exists("test-1.bin"));
+    ASSERT_FALSE(fs_.exists("test-2.bin"));
+    ASSERT_TRUE(fs_.exists("test-3.bin"));
+
+    CollectingFileVisitor files;
+    ASSERT_TRUE(fs_.list(files));
+    ASSERT_EQ(files.files.size(), (size_t)2);
+
+    CollectingPositionVisitor positions;
+    ASSERT_TRUE(fs_.positions(INodeKey::file_id("test-2.bin"), positions));
+    ASSERT_EQ(positions.positions.size(), (size_t)0);
+
+    auto read = 0;
+    auto reading = fs_.open("test-3.bin", true);
+    read_and_verify_pattern(reading, pattern, sizeof(pattern), read);
+    reading.close();
+
+    ASSERT_EQ(read, (int32_t)geometry_.block_size() * 20);
+}
+
+TEST_F(FileOpsSuite, RemoveSavesTheTreeBeforeFreeingBlocks) {
+    uint8_t pattern[] = { 'a', 's', 'd', 'f' };
+
+    for (auto name : { "test-1.bin", "test-2.bin" }) {
+        auto wrote = 0;
+        auto writing = fs_.open(name);
+        write_pattern(writing, pattern, sizeof(pattern), geometry_.block_size() * 20, wrote);
+        writing.close();
+    }
+
+    ASSERT_TRUE(fs_.remove("test-2.bin"));
+
+    // As though we lost power right after, the saved tree already has none
+    // of the removed file's keys.
+    DebuggingBlockAllocator second_allocator;
+    FileSystem second_fs{ storage_, second_allocator };
+    ASSERT_TRUE(second_fs.mount());
+
+    ASSERT_TRUE(second_fs.exists("test-1.bin"));
+    ASSERT_FALSE(second_fs.exists("test-2.bin"));
+
+    CollectingPositionVisitor positions;
+    ASSERT_TRUE(second_fs.positions(INodeKey::file_id("test-2.bin"), positions));
+    ASSERT_EQ(positions.positions.size(), (size_t)0);
+}
+
+TEST_F(FileOpsSuite, SeekingToTheEndFailsWhenHeadsCantBeRead) {
+    class FailingHeadReads : public EraseTrackingStorage {
+    public:
+        block_index_t failing{ BLOCK_INDEX_INVALID };
+
+    public:
+        FailingHeadReads(StorageBackend &target) : EraseTrackingStorage(target) {
+        }
+
+    public:
+        bool read(BlockAddress addr, void *d, size_t n) override {
+            if (addr.block == failing && addr.position == 0) {
+                return false;
+            }
+            return EraseTrackingStorage::read(addr, d, n);
+        }
+    };
+
+    uint8_t pattern[] = { 'a', 's', 'd', 'f' };
+
+    FailingHeadReads storage{ storage_ };
+    DebuggingBlockAllocator allocator;
+    FileSystem fs{ storage, allocator };
+    ASSERT_TRUE(storage.open());
+    ASSERT_TRUE(fs.mount(true));
+
+    auto wrote = 0;
+    auto writing = fs.open("test.bin");
+    write_pattern(writing, pattern, sizeof(pattern), geometry_.block_size() * 20, wrote);
+    writing.close();
+
+    CollectingPositionVisitor saved;
+    ASSERT_TRUE(fs.positions(INodeKey::file_id("test.bin"), saved));
+    ASSERT_GT(saved.positions.size(), (size_t)1);
+
+    storage.failing = saved.positions.back().address.block;
+
+    auto reading = fs.open("test.bin", true);
+    ASSERT_EQ(reading.seek(Seek::End), INT64_MAX);
+    reading.close();
+}
+
+TEST_F(FileOpsSuite, PositionsAreBufferedUntilFlushed) {
+    uint8_t pattern[] = { 'a', 's', 'd', 'f' };
+
+    auto wrote = 0;
+    auto writing = fs_.open("test.bin");
+    write_pattern(writing, pattern, sizeof(pattern), geometry_.block_size() * 64, wrote);
+    writing.close();
+
+    CollectingPositionVisitor buffered;
+    ASSERT_TRUE(fs_.positions(INodeKey::file_id("test.bin"), buffered));
+    ASSERT_GT(buffered.positions.size(), (size_t)1);
+
+    ASSERT_TRUE(fs_.flush());
+
+    DebuggingBlockAllocator second_allocator;
+    FileSystem second_fs{ storage_, second_allocator };
+    ASSERT_TRUE(second_fs.mount());
+
+    CollectingPositionVisitor saved;
+    ASSERT_TRUE(second_fs.positions(INodeKey::file_id("test.bin"), saved));
+    ASSERT_EQ(saved.positions.size(), buffered.positions.size());
+    for (auto i = (size_t)0; i < saved.positions.size(); ++i) {
+        ASSERT_EQ(saved.positions[i].position, buffered.positions[i].position);
+    }
+}
+
+TEST_F(FileOpsSuite, StreamsKeepFileBlocksAwayFromTheTree) {
+    uint8_t pattern[] = { 'a', 's', 'd', 'f' };
+
+    DebuggingBlockAllocator allocator;
+    allocator.separate_streams(true);
+    FileSystem fs{ storage_, allocator };
+    ASSERT_TRUE(fs.mount(true));
+
+    auto total_writing = (int32_t)(geometry_.block_size() * 32);
+
+    auto wrote = 0;
+    auto writing = fs.open("test.bin");
+    write_pattern(writing, pattern, sizeof(pattern), total_writing, wrote);
+    writing.close();
+
+    auto files = allocator.blocks_of_type(BlockType::File);
+    auto leaves = allocator.blocks_of_type(BlockType::Leaf);
+    ASSERT_FALSE(files.empty());
+    ASSERT_FALSE(leaves.empty());
+    ASSERT_LT(*files.rbegin(), *leaves.begin());
+
+    {
+        auto read = 0;
+        auto reading = fs.open("test.bin", true);
+        read_and_verify_pattern(reading, pattern, sizeof(pattern), read);
+        reading.close();
+        ASSERT_EQ(read, wrote);
+    }
+
+    // As though we lost power, both frontiers are found again.
+    DebuggingBlockAllocator second_allocator;
+    second_allocator.separate_streams(true);
+    FileSystem second_fs{ storage_, second_allocator };
+    ASSERT_TRUE(second_fs.mount());
+
+    ASSERT_EQ(second_allocator.state().head, allocator.state().head);
+    ASSERT_EQ(second_allocator.state().hot, allocator.state().hot);
+
+    auto read = 0;
+    auto reading = second_fs.open("test.bin", true);
+    read_and_verify_pattern(reading, pattern, sizeof(pattern), read);
+    reading.close();
+    ASSERT_EQ(read, wrote);
+}
+
+TEST_F(FileOpsSuite, JournalKeepsPositionsAfterLostPower) {
+    uint8_t pattern[] = { 'a', 's', 'd', 'f' };
+
+    auto total_writing = (int32_t)(geometry_.block_size() * 64);
+
+    auto wrote = 0;
+    auto writing = fs_.open("test.bin");
+    write_pattern(writing, pattern, sizeof(pattern), total_writing, wrote);
+    writing.close();
+
+    CollectingPositionVisitor saved;
+    ASSERT_TRUE(fs_.positions(INodeKey::file_id("test.bin"), saved));
+    ASSERT_GT(saved.positions.size(), (size_t)1);
+
+    // As though we lost power before flushing.
+    DebuggingBlockAllocator second_allocator;
+    FileSystem second_fs{ storage_, second_allocator };
+    ASSERT_TRUE(second_fs.mount());
+
+    ASSERT_EQ(second_allocator.state().head, allocator_.state().head);
+
+    CollectingPositionVisitor replayed;
+    ASSERT_TRUE(second_fs.positions(INodeKey::file_id("test.bin"), replayed));
+    ASSERT_EQ(replayed.positions.size(), saved.positions.size());
+
+    // Seeking only walks the blocks written since the last position.
+    storage_.log().clear();
+    auto reading = second_fs.open("test.bin", true);
+    ASSERT_EQ(reading.seek(Seek::End), total_writing);
+    ASSERT_LT(storage_.log().size(), (size_t)(geometry_.sectors_per_block() * 16));
+    reading.close();
+
+    ASSERT_TRUE(fs_.mount());
 }
 
 static void write_pattern(OpenFile &file, uint8_t *pattern, int32_t pattern_length,
@@ -26,6 +26,14 @@ protected:
         ASSERT_TRUE(fs_.unmount());
     }
 
+    void write_head(block_index_t block, BlockType type, block_age_t age = 0) {
+        BlockHead head{ type };
+        head.fill();
+        head.age = age;
+        ASSERT_TRUE(storage_.erase(block));
+        ASSERT_TRUE(storage_.write({ block, 0 }, &head, sizeof(BlockHead)));
+    }
+
 };
 
 TEST_F(FreePileSuite, CreatesEmptyFreePile) {
@@ -76,3 +84,178 @@ TEST_F(FreePileSuite, FindsEndOfFreePileFromFirstBlock) {
 
     ASSERT_EQ(fpm.location(), after);
 }
+
+TEST_F(FreePileSuite, FindsEndOfFreePileFromLastBlockQuickly) {
+    auto entry_size = (int32_t)sizeof(FreePileEntry);
+    auto entries_per_block = (int32_t)geometry_.block_size() / entry_size;
+
+    for (auto i = 0; i < 3 * entries_per_block + 6; ++i) {
+        ASSERT_TRUE(fs_.fpm().free((block_index_t)(600 + i % 400)));
+    }
+
+    auto file = fs_.open("test.bin");
+    file.close();
+
+    auto after = fs_.fpm().location();
+    ASSERT_EQ(fs_.sb().free_tail, after.block);
+
+    storage_.log().clear();
+
+    FreePileManager fpm{ storage_, allocator_ };
+    ASSERT_TRUE(fpm.locate(fs_.sb().free_tail));
+
+    ASSERT_EQ(fpm.location(), after);
+
+    // Head, tail, bisecting the sectors and then the last one with entries,
+    // and the first one to find those that haven't been taken.
+    ASSERT_LE(storage_.log().size(), (size_t)9);
+}
+
+TEST_F(FreePileSuite, FreedBlocksAreTakenInOrder) {
+    write_head(601, BlockType::File);
+    write_head(602, BlockType::File);
+
+    ASSERT_TRUE(fs_.fpm().free(600));
+    ASSERT_TRUE(fs_.fpm().free(601));
+    ASSERT_TRUE(fs_.fpm().free(602));
+    ASSERT_TRUE(fs_.fpm().free(700));
+
+    ASSERT_EQ(fs_.fpm().allocate(BlockType::Leaf).block, (block_index_t)600);
+
+    auto extent = fs_.fpm().reserve(BlockType::File, 8);
+    ASSERT_EQ(extent.block, (block_index_t)601);
+    ASSERT_EQ(extent.size, (uint32_t)2);
+
+    ASSERT_EQ(fs_.fpm().allocate(BlockType::Leaf).block, (block_index_t)700);
+    ASSERT_TRUE(fs_.fpm().empty());
+
+    auto head = allocator_.state().head;
+    ASSERT_EQ(fs_.fpm().allocate(BlockType::Leaf).block, head);
+}
+
+TEST_F(FreePileSuite, FreedBlocksAreTakenForTheirStream) {
+    write_head(600, BlockType::File);
+    write_head(601, BlockType::File);
+    write_head(602, BlockType::File);
+    write_head(700, BlockType::Leaf);
+
+    ASSERT_TRUE(fs_.fpm().free(600));
+    ASSERT_TRUE(fs_.fpm().free(700));
+    ASSERT_TRUE(fs_.fpm().free(601));
+    ASSERT_TRUE(fs_.fpm().free(602));
+
+    // Hot blocks in between don't break up runs of cold ones.
+    auto extent = fs_.fpm().reserve(BlockType::File, 2);
+    ASSERT_EQ(extent.block, (block_index_t)600);
+    ASSERT_EQ(extent.size, (uint32_t)2);
+
+    ASSERT_EQ(fs_.fpm().allocate(BlockType::Index).block, (block_index_t)700);
+    ASSERT_EQ(fs_.fpm().allocate(BlockType::File).block, (block_index_t)602);
+
+    auto head = allocator_.state().head;
+    ASSERT_EQ(fs_.fpm().allocate(BlockType::Leaf).block, head);
+    ASSERT_EQ(fs_.fpm().allocate(BlockType::File).block, head + 1);
+}
+
+TEST_F(FreePileSuite, FreedBlocksKeepTheirAges) {
+    write_head(600, BlockType::Leaf, 5);
+
+    ASSERT_TRUE(fs_.fpm().free(600));
+    ASSERT_TRUE(fs_.fpm().free(601, 2));
+
+    auto first = fs_.fpm().allocate(BlockType::Leaf);
+    ASSERT_EQ(first.block, (block_index_t)600);
+    ASSERT_EQ(first.age, (block_age_t)6);
+    ASSERT_FALSE(first.erased);
+
+    auto second = fs_.fpm().allocate(BlockType::Leaf);
+    ASSERT_EQ(second.block, (block_index_t)601);
+    ASSERT_EQ(second.age, (block_age_t)3);
+
+    // Unused blocks come back as old as they went out.
+    ASSERT_TRUE(fs_.fpm().release(BlockExtent{ AllocatedBlock{ 602, 7, false } }));
+    ASSERT_EQ(fs_.fpm().allocate(BlockType::File).age, (block_age_t)7);
+}
+
+TEST_F(FreePileSuite, TakenBlocksStayTakenAfterLocating) {
+    ASSERT_TRUE(fs_.fpm().free(600));
+    ASSERT_TRUE(fs_.fpm().free(601));
+
+    ASSERT_EQ(fs_.fpm().allocate(BlockType::Leaf).block, (block_index_t)600);
+
+    FreePileManager fpm{ storage_, allocator_ };
+    ASSERT_TRUE(fpm.locate(fs_.sb().free, fs_.fpm().location().block));
+
+    ASSERT_EQ(fpm.cursor(), fs_.fpm().cursor());
+    ASSERT_EQ(fpm.allocate(BlockType::Leaf).block, (block_index_t)601);
+}
+
+TEST_F(FreePileSuite, CheckpointDropsBlocksThatHaveAllBeenTaken) {
+    auto entry_size = (int32_t)sizeof(FreePileEntry);
+    auto entries_per_block = (int32_t)geometry_.block_size() / entry_size;
+    auto first = fs_.sb().free;
+
+    for (auto i = 0; i < entries_per_block + 6; ++i) {
+        ASSERT_TRUE(fs_.fpm().free((block_index_t)(600 + i % 400)));
+    }
+
+    for (auto i = 0; i < entries_per_block; ++i) {
+        ASSERT_TRUE(fs_.fpm().allocate(BlockType::Leaf).valid());
+    }
+
+    ASSERT_NE(fs_.fpm().cursor().block, first);
+
+    auto file = fs_.open("test.bin");
+    file.close();
+
+    ASSERT_NE(fs_.sb().free, first);
+    ASSERT_EQ(fs_.sb().free, fs_.fpm().cursor().block);
+
+    ASSERT_TRUE(fs_.mount());
+    ASSERT_EQ(fs_.sb().free, fs_.fpm().cursor().block);
+}
+
+TEST_F(FreePileSuite, WritersDontEraseReusedBlocks) {
+    PatternHelper helper;
+
+    for (auto i = 0; i < 4; ++i) {
+        auto name = "file-" + std::to_string(i) + ".bin";
+        auto file = fs_.open(name.c_str());
+        helper.write(file, (geometry_.block_size() * 2) / helper.size());
+        file.close();
+    }
+
+    for (auto i = 0; i < 4; ++i) {
+        auto name = "file-" + std::to_string(i) + ".bin";
+        ASSERT_TRUE(fs_.remove(name.c_str()));
+    }
+
+    ASSERT_TRUE(fs_.gc());
+
+    // Anything before the allocator's head was used before, and so came
+    // back from the pile.
+    auto head = allocator_.state().head;
+
+    storage_.log().clear();
+
+    for (auto i = 0; i < 4; ++i) {
+        auto name = "again-" + std::to_string(i) + ".bin";
+        auto file = fs_.open(name.c_str());
+        helper.write(file, (geometry_.block_size() * 2) / helper.size());
+        file.close();
+    }
+
+    ASSERT_TRUE(fs_.flush());
+
+    auto reused = 0;
+    for (auto &entry : storage_.log().entries()) {
+        if (entry.type() == OperationType::EraseBlock) {
+            ASSERT_GE(entry.address().block, head);
+        }
+        if (entry.type() == OperationType::Write && entry.address().block < head && entry.address().position == 0) {
+            reused++;
+        }
+    }
+
+    ASSERT_GE(reused, 8);
+}
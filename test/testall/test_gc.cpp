@@ -10,7 +10,7 @@ using namespace phylum;
 
 class GarbageCollectionSuite : public ::testing::Test {
 protected:
-    Geometry geometry_{ 1024, 4, 4, 512 };
+    Geometry geometry_{ 4096, 4, 4, 512 };
     LinuxMemoryBackend storage_;
     DebuggingBlockAllocator allocator_;
     FileSystem fs_{ storage_, allocator_ };
@@ -22,6 +22,8 @@ protected:
         ASSERT_TRUE(storage_.initialize(geometry_));
         ASSERT_TRUE(storage_.open());
         ASSERT_TRUE(fs_.mount(true));
+        // These need trees that are large and the same size every time.
+        fs_.position_policy({ 8, 8, 8 });
     }
 
     void TearDown() override {
@@ -49,16 +51,17 @@ TEST_F(GarbageCollectionSuite, RunOnSingleBlockTree) {
 
     ASSERT_NE(before, after);
 
-    ASSERT_EQ(blocks.number_of_blocks(BlockType::Leaf, 0, allocator_.state().head), 2);
+    // The old blocks were freed and erased.
+    ASSERT_EQ(blocks.number_of_blocks(BlockType::Leaf, 0, allocator_.state().head), 1);
     ASSERT_EQ(blocks.number_of_blocks(BlockType::Index, 0, allocator_.state().head), 0);
 }
 
 TEST_F(GarbageCollectionSuite, RunOnSingleLargeTree) {
-    ASSERT_TRUE(helper.write_file("test-1.bin", geometry_.block_size() * 256));
-    ASSERT_TRUE(helper.write_file("test-2.bin", geometry_.block_size() * 256));
+    ASSERT_TRUE(helper.write_file("test-1.bin", geometry_.block_size() * 1200));
+    ASSERT_TRUE(helper.write_file("test-2.bin", geometry_.block_size() * 1200));
 
-    ASSERT_EQ(blocks.number_of_blocks(BlockType::Leaf), 2);
-    ASSERT_EQ(blocks.number_of_blocks(BlockType::Index), 3);
+    ASSERT_EQ(blocks.number_of_blocks(BlockType::Leaf), 3);
+    ASSERT_EQ(blocks.number_of_blocks(BlockType::Index), 1);
 
     auto before_address = fs_.sb().tree;
     auto before_ts = fs_.sb().last_gc;
@@ -71,6 +74,87 @@ TEST_F(GarbageCollectionSuite, RunOnSingleLargeTree) {
     ASSERT_NE(before_address, after_address);
     ASSERT_GT(after_ts, before_ts);
 
-    ASSERT_EQ(blocks.number_of_blocks(BlockType::Leaf, 0, allocator_.state().head), 3);
-    ASSERT_EQ(blocks.number_of_blocks(BlockType::Index, 0, allocator_.state().head), 4);
+    // The old blocks were freed and erased.
+    ASSERT_EQ(blocks.number_of_blocks(BlockType::Leaf, 0, allocator_.state().head), 1);
+    ASSERT_EQ(blocks.number_of_blocks(BlockType::Index, 0, allocator_.state().head), 1);
+}
+
+TEST_F(GarbageCollectionSuite, FreedBlocksAreReused) {
+    ASSERT_TRUE(helper.write_file("test-1.bin", geometry_.block_size() * 1200));
+
+    ASSERT_TRUE(fs_.gc());
+
+    ASSERT_FALSE(fs_.fpm().empty());
+
+    auto head = allocator_.state().head;
+
+    ASSERT_TRUE(helper.write_file("test-2.bin", 32));
+
+    ASSERT_EQ(allocator_.state().head, head);
+}
+
+TEST_F(GarbageCollectionSuite, IncrementalOnEmpty) {
+    ASSERT_TRUE(fs_.gc(16));
+    ASSERT_EQ(fs_.sb().gc.relocating, 0);
+}
+
+TEST_F(GarbageCollectionSuite, IncrementalFreesOldestBlocks) {
+    ASSERT_TRUE(helper.write_file("test-1.bin", geometry_.block_size() * 1800));
+    ASSERT_TRUE(helper.write_file("test-2.bin", geometry_.block_size() * 1800));
+
+    std::set<block_index_t> freed;
+
+    for (auto i = 0; i < 1000; ++i) {
+        auto before = fs_.sb().gc;
+
+        ASSERT_TRUE(fs_.gc(16));
+
+        auto after = fs_.sb().gc;
+        if (is_valid_block(before.leaf) && before.leaf != after.leaf) {
+            freed.insert(before.leaf);
+        }
+        if (is_valid_block(before.index) && before.index != after.index) {
+            freed.insert(before.index);
+        }
+
+        // Nothing left to collect.
+        if (after.relocating == 0 && before.leaf == after.leaf && before.index == after.index) {
+            break;
+        }
+    }
+
+    ASSERT_GE(freed.size(), (size_t)3);
+
+    // If anything still used those blocks we'll find out.
+    for (auto block : freed) {
+        ASSERT_TRUE(storage_.erase(block));
+    }
+
+    ASSERT_TRUE(fs_.mount());
+
+    for (auto name : { "test-1.bin", "test-2.bin" }) {
+        ASSERT_TRUE(fs_.exists(name));
+
+        auto file = fs_.open(name, true);
+        ASSERT_EQ(file.size(), geometry_.block_size() * 1800);
+        file.close();
+    }
+}
+
+TEST_F(GarbageCollectionSuite, IncrementalResumesAfterMount) {
+    ASSERT_TRUE(helper.write_file("test-1.bin", geometry_.block_size() * 1200));
+    ASSERT_TRUE(helper.write_file("test-2.bin", geometry_.block_size() * 1200));
+
+    ASSERT_TRUE(fs_.gc(4));
+
+    auto before = fs_.sb().gc;
+    ASSERT_NE(before.relocating, 0);
+
+    ASSERT_TRUE(fs_.mount());
+
+    auto after = fs_.sb().gc;
+    ASSERT_EQ(after.relocating, before.relocating);
+    ASSERT_EQ(after.key, before.key);
+    ASSERT_EQ(after.leaf, before.leaf);
+    ASSERT_EQ(after.index, before.index);
 }
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include "phylum/file_system.h"
+#include "backends/linux_memory/linux_memory.h"
+
+#include "utilities.h"
+
+using namespace phylum;
+
+class JournalSuite : public ::testing::Test {
+protected:
+    Geometry geometry_{ 1024, 4, 4, 512 };
+    LinuxMemoryBackend storage_;
+    DebuggingBlockAllocator allocator_;
+    FileSystem fs_{ storage_, allocator_ };
+    BlockHelper helper_{ storage_ };
+
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(storage_.initialize(geometry_));
+        ASSERT_TRUE(storage_.open());
+        ASSERT_TRUE(fs_.mount(true));
+    }
+
+    void TearDown() override {
+        ASSERT_TRUE(fs_.unmount());
+    }
+
+};
+
+static std::vector<uint64_t> replay_keys(JournalManager &journal, block_index_t block, timestamp_t timestamp) {
+    std::vector<uint64_t> keys;
+    journal.replay(block, timestamp, [&](JournalEntry &entry) {
+        keys.push_back(entry.key);
+    });
+    return keys;
+}
+
+TEST_F(JournalSuite, CreatesEmptyJournal) {
+    ASSERT_TRUE(helper_.is_type(fs_.sb().journal, BlockType::Journal));
+}
+
+TEST_F(JournalSuite, FindsEndOfJournalFromFirstBlock) {
+    auto entries_per_block = (int32_t)geometry_.block_size() / (int32_t)sizeof(JournalEntry);
+    auto before = fs_.journal().location();
+
+    for (auto i = 0; i < entries_per_block + 6; ++i) {
+        ASSERT_TRUE(fs_.journal().append({ JournalEntryKind::Block, (block_index_t)(i + 10) }));
+    }
+
+    auto after = fs_.journal().location();
+    ASSERT_NE(before.block, after.block);
+
+    JournalManager journal{ storage_, allocator_ };
+    ASSERT_TRUE(journal.locate(fs_.sb().journal));
+
+    ASSERT_EQ(journal.location(), after);
+}
+
+TEST_F(JournalSuite, ReplaysEntriesAfterLastFinishedCheckpoint) {
+    JournalManager journal{ storage_, allocator_ };
+    auto block = allocator_.allocate(BlockType::Journal).block;
+    ASSERT_TRUE(journal.format(block));
+
+    ASSERT_TRUE(journal.append({ JournalEntryKind::Position, 0, 1 }));
+    ASSERT_TRUE(journal.append({ JournalEntryKind::Checkpoint, 0, 5 }));
+    ASSERT_TRUE(journal.append({ JournalEntryKind::Position, 0, 2 }));
+    ASSERT_TRUE(journal.append({ JournalEntryKind::Checkpoint, 0, 6 }));
+    ASSERT_TRUE(journal.append({ JournalEntryKind::Position, 0, 3 }));
+
+    ASSERT_EQ(replay_keys(journal, block, 4), (std::vector<uint64_t>{ 1, 2, 3 }));
+    ASSERT_EQ(replay_keys(journal, block, 5), (std::vector<uint64_t>{ 2, 3 }));
+    ASSERT_EQ(replay_keys(journal, block, 6), (std::vector<uint64_t>{ 3 }));
+}
+
+TEST_F(JournalSuite, CheckpointRestartsJournalThatSpilled) {
+    auto entries_per_block = (int32_t)geometry_.block_size() / (int32_t)sizeof(JournalEntry);
+    auto first = fs_.sb().journal;
+
+    for (auto i = 0; i < entries_per_block + 6; ++i) {
+        ASSERT_TRUE(fs_.journal().append({ JournalEntryKind::Block, (block_index_t)(i + 10) }));
+    }
+
+    auto file = fs_.open("test.bin");
+    file.close();
+
+    ASSERT_NE(fs_.sb().journal, first);
+    ASSERT_EQ(fs_.journal().location().block, fs_.sb().journal);
+}
+
+TEST_F(JournalSuite, ReplayReadsSectorsInsteadOfEntries) {
+    auto entries_per_sector = (int32_t)SectorSize / (int32_t)sizeof(JournalEntry);
+    JournalManager journal{ storage_, allocator_ };
+    auto block = allocator_.allocate(BlockType::Journal).block;
+    ASSERT_TRUE(journal.format(block));
+
+    for (auto i = 0; i < entries_per_sector * 2; ++i) {
+        ASSERT_TRUE(journal.append({ JournalEntryKind::Position, 0, (uint64_t)i }));
+    }
+
+    storage_.log().clear();
+
+    ASSERT_EQ(replay_keys(journal, block, 0).size(), (size_t)(entries_per_sector * 2));
+
+    // Head and the two sectors of entries for each of the two passes, and
+    // the first pass also reads the sector after them to find the end.
+    ASSERT_EQ(storage_.log().size(), (size_t)(3 + 3 + 1));
+}
@@ -186,6 +186,75 @@ TYPED_TEST(PersistedTreeSuite, FindLessThanLookup) {
     }
 }
 
+TYPED_TEST(PersistedTreeSuite, IterateRange) {
+    using TreeType = PersistedTree<typename TypeParam::NodeType>;
+
+    TreeType tree{ this->cfg_.cache_ };
+
+    std::map<typename TypeParam::NodeType::KeyType, typename TypeParam::NodeType::ValueType> map;
+
+    srandom(1);
+
+    auto value = 1;
+    for (auto i = 0; i < 1024; ++i) {
+        auto key = random() % UINT32_MAX;
+        tree.add(key, value);
+        map[key] = value;
+        value++;
+    }
+
+    auto first = map.begin();
+    std::advance(first, 100);
+    auto last = map.begin();
+    std::advance(last, 700);
+
+    auto expected = first;
+    auto visited = 0;
+    for (typename TreeType::Iterator iter{ tree, first->first, last->first }; iter.valid(); iter.next()) {
+        ASSERT_EQ(iter.key(), expected->first);
+        ASSERT_EQ(iter.value(), expected->second);
+        expected++;
+        visited++;
+    }
+
+    ASSERT_EQ(visited, 601);
+
+    typename decltype(map)::reverse_iterator reversed{ std::next(last) };
+    visited = 0;
+    for (typename TreeType::Iterator iter{ tree, first->first + 1, last->first, true }; iter.valid(); iter.next()) {
+        ASSERT_EQ(iter.key(), reversed->first);
+        ASSERT_EQ(iter.value(), reversed->second);
+        reversed++;
+        visited++;
+    }
+
+    ASSERT_EQ(visited, 600);
+
+    // Iterating should leave the tree usable afterwards.
+    ASSERT_EQ(tree.find(first->first), first->second);
+}
+
+TYPED_TEST(PersistedTreeSuite, IterateEmptyRange) {
+    using TreeType = PersistedTree<typename TypeParam::NodeType>;
+
+    TreeType tree{ this->cfg_.cache_ };
+
+    for (auto i = 1; i < 100; ++i) {
+        tree.add(i * 10, i);
+    }
+
+    typename TreeType::Iterator forward{ tree, 11, 19 };
+    ASSERT_FALSE(forward.valid());
+    forward.close();
+
+    typename TreeType::Iterator reverse{ tree, 11, 19, true };
+    ASSERT_FALSE(reverse.valid());
+    reverse.close();
+
+    typename TreeType::Iterator after{ tree, 1000, UINT64_MAX };
+    ASSERT_FALSE(after.valid());
+}
+
 template<typename NodeType, typename NodeRefType>
 struct SimpleVisitor : PersistedTreeVisitor<NodeRefType, NodeType> {
     std::map<block_index_t, std::vector<BlockAddress>> live;
@@ -257,6 +326,128 @@ TYPED_TEST(PersistedTreeSuite, WalkLargeTree) {
     ASSERT_EQ(visitor.calls, 493);
 }
 
+TYPED_TEST(PersistedTreeSuite, RemoveRebalances) {
+    using TreeType = PersistedTree<typename TypeParam::NodeType>;
+
+    TreeType tree{ this->cfg_.cache_ };
+
+    std::map<typename TypeParam::NodeType::KeyType, typename TypeParam::NodeType::ValueType> map;
+    std::vector<typename TypeParam::NodeType::KeyType> keys;
+
+    srandom(1);
+
+    auto value = 1;
+    for (auto i = 0; i < 256; ++i) {
+        auto key = random() % UINT32_MAX;
+        tree.add(key, value);
+        if (map.find(key) == map.end()) {
+            keys.push_back(key);
+        }
+        map[key] = value;
+        value++;
+    }
+
+    std::random_shuffle(keys.begin(), keys.end(), [](size_t n) { return random() % n; });
+
+    for (auto i = 0u; i < keys.size(); ++i) {
+        ASSERT_TRUE(tree.remove(keys[i]));
+        ASSERT_FALSE(tree.remove(keys[i]));
+        map.erase(keys[i]);
+
+        if (i % 16 == 0) {
+            auto expected = map.begin();
+            for (typename TreeType::Iterator iter{ tree, 0, UINT64_MAX }; iter.valid(); iter.next()) {
+                ASSERT_EQ(iter.key(), expected->first);
+                ASSERT_EQ(iter.value(), expected->second);
+                expected++;
+            }
+            ASSERT_TRUE(expected == map.end());
+        }
+    }
+
+    typename TreeType::Iterator iter{ tree, 0, UINT64_MAX };
+    ASSERT_FALSE(iter.valid());
+    iter.close();
+
+    SimpleVisitor<typename TypeParam::NodeType, typename TypeParam::NodeRefType> visitor;
+    tree.accept(visitor);
+    ASSERT_EQ(visitor.calls, 1);
+}
+
+TYPED_TEST(PersistedTreeSuite, AddSorted) {
+    using KeyType = typename TypeParam::NodeType::KeyType;
+    using ValueType = typename TypeParam::NodeType::ValueType;
+
+    PersistedTree<typename TypeParam::NodeType> tree{ this->cfg_.cache_ };
+    std::map<KeyType, ValueType> expected;
+
+    for (auto i = 0; i < 64; ++i) {
+        auto key = (KeyType)(random() % 4096);
+        tree.add(key, i + 1);
+        expected[key] = i + 1;
+    }
+
+    // Runs of neighbouring keys with gaps between them, some of which are
+    // already in the tree.
+    for (auto batch = 0; batch < 4; ++batch) {
+        std::vector<KeyType> keys;
+        std::vector<ValueType> values;
+        auto key = (KeyType)(random() % 512);
+        for (auto i = 0; i < 48; ++i) {
+            key += i % 8 == 0 ? random() % 256 + 1 : 1;
+            keys.push_back(key);
+            values.push_back(1000 * (batch + 1) + i);
+            expected[key] = 1000 * (batch + 1) + i;
+        }
+        tree.add(keys.data(), values.data(), keys.size());
+    }
+
+    for (auto &pair : expected) {
+        ASSERT_EQ(tree.find(pair.first), pair.second);
+    }
+
+    auto iter = expected.begin();
+    for (typename PersistedTree<typename TypeParam::NodeType>::Iterator i{ tree, 0, UINT64_MAX }; i.valid(); i.next()) {
+        ASSERT_EQ(i.key(), iter->first);
+        iter++;
+    }
+    ASSERT_EQ(iter, expected.end());
+}
+
+TYPED_TEST(PersistedTreeSuite, RemoveRange) {
+    using KeyType = typename TypeParam::NodeType::KeyType;
+    using ValueType = typename TypeParam::NodeType::ValueType;
+    using TreeType = PersistedTree<typename TypeParam::NodeType>;
+
+    TreeType tree{ this->cfg_.cache_ };
+    std::map<KeyType, ValueType> expected;
+
+    for (auto i = 1; i <= 512; ++i) {
+        tree.add((KeyType)(i * 2), i);
+        expected[(KeyType)(i * 2)] = i;
+    }
+
+    // Neither end is a key, and the range spans many leaves.
+    ASSERT_EQ(tree.remove(101, 701), (size_t)300);
+    expected.erase(expected.lower_bound(101), expected.upper_bound(701));
+
+    ASSERT_EQ(tree.remove(101, 701), (size_t)0);
+    ASSERT_EQ(tree.remove(1, 1), (size_t)0);
+
+    auto iter = expected.begin();
+    for (typename TreeType::Iterator i{ tree, 0, UINT64_MAX }; i.valid(); i.next()) {
+        ASSERT_EQ(i.key(), iter->first);
+        ASSERT_EQ(i.value(), iter->second);
+        iter++;
+    }
+    ASSERT_EQ(iter, expected.end());
+
+    ASSERT_EQ(tree.remove(0, UINT32_MAX), expected.size());
+
+    typename TreeType::Iterator empty{ tree, 0, UINT64_MAX };
+    ASSERT_FALSE(empty.valid());
+}
+
 TYPED_TEST(PersistedTreeSuite, RecreateSmallTree) {
     PersistedTree<typename TypeParam::NodeType> tree{ this->cfg_.cache_ };
 
@@ -318,3 +509,78 @@ TYPED_TEST(PersistedTreeSuite, RecreateLargeTree) {
         // helper.dump(3, this->cfg_.allocator_.state().head);
     }
 }
+
+TEST(NodeSerializerSuite, CompactLeafRoundTrip) {
+    using NodeType = Node<uint64_t, int32_t, BlockAddress, 6, 6>;
+    using SerializerType = NodeSerializer<NodeType>;
+
+    NodeType node;
+    node.clear();
+    node.depth = 0;
+    node.number_keys = 6;
+    for (auto i = 0; i < 6; ++i) {
+        node.keys[i] = INodeKey(1024, i * 4096);
+        node.d.values[i] = -i * 3;
+    }
+
+    SerializerType serializer;
+    TreeHead head;
+    head.timestamp = 1000;
+
+    auto size = serializer.size(&node, &head);
+    ASSERT_LT(size, sizeof(node.keys) + sizeof(node.d.values));
+
+    uint8_t buffer[SerializerType::HeadNodeSize];
+    memset(buffer, 0xff, sizeof(buffer));
+    ASSERT_TRUE(serializer.serialize(buffer, &node, &head));
+    ASSERT_EQ(serializer.record_size(buffer, sizeof(buffer)), size);
+
+    NodeType copy;
+    TreeHead copy_head;
+    ASSERT_TRUE(serializer.deserialize(buffer, sizeof(buffer), &copy, &copy_head));
+    ASSERT_EQ(copy.depth, 0);
+    ASSERT_EQ(copy.number_keys, 6);
+    ASSERT_EQ(copy_head.timestamp, (timestamp_t)1000);
+    for (auto i = 0; i < 6; ++i) {
+        ASSERT_EQ(copy.keys[i], node.keys[i]);
+        ASSERT_EQ(copy.d.values[i], node.d.values[i]);
+    }
+
+    // Erased space and corrupted records are never mistaken for nodes.
+    buffer[size / 2] ^= 0x01;
+    ASSERT_EQ(serializer.record_size(buffer, sizeof(buffer)), (size_t)0);
+    memset(buffer, 0x00, sizeof(buffer));
+    ASSERT_EQ(serializer.record_size(buffer, sizeof(buffer)), (size_t)0);
+}
+
+TEST(NodeSerializerSuite, CompactInnerRoundTrip) {
+    using NodeType = Node<uint64_t, int32_t, BlockAddress, 6, 6>;
+    using SerializerType = NodeSerializer<NodeType>;
+
+    NodeType node;
+    node.clear();
+    node.depth = 2;
+    node.number_keys = 3;
+    for (auto i = 0; i < 3; ++i) {
+        node.keys[i] = INodeKey(2048, i * 512);
+    }
+    for (auto i = 0; i <= 3; ++i) {
+        node.d.children[i].address(BlockAddress{ (block_index_t)(10 - i), (uint32_t)(512 + i * 48) });
+    }
+
+    SerializerType serializer;
+    uint8_t buffer[SerializerType::HeadNodeSize];
+    ASSERT_TRUE(serializer.serialize(buffer, &node, nullptr));
+
+    NodeType copy;
+    ASSERT_TRUE(serializer.deserialize(buffer, serializer.size(&node, nullptr), &copy, nullptr));
+    ASSERT_EQ(copy.depth, 2);
+    ASSERT_EQ(copy.number_keys, 3);
+    for (auto i = 0; i < 3; ++i) {
+        ASSERT_EQ(copy.keys[i], node.keys[i]);
+    }
+    for (auto i = 0; i <= 3; ++i) {
+        ASSERT_EQ(copy.d.children[i].address(), node.d.children[i].address());
+    }
+    ASSERT_FALSE(copy.d.children[4].address().valid());
+}
@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include "backends/arduino_serial_flash/serial_flash_allocator.h"
+#include "backends/linux_memory/linux_memory.h"
+
+#include "utilities.h"
+
+using namespace phylum;
+
+class SerialFlashAllocatorSuite : public ::testing::Test {
+protected:
+    Geometry geometry_{ 32, 4, 4, 512 };
+    LinuxMemoryBackend storage_;
+    SerialFlashAllocator allocator_{ storage_ };
+
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(storage_.initialize(geometry_));
+        ASSERT_TRUE(storage_.open());
+        ASSERT_TRUE(allocator_.initialize());
+    }
+
+    void TearDown() override {
+        ASSERT_TRUE(storage_.close());
+    }
+
+};
+
+TEST_F(SerialFlashAllocatorSuite, AllocatingReadsNothing) {
+    storage_.log().clear();
+
+    for (auto i = 0; i < 20; ++i) {
+        ASSERT_TRUE(is_valid_block(allocator_.allocate(BlockType::File).block));
+    }
+
+    ASSERT_EQ(storage_.log().size(), 0);
+    ASSERT_EQ(allocator_.number_of_free_blocks(), (uint32_t)(32 - 3 - 20));
+}
+
+TEST_F(SerialFlashAllocatorSuite, AllocatesYoungestBlocksFirst) {
+    std::vector<block_index_t> allocated;
+    for (auto i = 0; i < 32 - 3; ++i) {
+        allocated.push_back(allocator_.allocate(BlockType::File).block);
+    }
+
+    // Blocks that were never formatted go first, file blocks from the start.
+    ASSERT_EQ(allocated[0], (block_index_t)3);
+    ASSERT_EQ(allocator_.number_of_free_blocks(), (uint32_t)0);
+
+    ASSERT_TRUE(allocator_.free(10, 5));
+    ASSERT_TRUE(allocator_.free(12, 2));
+    ASSERT_TRUE(allocator_.free(7, 9));
+
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)12);
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)10);
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)7);
+    ASSERT_FALSE(is_valid_block(allocator_.allocate(BlockType::File).block));
+}
+
+TEST_F(SerialFlashAllocatorSuite, KeepsHotAndColdBlocksApart) {
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)3);
+    ASSERT_EQ(allocator_.allocate(BlockType::SuperBlockLink).block, (block_index_t)31);
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)4);
+    ASSERT_EQ(allocator_.allocate(BlockType::Leaf).block, (block_index_t)30);
+}
+
+TEST_F(SerialFlashAllocatorSuite, ReusedBlocksStayInTheirStream) {
+    for (auto i = 0; i < 32 - 3; ++i) {
+        allocator_.allocate(BlockType::File);
+    }
+
+    ASSERT_TRUE(allocator_.free(25, 1));
+    ASSERT_TRUE(allocator_.free(5, 7));
+    ASSERT_TRUE(allocator_.free(28, 3));
+    ASSERT_TRUE(allocator_.free(8, 6));
+
+    // Even though they're younger, the blocks at the end are left for the
+    // hot stream while there are cold ones.
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)8);
+    ASSERT_EQ(allocator_.allocate(BlockType::Leaf).block, (block_index_t)25);
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)5);
+
+    // With no cold blocks left, files get what there is.
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)28);
+    ASSERT_FALSE(is_valid_block(allocator_.allocate(BlockType::Leaf).block));
+}
+
+TEST_F(SerialFlashAllocatorSuite, PreallocatedBlocksAreOnlyForFiles) {
+    for (auto i = 0; i < 32 - 3; ++i) {
+        allocator_.allocate(BlockType::File);
+    }
+
+    ASSERT_TRUE(allocator_.free(5, 1));
+    ASSERT_TRUE(allocator_.free(25, 1));
+    ASSERT_FALSE(allocator_.preallocate(1));
+
+    ASSERT_EQ(allocator_.allocate(BlockType::Leaf).block, (block_index_t)25);
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)5);
+}
+
+TEST_F(SerialFlashAllocatorSuite, MountingFindsFreedBlocksByAge) {
+    for (auto i = 0; i < 32 - 3; ++i) {
+        allocator_.allocate(BlockType::File);
+    }
+
+    ASSERT_TRUE(allocator_.free(12, 4));
+    ASSERT_TRUE(allocator_.free(9, 3));
+
+    SerialFlashAllocator mounted{ storage_ };
+    ASSERT_TRUE(mounted.initialize());
+    ASSERT_EQ(mounted.number_of_free_blocks(), (uint32_t)(32 - 3));
+
+    // Blocks that were never formatted are always preferred.
+    for (auto i = 0; i < 32 - 3 - 2; ++i) {
+        auto block = mounted.allocate(BlockType::File).block;
+        ASSERT_NE(block, (block_index_t)9);
+        ASSERT_NE(block, (block_index_t)12);
+    }
+
+    ASSERT_EQ(mounted.allocate(BlockType::File).block, (block_index_t)9);
+    ASSERT_EQ(mounted.allocate(BlockType::File).block, (block_index_t)12);
+}
+
+TEST(SerialFlashAllocatorLargerSuite, UsesBlocksPastTheFirst64) {
+    Geometry geometry{ 256, 4, 4, 512 };
+    LinuxMemoryBackend storage;
+    SerialFlashAllocator allocator{ storage };
+
+    ASSERT_TRUE(storage.initialize(geometry));
+    ASSERT_TRUE(storage.open());
+    ASSERT_TRUE(allocator.initialize());
+
+    ASSERT_EQ(allocator.number_of_free_blocks(), (uint32_t)256 - 3);
+
+    std::vector<block_index_t> allocated;
+    for (auto i = 0; i < 256 - 3; ++i) {
+        auto block = allocator.allocate(BlockType::File).block;
+        ASSERT_TRUE(is_valid_block(block));
+        allocated.push_back(block);
+    }
+
+    ASSERT_EQ(allocator.number_of_free_blocks(), (uint32_t)0);
+    ASSERT_NE(std::find(allocated.begin(), allocated.end(), (block_index_t)255), allocated.end());
+
+    ASSERT_TRUE(storage.close());
+}
+
+TEST_F(SerialFlashAllocatorSuite, PreallocatedBlocksKeepTheirAge) {
+    for (auto i = 0; i < 32 - 3; ++i) {
+        allocator_.allocate(BlockType::File);
+    }
+
+    ASSERT_TRUE(allocator_.free(10, 5));
+
+    // There's only the one block to preallocate.
+    ASSERT_FALSE(allocator_.preallocate(1));
+
+    auto alloc = allocator_.allocate(BlockType::File);
+    ASSERT_EQ(alloc.block, (block_index_t)10);
+    ASSERT_EQ(alloc.age, (block_age_t)5);
+    ASSERT_TRUE(alloc.erased);
+}
@@ -52,17 +52,36 @@ TEST_F(SuperBlockNonStandardSizeSuite, SavingAFewRevisions) {
         ASSERT_TRUE(manager_.save());
     }
 
-    ASSERT_EQ(manager_.location().sector, 5);
+    ASSERT_EQ(manager_.location().position, (uint32_t)(5 * sizeof(SimpleState)));
 
     BasicSuperBlockManager<SimpleState> other_manager{ storage_, allocator_ };
 
     ASSERT_EQ(other_manager.location().block, BLOCK_INDEX_INVALID);
-    ASSERT_EQ(other_manager.location().sector, SECTOR_INDEX_INVALID);
+    ASSERT_EQ(other_manager.location().position, POSITION_INDEX_INVALID);
 
     ASSERT_TRUE(other_manager.locate());
 
     ASSERT_EQ(other_manager.location().block, (block_index_t)31);
-    ASSERT_EQ(other_manager.location().sector, (sector_index_t)5);
+    ASSERT_EQ(other_manager.location().position, (uint32_t)(5 * sizeof(SimpleState)));
+}
+
+TEST_F(SuperBlockNonStandardSizeSuite, LocatingBisectsLinks) {
+    ASSERT_TRUE(manager_.create());
+
+    for (auto i = 0; i < 20; ++i) {
+        ASSERT_TRUE(manager_.save());
+    }
+
+    storage_.log().clear();
+
+    BasicSuperBlockManager<SimpleState> other_manager{ storage_, allocator_ };
+
+    ASSERT_TRUE(other_manager.locate());
+
+    ASSERT_EQ(other_manager.location(), manager_.location());
+    ASSERT_EQ(other_manager.location().position, (uint32_t)(20 * sizeof(SimpleState)));
+    // Fewer reads than there are links in the super block's block alone.
+    ASSERT_LT(storage_.log().size(), (size_t)21);
 }
 
 TEST_F(SuperBlockNonStandardSizeSuite, PrefersInvalidBlocksDuringAllocation) {
@@ -76,7 +95,7 @@ TEST_F(SuperBlockNonStandardSizeSuite, PrefersInvalidBlocksDuringAllocation) {
         }
     }
 
-    for (auto i = 0; i < 33; ++i) {
+    for (auto i = (uint32_t)0; i < manager_.manager().records_per_block() + 1; ++i) {
         ASSERT_TRUE(manager_.save());
     }
 
@@ -96,11 +115,12 @@ TEST_F(SuperBlockNonStandardSizeSuite, AgeIsIncrementedWhenAllocatingBlockWithAg
         }
     }
 
-    for (auto i = 0; i < 33; ++i) {
+    for (auto i = (uint32_t)0; i < manager_.manager().records_per_block() + 1; ++i) {
         ASSERT_TRUE(manager_.save());
     }
 
-    ASSERT_EQ(manager_.location().block, (block_index_t)3);
+    // Super blocks are hot, so the first of the blocks kept for them.
+    ASSERT_EQ(manager_.location().block, (block_index_t)16);
 
     BlockHead header;
     ASSERT_TRUE(storage_.read(BlockAddress{ manager_.location().block, 0 }, &header, sizeof(BlockHead)));
@@ -1,6 +1,10 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include "phylum/tree.h"
+#include "phylum/memtable.h"
 #include "phylum/private.h"
 #include "phylum/inodes.h"
 
@@ -106,12 +110,15 @@ TEST_F(TreeSuite, MultipleLevelRemove) {
         ASSERT_TRUE(tree.remove(pair.first));
     }
 
-    // TODO: Delete is incomplete.
-    ASSERT_FALSE(tree.empty());
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQ(tree.depth, (unsigned)0);
+    ASSERT_EQ(tree.allocated_leafs, (size_t)1);
+    ASSERT_EQ(tree.allocated_inners, (size_t)0);
 }
 
 TEST_F(TreeSuite, MultipleLookup) {
     std::vector<uint32_t> inodes;
+    std::vector<uint64_t> keys;
 
     StandardTree tree;
 
@@ -123,6 +130,7 @@ TEST_F(TreeSuite, MultipleLookup) {
 
         for (auto j = 0; j < 128; ++j) {
             tree.add(INodeKey(inode, offset), inode);
+            keys.push_back(INodeKey(inode, offset));
             offset += random() % 4096;
         }
     }
@@ -130,7 +138,43 @@ TEST_F(TreeSuite, MultipleLookup) {
     auto first_key = INodeKey(inodes[3], 0);
     auto last_key = INodeKey(inodes[3], ((uint32_t)-1));
 
-    tree.find_all(first_key, last_key);
+    std::set<uint64_t> expected;
+    for (auto &key : keys) {
+        if (key >= first_key && key <= last_key) {
+            expected.insert(key);
+        }
+    }
+
+    auto iter = expected.begin();
+    auto visited = tree.find_all(first_key, last_key, [&](uint64_t key, int64_t value) {
+        ASSERT_EQ(key, *iter);
+        ASSERT_EQ(value, (int64_t)inodes[3]);
+        iter++;
+    });
+
+    ASSERT_EQ(visited, expected.size());
+}
+
+TEST_F(TreeSuite, IterateReverse) {
+    BPlusTree<int32_t, int32_t, 6, 6> tree;
+
+    for (auto i = 1; i <= 512; ++i) {
+        tree.add(i, i);
+    }
+
+    tree.remove(300);
+
+    auto expected = 400;
+    for (BPlusTree<int32_t, int32_t, 6, 6>::Iterator iter{ tree, 200, 400, true }; iter.valid(); iter.next()) {
+        if (expected == 300) {
+            expected--;
+        }
+        ASSERT_EQ(iter.key(), expected);
+        ASSERT_EQ(iter.value(), expected);
+        expected--;
+    }
+
+    ASSERT_EQ(expected, 199);
 }
 
 TEST_F(TreeSuite, MultipleLookupRandom) {
@@ -153,6 +197,228 @@ TEST_F(TreeSuite, MultipleLookupRandom) {
     }
 }
 
+TEST_F(TreeSuite, RemoveAndClearReuseNodes) {
+    StandardTree tree;
+
+    ASSERT_TRUE(tree.reserve(256, 64));
+
+    for (auto round = 0; round < 4; ++round) {
+        for (auto i = 1; i <= 512; ++i) {
+            ASSERT_TRUE(tree.add(i, i));
+        }
+        for (auto i = 1; i <= 512; ++i) {
+            ASSERT_TRUE(tree.remove(i));
+        }
+        ASSERT_TRUE(tree.empty());
+        ASSERT_EQ(tree.allocated_leafs, (size_t)1);
+        ASSERT_EQ(tree.allocated_inners, (size_t)0);
+    }
+
+    for (auto i = 1; i <= 512; ++i) {
+        ASSERT_TRUE(tree.add(i, i));
+    }
+
+    tree.clear();
+
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQ(tree.lookup(10), 0);
+    ASSERT_TRUE(tree.add(10, 128));
+    ASSERT_EQ(tree.lookup(10), 128);
+}
+
+TEST_F(TreeSuite, NodePoolReusesReleasedNodes) {
+    struct alignas(8) TestNode {
+        uint64_t keys[3];
+    };
+
+    using PoolType = NodePool<TestNode, 64, 4>;
+
+    PoolType pool;
+
+    ASSERT_EQ((size_t)PoolType::SlotSize, (size_t)64);
+
+    std::vector<TestNode*> nodes;
+    for (auto i = 0; i < 6; ++i) {
+        auto node = pool.allocate();
+        ASSERT_NE(node, nullptr);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(node) % 64, (uintptr_t)0);
+        nodes.push_back(node);
+    }
+
+    ASSERT_EQ(pool.size(), (size_t)6);
+    ASSERT_EQ(pool.capacity(), (size_t)8);
+
+    for (auto node : nodes) {
+        pool.release(node);
+    }
+
+    for (auto i = 0; i < 8; ++i) {
+        ASSERT_NE(pool.allocate(), nullptr);
+    }
+
+    ASSERT_EQ(pool.capacity(), (size_t)8);
+
+    pool.clear();
+
+    ASSERT_EQ(pool.size(), (size_t)0);
+    ASSERT_EQ(pool.capacity(), (size_t)0);
+}
+
+TEST_F(TreeSuite, MemTableKeepsPairsSorted) {
+    MemTable<uint64_t, uint64_t, 8> table;
+
+    for (auto key : { 50, 10, 40, 20, 30 }) {
+        ASSERT_TRUE(table.add(key, key + 1));
+    }
+    ASSERT_TRUE(table.add(30, 300));
+    ASSERT_EQ(table.size(), (size_t)5);
+
+    for (auto i = (size_t)1; i < table.size(); ++i) {
+        ASSERT_LT(table.keys()[i - 1], table.keys()[i]);
+    }
+
+    uint64_t value;
+    uint64_t found;
+    ASSERT_TRUE(table.find(30, &value));
+    ASSERT_EQ(value, (uint64_t)300);
+    ASSERT_FALSE(table.find(35, &value));
+
+    ASSERT_TRUE(table.find_less_then(40, &value, &found));
+    ASSERT_EQ(found, (uint64_t)30);
+    ASSERT_FALSE(table.find_less_then(10, &value, &found));
+
+    ASSERT_EQ(table.remove(15, 40), (size_t)3);
+    ASSERT_EQ(table.size(), (size_t)2);
+    ASSERT_TRUE(table.find(50, &value));
+
+    for (auto key = 100; !table.full(); ++key) {
+        ASSERT_TRUE(table.add(key, key));
+    }
+    ASSERT_FALSE(table.add(1, 1));
+    ASSERT_TRUE(table.add(50, 5));
+}
+
+TEST_F(TreeSuite, ConcurrentTreeMatchesMap) {
+    ConcurrentBPlusTree<uint64_t, int64_t, 6, 6> tree;
+    map<uint64_t, int64_t> expected;
+
+    for (auto i = 0; i < 4096; ++i) {
+        auto key = (uint64_t)(random() % 2048);
+        if (i % 3 == 2) {
+            ASSERT_EQ(tree.remove(key), expected.erase(key) == 1);
+        }
+        else {
+            tree.add(key, i);
+            expected[key] = i;
+        }
+    }
+
+    ASSERT_GT(tree.depth(), (unsigned)1);
+
+    for (auto key = (uint64_t)0; key < 2048; ++key) {
+        int64_t value = -1;
+        auto iter = expected.find(key);
+        ASSERT_EQ(tree.find(key, &value), iter != expected.end());
+        if (iter != expected.end()) {
+            ASSERT_EQ(value, iter->second);
+        }
+    }
+
+    auto iter = expected.lower_bound(100);
+    auto visited = tree.find_all(100, 1500, [&](uint64_t key, int64_t value) {
+        ASSERT_EQ(key, iter->first);
+        ASSERT_EQ(value, iter->second);
+        iter++;
+    });
+
+    ASSERT_EQ(iter, expected.upper_bound(1500));
+    ASSERT_GT(visited, (size_t)0);
+}
+
+TEST_F(TreeSuite, ConcurrentTreeAddsFromManyThreads) {
+    static constexpr uint64_t NumberOfWriters = 4;
+    static constexpr uint64_t KeysPerWriter = 8192;
+
+    ConcurrentBPlusTree<uint64_t, uint64_t, 12, 12> tree;
+    std::atomic<bool> writing{ true };
+    std::atomic<size_t> failures{ 0 };
+
+    std::vector<std::thread> writers;
+    for (auto w = (uint64_t)0; w < NumberOfWriters; ++w) {
+        writers.emplace_back([&tree, w] {
+            for (auto i = (uint64_t)0; i < KeysPerWriter; ++i) {
+                auto key = i * NumberOfWriters + w;
+                tree.add(key, key + 1);
+            }
+        });
+    }
+
+    // Scans running alongside should always see keys in order and with the
+    // values they were added with.
+    std::thread reader([&] {
+        while (writing) {
+            uint64_t previous = 0;
+            auto first = true;
+            tree.find_all(0, UINT64_MAX, [&](uint64_t key, uint64_t value) {
+                if ((!first && key <= previous) || value != key + 1) {
+                    failures++;
+                }
+                previous = key;
+                first = false;
+            });
+        }
+    });
+
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    writing = false;
+    reader.join();
+
+    ASSERT_EQ(failures, (size_t)0);
+
+    for (auto key = (uint64_t)0; key < NumberOfWriters * KeysPerWriter; ++key) {
+        ASSERT_EQ(tree.lookup(key), key + 1);
+    }
+
+    ASSERT_EQ(tree.find_all(0, UINT64_MAX, [](uint64_t, uint64_t) { }), (size_t)(NumberOfWriters * KeysPerWriter));
+}
+
+template<size_t N>
+static void verify_key_positions(std::vector<uint64_t> pool) {
+    uint64_t keys[N];
+
+    for (auto number_keys = (size_t)0; number_keys <= N; ++number_keys) {
+        std::sort(pool.begin(), pool.begin() + number_keys);
+        std::copy(pool.begin(), pool.begin() + number_keys, keys);
+
+        for (auto &p : pool) {
+            for (auto key : { p - 1, p, p + 1 }) {
+                auto lower = std::lower_bound(keys, keys + number_keys, key) - keys;
+                auto upper = std::upper_bound(keys, keys + number_keys, key) - keys;
+                ASSERT_EQ(Keys::leaf_position_for(key, keys, number_keys), (unsigned)lower);
+                ASSERT_EQ(Keys::inner_position_for(key, keys, number_keys), (unsigned)upper);
+            }
+        }
+    }
+}
+
+TEST_F(TreeSuite, KeyPositions) {
+    std::vector<uint64_t> pool;
+    for (auto i = 0; i < 32; ++i) {
+        // Include keys with the upper bit set, those are easy to get wrong
+        // when comparing with signed instructions.
+        pool.push_back(INodeKey((file_id_t)(i % 2 == 0 ? i : UINT32_MAX - i), (uint32_t)random()));
+    }
+    pool.push_back(0);
+    pool.push_back(UINT64_MAX);
+
+    verify_key_positions<6>(pool);
+    verify_key_positions<12>(pool);
+    verify_key_positions<23>(pool);
+    verify_key_positions<32>(pool);
+}
+
 TEST_F(TreeSuite3Deep, SimpleInsertAndFind) {
     EXPECT_FALSE(tree_.find(52));
 
@@ -220,8 +486,6 @@ TEST_F(TreeSuite3Deep, FindLastLessThan) {
     EXPECT_EQ(50, found_key);
 }
 
-// NOTE: This test currently fails: find_last_less_then does not work when things
-// are deleted. JACOB - Is this still true? Steems ok to me.
 TEST_F(TreeSuite3Deep, FindLastLessThanDeleted) {
     tree_.add(52, 1);
     tree_.add(50, 2);
@@ -252,7 +516,7 @@ template<typename K, typename V>
 static bool do_find(const map<K, V>& std_map, const BPlusTree<K, V, 3, 3>& tree, const K key) {
     auto success = true;
 
-    // Test the weird "find first less than". Not compatible with deletes
+    // Test the weird "find first less than".
     auto i = std_map.lower_bound(key);
     V map_less_than = -2;
     if (i != std_map.begin()) {
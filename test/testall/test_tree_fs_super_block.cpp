@@ -7,10 +7,27 @@
 
 using namespace phylum;
 
-class SuperBlockSuite : public ::testing::Test {
-protected:
-    static constexpr int32_t anchor_overflow_iterations = 16 * 16 * 16 * 16 + 6;
+// Each sector starts with a whole super block, and after that saves that
+// changed only a few fields write deltas. This is where the given one goes
+// in its block.
+static uint32_t per_sector(Geometry &g) {
+    auto whole = (uint32_t)sizeof(TreeFileSystemSuperBlock);
+    auto delta = (uint32_t)sizeof(SuperBlockDelta);
+    return (g.sector_size - whole - delta) / delta + 2;
+}
+
+static uint32_t position_of(Geometry &g, uint32_t record) {
+    auto whole = (uint32_t)sizeof(TreeFileSystemSuperBlock);
+    auto delta = (uint32_t)sizeof(SuperBlockDelta);
+    auto r = record % per_sector(g);
+    return (record / per_sector(g)) * g.sector_size + (r == 0 ? 0 : whole + (r - 1) * delta);
+}
 
+static uint32_t saves_per_block(Geometry &g) {
+    return per_sector(g) * g.sectors_per_block();
+}
+
+class SuperBlockSuite : public ::testing::Test {
 protected:
     Geometry geometry_{ 1024, 4, 4, 512 };
     LinuxMemoryBackend storage_;
@@ -28,6 +45,20 @@ protected:
         ASSERT_TRUE(storage_.close());
     }
 
+    uint32_t records() {
+        return sbm_.manager().records_per_block();
+    }
+
+    uint32_t saves() {
+        return saves_per_block(geometry_);
+    }
+
+    // Anchors are rolled over once every link in the chain below them has
+    // filled up, so this keeps the chain short enough to get there.
+    uint32_t anchor_overflow_iterations() {
+        return saves() * records() * records() + 6;
+    }
+
 };
 
 TEST_F(SuperBlockSuite, LocatingUnformatted) {
@@ -48,11 +79,11 @@ TEST_F(SuperBlockSuite, SavingAFewRevisions) {
         ASSERT_TRUE(sbm_.save());
     }
 
-    ASSERT_EQ(sbm_.location().sector, 5);
+    ASSERT_EQ(sbm_.location().position, position_of(geometry_, 5));
 
     ASSERT_TRUE(sbm_.locate());
 
-    ASSERT_EQ(sbm_.location().sector, 5);
+    ASSERT_EQ(sbm_.location().position, position_of(geometry_, 5));
 }
 
 TEST_F(SuperBlockSuite, BlockRollover) {
@@ -60,44 +91,65 @@ TEST_F(SuperBlockSuite, BlockRollover) {
 
     auto old = sbm_.location();
 
-    for (auto i = 0; i < 18; ++i) {
+    for (auto i = (uint32_t)0; i < saves() + 2; ++i) {
         ASSERT_TRUE(sbm_.save());
     }
 
     ASSERT_TRUE(sbm_.locate());
 
     ASSERT_NE(sbm_.location().block, old.block);
-    ASSERT_EQ(sbm_.location().sector, 2);
+    ASSERT_EQ(sbm_.location().position, position_of(geometry_, 2));
+}
+
+TEST_F(SuperBlockSuite, LocatingLongerChains) {
+    sbm_.manager().chain_length(4);
+
+    ASSERT_TRUE(sbm_.create());
+
+    for (auto i = (uint32_t)0; i < saves() + 2; ++i) {
+        ASSERT_TRUE(sbm_.save());
+    }
+
+    TreeFileSystemSuperBlockManager other{ storage_, allocator_ };
+
+    ASSERT_TRUE(other.locate());
+
+    ASSERT_EQ(other.location(), sbm_.location());
+    ASSERT_EQ(other.timestamp(), sbm_.timestamp());
 }
 
 TEST_F(SuperBlockSuite, AnchorAreaRollover) {
+    sbm_.manager().chain_length(1);
+
     ASSERT_TRUE(sbm_.create());
 
     auto old = sbm_.location();
 
-    for (auto i = 0; i < anchor_overflow_iterations; ++i) {
+    for (auto i = (uint32_t)0; i < anchor_overflow_iterations(); ++i) {
         ASSERT_TRUE(sbm_.save());
     }
 
     ASSERT_TRUE(sbm_.locate());
 
     ASSERT_NE(sbm_.location().block, old.block);
-    ASSERT_EQ(sbm_.location().sector, 6);
+    ASSERT_EQ(sbm_.location().position, position_of(geometry_, 6));
 }
 
 TEST_F(SuperBlockSuite, AnchorAreaRolloverTwice) {
+    sbm_.manager().chain_length(1);
+
     ASSERT_TRUE(sbm_.create());
 
     auto old = sbm_.location();
 
-    for (auto i = 0; i < anchor_overflow_iterations * 2; ++i) {
+    for (auto i = (uint32_t)0; i < anchor_overflow_iterations() * 2; ++i) {
         ASSERT_TRUE(sbm_.save());
     }
 
     ASSERT_TRUE(sbm_.locate());
 
     ASSERT_NE(sbm_.location().block, old.block);
-    ASSERT_EQ(sbm_.location().sector, 12);
+    ASSERT_EQ(sbm_.location().position, position_of(geometry_, 12));
 }
 
 class SuperBlockSequentialAllocatorSuite : public ::testing::Test {
@@ -125,7 +177,7 @@ TEST_F(SuperBlockSequentialAllocatorSuite, SaveAndLoadAllocatorState) {
 
     ASSERT_EQ(allocator_.state().head, (block_index_t)8);
 
-    for (auto i = 0; i < 18; ++i) {
+    for (auto i = (uint32_t)0; i < saves_per_block(geometry_) + 2; ++i) {
         ASSERT_TRUE(sbm_.save());
     }
 
@@ -138,6 +190,27 @@ TEST_F(SuperBlockSequentialAllocatorSuite, SaveAndLoadAllocatorState) {
     ASSERT_EQ(allocator_.state().head, (block_index_t)9);
 }
 
+TEST_F(SuperBlockSequentialAllocatorSuite, SaveAndLoadAllocatorStateFromDeltas) {
+    ASSERT_TRUE(sbm_.create());
+
+    ASSERT_TRUE(sbm_.save());
+
+    auto allocated = allocator_.allocate(BlockType::File);
+    ASSERT_TRUE(allocated.valid());
+
+    ASSERT_TRUE(sbm_.save());
+
+    ASSERT_EQ(sbm_.location().position, position_of(geometry_, 2));
+    ASSERT_EQ(allocator_.state().head, allocated.block + 1);
+
+    allocator_.state({ BLOCK_INDEX_INVALID });
+
+    ASSERT_TRUE(sbm_.locate());
+
+    ASSERT_EQ(sbm_.location().position, position_of(geometry_, 2));
+    ASSERT_EQ(allocator_.state().head, allocated.block + 1);
+}
+
 TEST_F(SuperBlockSuite, ResilienceSaveInterrupted) {
     ASSERT_TRUE(sbm_.create());
 
@@ -145,13 +218,13 @@ TEST_F(SuperBlockSuite, ResilienceSaveInterrupted) {
         ASSERT_TRUE(sbm_.save());
     }
 
-    ASSERT_EQ(sbm_.location().sector, 5);
+    ASSERT_EQ(sbm_.location().position, position_of(geometry_, 5));
 
     storage_.log().undo(1);
 
     ASSERT_TRUE(sbm_.locate());
 
-    ASSERT_EQ(sbm_.location().sector, 4);
+    ASSERT_EQ(sbm_.location().position, position_of(geometry_, 4));
 }
 
 TEST_F(SuperBlockSuite, ResilienceBlockRolloverInterrupted) {
@@ -161,7 +234,7 @@ TEST_F(SuperBlockSuite, ResilienceBlockRolloverInterrupted) {
 
     storage_.log().copy_on_write(true);
 
-    for (auto i = 0; i < 18; ++i) {
+    for (auto i = (uint32_t)0; i < saves() + 2; ++i) {
         ASSERT_TRUE(sbm_.save());
     }
 
@@ -170,5 +243,5 @@ TEST_F(SuperBlockSuite, ResilienceBlockRolloverInterrupted) {
     ASSERT_TRUE(sbm_.locate());
 
     ASSERT_EQ(sbm_.location().block, old.block);
-    ASSERT_EQ(sbm_.location().sector, 15);
+    ASSERT_EQ(sbm_.location().position, position_of(geometry_, saves() - 1));
 }
@@ -52,11 +52,11 @@ TEST_F(WanderingBlockSuite, SavingAFewRevisions) {
         ASSERT_TRUE(manager_.save());
     }
 
-    ASSERT_EQ(manager_.location().sector, 5);
+    ASSERT_EQ(manager_.location().position, (uint32_t)(5 * sizeof(SimpleState)));
 
     ASSERT_TRUE(manager_.locate());
 
-    ASSERT_EQ(manager_.location().sector, 5);
+    ASSERT_EQ(manager_.location().position, (uint32_t)(5 * sizeof(SimpleState)));
 }
 
 TEST_F(WanderingBlockSuite, CreatingSmallFile) {
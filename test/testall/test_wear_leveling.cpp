@@ -0,0 +1,334 @@
+#include <gtest/gtest.h>
+
+#include "phylum/file_system.h"
+#include "phylum/wear_leveling_allocator.h"
+#include "backends/linux_memory/linux_memory.h"
+
+#include "utilities.h"
+
+using namespace phylum;
+
+class WearLevelingSuite : public ::testing::Test {
+protected:
+    Geometry geometry_{ 32, 4, 4, 512 };
+    LinuxMemoryBackend storage_;
+    WearLevelingBlockAllocator allocator_{ storage_ };
+
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(storage_.initialize(geometry_));
+        ASSERT_TRUE(storage_.open());
+        ASSERT_TRUE(allocator_.initialize(geometry_));
+    }
+
+    void TearDown() override {
+        ASSERT_TRUE(storage_.close());
+    }
+
+    void write_head(block_index_t block, block_age_t age) {
+        BlockHead head{ BlockType::File };
+        head.fill();
+        head.age = age;
+        ASSERT_TRUE(storage_.erase(block));
+        ASSERT_TRUE(storage_.write({ block, 0 }, &head, sizeof(BlockHead)));
+    }
+
+};
+
+class RecordingMigrator : public BlockMigrator {
+public:
+    std::vector<std::pair<block_index_t, block_index_t>> moved;
+
+public:
+    bool migrate(block_index_t from, AllocatedBlock to) override {
+        moved.push_back({ from, to.block });
+        return true;
+    }
+
+};
+
+TEST_F(WearLevelingSuite, AllocatesLeastWornBlocksFirst) {
+    for (auto i = 0; i < 32 - 3; ++i) {
+        ASSERT_TRUE(is_valid_block(allocator_.allocate(BlockType::File).block));
+    }
+
+    ASSERT_EQ(allocator_.number_of_free_blocks(), (uint32_t)0);
+
+    ASSERT_TRUE(allocator_.free(10, 5));
+    ASSERT_TRUE(allocator_.free(20, 2));
+    ASSERT_TRUE(allocator_.free(7, 9));
+
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)20);
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, (block_index_t)10);
+
+    auto last = allocator_.allocate(BlockType::File);
+    ASSERT_EQ(last.block, (block_index_t)7);
+    ASSERT_EQ(last.age, (block_age_t)10);
+}
+
+TEST_F(WearLevelingSuite, FindsAgesWhenInitializing) {
+    write_head(5, 7);
+    write_head(6, 2);
+    ASSERT_TRUE(allocator_.free(6, 0));
+
+    WearLevelingBlockAllocator other{ storage_ };
+    ASSERT_TRUE(other.initialize(geometry_));
+
+    ASSERT_EQ(other.number_of_free_blocks(), (uint32_t)(32 - 3 - 1));
+    ASSERT_EQ(other.age(5), (block_age_t)7);
+    ASSERT_EQ(other.age(6), (block_age_t)3);
+    ASSERT_EQ(other.maximum_age(), (block_age_t)7);
+}
+
+TEST_F(WearLevelingSuite, Histogram) {
+    write_head(5, 7);
+    write_head(6, 2);
+    write_head(7, 3);
+    ASSERT_TRUE(allocator_.initialize(geometry_));
+
+    uint32_t counts[4];
+    ASSERT_EQ(allocator_.histogram(counts, 4, 2), (uint32_t)32);
+    ASSERT_EQ(counts[0], (uint32_t)29);
+    ASSERT_EQ(counts[1], (uint32_t)2);
+    ASSERT_EQ(counts[2], (uint32_t)0);
+    ASSERT_EQ(counts[3], (uint32_t)1);
+}
+
+TEST_F(WearLevelingSuite, LevelingMovesColdBlocks) {
+    allocator_.threshold(4);
+
+    std::vector<block_index_t> cold;
+    for (auto i = 0; i < 10; ++i) {
+        cold.push_back(allocator_.allocate(BlockType::File).block);
+    }
+
+    // Everything else gets worn by a busy writer.
+    for (auto i = 0; i < 8; ++i) {
+        std::vector<block_index_t> hot;
+        for (auto j = 0; j < 32 - 3 - 10; ++j) {
+            hot.push_back(allocator_.allocate(BlockType::File).block);
+        }
+        for (auto block : hot) {
+            ASSERT_TRUE(allocator_.free(block, 0));
+        }
+    }
+
+    ASSERT_EQ(allocator_.spread(), (block_age_t)8);
+
+    RecordingMigrator migrator;
+    ASSERT_TRUE(allocator_.level(migrator));
+
+    ASSERT_EQ(allocator_.migrations(), (uint32_t)1);
+    ASSERT_EQ(migrator.moved.size(), (size_t)1);
+    ASSERT_EQ(migrator.moved[0].first, cold[0]);
+    ASSERT_EQ(allocator_.age(migrator.moved[0].first), (block_age_t)1);
+    ASSERT_EQ(allocator_.age(migrator.moved[0].second), (block_age_t)8);
+
+    for (auto i = 0; i < 9; ++i) {
+        ASSERT_TRUE(allocator_.level(migrator));
+    }
+
+    ASSERT_EQ(allocator_.migrations(), (uint32_t)10);
+    ASSERT_TRUE(allocator_.level(migrator));
+    ASSERT_EQ(allocator_.migrations(), (uint32_t)10);
+    ASSERT_EQ(allocator_.spread(), (block_age_t)0);
+
+    // The young blocks are the first to be used again.
+    ASSERT_EQ(allocator_.allocate(BlockType::File).block, cold[0]);
+}
+
+TEST_F(WearLevelingSuite, LevelingWaitsForThreshold) {
+    allocator_.allocate(BlockType::File);
+
+    for (auto i = 0; i < 4; ++i) {
+        auto block = allocator_.allocate(BlockType::File).block;
+        ASSERT_TRUE(allocator_.free(block, 0));
+    }
+
+    RecordingMigrator migrator;
+    allocator_.threshold(4);
+    ASSERT_TRUE(allocator_.level(migrator));
+    ASSERT_EQ(allocator_.migrations(), (uint32_t)0);
+}
+
+TEST_F(WearLevelingSuite, FileSystemKeepsAgesInHeads) {
+    Geometry geometry{ 128, 4, 4, 512 };
+    LinuxMemoryBackend storage;
+    ASSERT_TRUE(storage.initialize(geometry));
+    ASSERT_TRUE(storage.open());
+
+    WearLevelingBlockAllocator allocator{ storage };
+    ASSERT_TRUE(allocator.initialize(geometry));
+
+    // Wear every block a little, so that a head written with age 0 stands
+    // out after mounting again.
+    for (auto round = 0; round < 2; ++round) {
+        std::vector<block_index_t> taken;
+        for (auto i = 0; i < 128 - 3; ++i) {
+            taken.push_back(allocator.allocate(BlockType::File).block);
+        }
+        for (auto block : taken) {
+            ASSERT_TRUE(allocator.free(block, 0));
+        }
+    }
+
+    {
+        FileSystem fs{ storage, allocator };
+        ASSERT_TRUE(fs.mount(true));
+
+        uint8_t buffer[256];
+        memset(buffer, 0xcc, sizeof(buffer));
+
+        auto writing = fs.open("test.bin");
+        for (auto wrote = (uint32_t)0; wrote < geometry.block_size() * 4; wrote += sizeof(buffer)) {
+            ASSERT_EQ(writing.write(buffer, sizeof(buffer)), (int32_t)sizeof(buffer));
+        }
+        writing.close();
+    }
+
+    // As though we lost power, the ages come back from the heads.
+    WearLevelingBlockAllocator other{ storage };
+    ASSERT_TRUE(other.initialize(geometry));
+
+    auto taken = 0;
+    for (auto block = (block_index_t)3; block < geometry.number_of_blocks; ++block) {
+        ASSERT_GE(other.age(block), (block_age_t)2);
+        if (other.age(block) == allocator.age(block)) {
+            taken++;
+        }
+    }
+    ASSERT_EQ(taken, (int32_t)(128 - 3));
+    ASSERT_LE(other.spread(), (block_age_t)1);
+
+    ASSERT_TRUE(storage.close());
+}
+
+TEST_F(WearLevelingSuite, FileSystemFreesIntoAllocator) {
+    Geometry geometry{ 32, 4, 4, 512 };
+    LinuxMemoryBackend storage;
+    ASSERT_TRUE(storage.initialize(geometry));
+    ASSERT_TRUE(storage.open());
+
+    WearLevelingBlockAllocator allocator{ storage };
+    ASSERT_TRUE(allocator.initialize(geometry));
+
+    uint8_t buffer[256];
+    memset(buffer, 0xcc, sizeof(buffer));
+
+    {
+        FileSystem fs{ storage, allocator };
+        ASSERT_TRUE(fs.mount(true));
+
+        // More blocks are written than there are, so removed files' blocks
+        // have to be used again.
+        for (auto round = 0; round < 12; ++round) {
+            auto free = allocator.number_of_free_blocks();
+
+            auto writing = fs.open("test.bin");
+            for (auto wrote = (uint32_t)0; wrote < geometry.block_size() * 4; wrote += sizeof(buffer)) {
+                ASSERT_EQ(writing.write(buffer, sizeof(buffer)), (int32_t)sizeof(buffer));
+            }
+            writing.close();
+
+            ASSERT_TRUE(fs.remove("test.bin"));
+
+            // Every block came back to the allocator, aged by being freed.
+            ASSERT_EQ(allocator.number_of_free_blocks(), free);
+        }
+    }
+
+    WearLevelingBlockAllocator other{ storage };
+    ASSERT_TRUE(other.initialize(geometry));
+
+    auto worn = (uint32_t)0;
+    for (auto block = (block_index_t)3; block < geometry.number_of_blocks; ++block) {
+        ASSERT_EQ(other.age(block), allocator.age(block));
+        if (other.age(block) >= 2) {
+            worn++;
+        }
+    }
+    ASSERT_GE(worn, other.number_of_free_blocks());
+
+    ASSERT_TRUE(storage.close());
+}
+
+TEST_F(WearLevelingSuite, FileSystemMigratesColdFiles) {
+    Geometry geometry{ 32, 4, 4, 512 };
+    LinuxMemoryBackend storage;
+    ASSERT_TRUE(storage.initialize(geometry));
+    ASSERT_TRUE(storage.open());
+
+    WearLevelingBlockAllocator allocator{ storage };
+    ASSERT_TRUE(allocator.initialize(geometry));
+    allocator.threshold(2);
+
+    uint8_t buffer[256];
+    auto cold_size = geometry.block_size() * 3 + 100;
+
+    auto verify = [&](FileSystem &fs) {
+        auto reading = fs.open("cold.bin", true);
+        ASSERT_TRUE(reading.open());
+        for (auto read = (uint32_t)0; read < cold_size; ) {
+            auto bytes = reading.read(buffer, sizeof(buffer));
+            ASSERT_GT(bytes, 0);
+            for (auto i = 0; i < bytes; ++i) {
+                ASSERT_EQ(buffer[i], (uint8_t)((read + i) % 251));
+            }
+            read += bytes;
+        }
+        ASSERT_EQ(reading.read(buffer, sizeof(buffer)), 0);
+        reading.close();
+    };
+
+    {
+        FileSystem fs{ storage, allocator };
+        ASSERT_TRUE(fs.mount(true));
+
+        auto writing = fs.open("cold.bin");
+        for (auto wrote = (uint32_t)0; wrote < cold_size; ) {
+            auto bytes = cold_size - wrote < sizeof(buffer) ? cold_size - wrote : (uint32_t)sizeof(buffer);
+            for (auto i = (uint32_t)0; i < bytes; ++i) {
+                buffer[i] = (uint8_t)((wrote + i) % 251);
+            }
+            ASSERT_EQ(writing.write(buffer, bytes), (int32_t)bytes);
+            wrote += bytes;
+        }
+        writing.close();
+
+        // Everything else gets worn by a file that's written and removed.
+        memset(buffer, 0xcc, sizeof(buffer));
+        for (auto round = 0; round < 12; ++round) {
+            auto hot = fs.open("hot.bin");
+            for (auto wrote = (uint32_t)0; wrote < geometry.block_size() * 4; wrote += sizeof(buffer)) {
+                ASSERT_EQ(hot.write(buffer, sizeof(buffer)), (int32_t)sizeof(buffer));
+            }
+            hot.close();
+            ASSERT_TRUE(fs.remove("hot.bin"));
+        }
+
+        ASSERT_GT(allocator.spread(), allocator.threshold());
+
+        FileSystemMigrator migrator{ fs };
+        for (auto i = 0; i < 32; ++i) {
+            ASSERT_TRUE(allocator.level(migrator));
+        }
+
+        // The blocks the file system keeps for itself are passed over, and
+        // the file's are moved until they've caught up.
+        auto migrations = allocator.migrations();
+        ASSERT_GE(migrations, (uint32_t)4);
+        ASSERT_TRUE(allocator.level(migrator));
+        ASSERT_EQ(allocator.migrations(), migrations);
+
+        verify(fs);
+    }
+
+    WearLevelingBlockAllocator other{ storage };
+    ASSERT_TRUE(other.initialize(geometry));
+
+    FileSystem fs{ storage, other };
+    ASSERT_TRUE(fs.mount());
+    verify(fs);
+
+    ASSERT_TRUE(storage.close());
+}
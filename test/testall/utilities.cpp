@@ -156,35 +156,33 @@ void BlockHelper::dump(block_index_t block) {
     case BlockType::SuperBlock: {
         break;
     }
-    case BlockType::Leaf: {
-        auto layout = get_tree_layout(*storage_, empty_allocator, BlockAddress{ block, SectorSize });
-        while (layout.walk_single_block(SerializerType::HeadNodeSize)) {
-            SerializerType::serialized_node_t node;
-            storage_->read(layout.address(), &node, sizeof(node));
-            if (!node.valid()) {
-                break;
+    case BlockType::Leaf:
+    case BlockType::Index: {
+        SerializerType serializer;
+        for (auto sector = (sector_index_t)1; sector < g.sectors_per_block(); ++sector) {
+            auto available = (size_t)g.sector_size;
+            if (sector == g.sectors_per_block() - 1) {
+                available -= sizeof(BlockTail);
             }
 
-            auto live = std::find(info.live.begin(), info.live.end(), layout.address()) != info.live.end();
-            sdebug() << "  " << (live ? "L" : " ") << (int32_t)node.level;
+            uint8_t buffer[SectorSize];
+            auto address = BlockAddress{ block, (uint32_t)(sector * g.sector_size) };
+            storage_->read(address, buffer, available);
 
-            layout.add(SerializerType::HeadNodeSize);
-        }
-        break;
-    }
-    case BlockType::Index: {
-        auto layout = get_tree_layout(*storage_, empty_allocator, BlockAddress{ block, SectorSize });
-        while (layout.walk_single_block(SerializerType::HeadNodeSize)) {
-            SerializerType::serialized_node_t node;
-            storage_->read(layout.address(), &node, sizeof(node));
-            if (!node.valid()) {
-                break;
-            }
+            auto position = (size_t)0;
+            while (true) {
+                NodeType node;
+                auto size = serializer.record_size(buffer + position, available - position);
+                if (size == 0 || !serializer.deserialize(buffer + position, size, &node, nullptr)) {
+                    break;
+                }
 
-            auto live = std::find(info.live.begin(), info.live.end(), layout.address()) != info.live.end();
-            sdebug() << "  " << (live ? "L" : " ") << (int32_t)node.level;
+                auto node_address = BlockAddress{ block, (uint32_t)(address.position + position) };
+                auto live = std::find(info.live.begin(), info.live.end(), node_address) != info.live.end();
+                sdebug() << "  " << (live ? "L" : " ") << (int32_t)node.depth;
 
-            layout.add(SerializerType::HeadNodeSize);
+                position += size;
+            }
         }
         break;
     }